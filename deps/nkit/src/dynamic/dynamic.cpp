@@ -806,6 +806,12 @@ namespace nkit
       detail::Impl<detail::LIST>::PushBack(*this, item);
   }
 
+  void Dynamic::Reserve(const size_t size)
+  {
+    if (IsList())
+      detail::Impl<detail::LIST>::Reserve(*this, size);
+  }
+
   void Dynamic::PushFront(const Dynamic & item)
   {
     if (IsList())
@@ -15,7 +15,10 @@
 */
 
 #include <stack>
+#include <vector>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <errno.h>
 
 #include <yajl/yajl_parse.h>
@@ -32,15 +35,111 @@ namespace nkit
     int json::xalloc = ::std::ios_base::xalloc();
   } // namespace detail
 
-  const std::string INT_64_MAX =
-      string_cast(std::numeric_limits<int64_t>::max());
-  const std::string INT_64_MIN =
-      string_cast(std::numeric_limits<int64_t>::min()).substr(1);
-  const size_t INT_64_MAX_LEN = INT_64_MAX.size();
-  const size_t INT_64_MIN_LEN = INT_64_MIN.size();
-  const std::string UINT64_T_MAX =
-      string_cast(std::numeric_limits<uint64_t>::max());
-  const size_t UINT64_T_MAX_LEN = UINT64_T_MAX.size();
+  //----------------------------------------------------------------------------
+  // Powers of ten which are exactly representable by double
+  static const double EXACT_POWERS_OF_10[] =
+  {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+  static const int MAX_EXACT_POWER_OF_10 = 22;
+  static const uint64_t MAX_EXACT_DOUBLE_MANTISSA = 1ULL << 53;
+  static const size_t MAX_UINT64_DIGITS = 19; // any 19 digits fit uint64_t
+  static const size_t NUMERIC_BUFFER_SIZE = 1024;
+
+  // Slow path for numbers which can't be converted exactly by fast path
+  static Dynamic parse_double(const char * str, size_t size)
+  {
+    char buffer[NUMERIC_BUFFER_SIZE];
+    if (unlikely(size >= NUMERIC_BUFFER_SIZE))
+      return Dynamic(strtod(std::string(str, size).c_str(), NULL));
+    memcpy(buffer, str, size);
+    buffer[size] = 0;
+    return Dynamic(strtod(buffer, NULL));
+  }
+
+  // Parses number which is already validated by yajl directly from JSON text.
+  // Integers become int64_t, or uint64_t if they don't fit int64_t, or double
+  // if they don't fit uint64_t. Fractions and exponents are converted by the
+  // Clinger's fast path (as in fast_float) if mantissa and exponent are small
+  // enough to give exact result, otherwise by strtod.
+  static Dynamic parse_number(const char * str, size_t size)
+  {
+    const char * p = str;
+    const char * end = str + size;
+    bool negative = (*p == '-');
+    if (negative)
+      ++p;
+
+    uint64_t mantissa = 0;
+    size_t digits = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; ++p, ++digits)
+      mantissa = mantissa * 10 + static_cast<unsigned>(*p - '0');
+
+    if (p == end)
+    {
+      if (digits <= MAX_UINT64_DIGITS)
+      {
+        if (!negative && mantissa <= static_cast<uint64_t>(
+            std::numeric_limits<int64_t>::max()))
+          return Dynamic(static_cast<int64_t>(mantissa));
+        if (negative && mantissa <= static_cast<uint64_t>(
+            std::numeric_limits<int64_t>::max()) + 1)
+          return Dynamic(static_cast<int64_t>(0 - mantissa));
+        if (!negative)
+          return Dynamic::UInt64(mantissa);
+        return parse_double(str, size);
+      }
+
+      // 20 digits may still fit uint64_t
+      if (!negative && digits == MAX_UINT64_DIGITS + 1)
+      {
+        uint64_t head = 0;
+        for (const char * d = str; d < end - 1; ++d)
+          head = head * 10 + static_cast<unsigned>(*d - '0');
+        uint64_t last = static_cast<unsigned>(end[-1] - '0');
+        const uint64_t max = std::numeric_limits<uint64_t>::max();
+        if (head < max / 10 || (head == max / 10 && last <= max % 10))
+          return Dynamic::UInt64(head * 10 + last);
+      }
+      return parse_double(str, size);
+    }
+
+    int exponent = 0;
+    if (*p == '.')
+    {
+      const char * fraction = ++p;
+      for (; p < end && *p >= '0' && *p <= '9'; ++p)
+        mantissa = mantissa * 10 + static_cast<unsigned>(*p - '0');
+      exponent = -static_cast<int>(p - fraction);
+      digits += static_cast<size_t>(p - fraction);
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+      ++p;
+      bool negative_exponent = (*p == '-');
+      if (*p == '-' || *p == '+')
+        ++p;
+      int e = 0;
+      for (; p < end && e < 10000; ++p)
+        e = e * 10 + (*p - '0');
+      if (p < end)
+        return parse_double(str, size);
+      exponent += negative_exponent ? -e : e;
+    }
+
+    if (digits > MAX_UINT64_DIGITS || mantissa > MAX_EXACT_DOUBLE_MANTISSA ||
+        exponent < -MAX_EXACT_POWER_OF_10 || exponent > MAX_EXACT_POWER_OF_10)
+      return parse_double(str, size);
+
+    double value = static_cast<double>(mantissa);
+    if (exponent < 0)
+      value /= EXACT_POWERS_OF_10[-exponent];
+    else
+      value *= EXACT_POWERS_OF_10[exponent];
+    return Dynamic(negative ? -value : value);
+  }
 
   class DynamicConstructor
   {
@@ -51,8 +150,6 @@ namespace nkit
       CT_ARRAY
     };
 
-    static const size_t NUMERIC_BUFFER_SIZE = 1024;
-
   public:
     DynamicConstructor(Dynamic * root)
       //: root_(root)
@@ -176,53 +273,12 @@ namespace nkit
       return true;
     }
 
-    Dynamic ParseNumber(const char * str, size_t size)
-    {
-      assert(size < NUMERIC_BUFFER_SIZE);
-      memcpy((void*)numeric_buffer_, (void*)str, size);
-      numeric_buffer_[size] = 0;
-      size_t digits_count = size;
-      const char * digits = numeric_buffer_;
-      const char * INT_64_BOUNDERY = INT_64_MAX.c_str();
-      size_t INT_64_BOUNDERY_LEN = INT_64_MAX_LEN;
-      if (str[0] == '-')
-      {
-        INT_64_BOUNDERY_LEN = INT_64_MIN_LEN;
-        INT_64_BOUNDERY = INT_64_MIN.c_str();
-        --digits_count;
-        ++digits;
-      }
-
-      bool has_dot = strchr(numeric_buffer_, '.') != NULL;
-
-      if (has_dot || digits_count > UINT64_T_MAX_LEN)
-      {
-        return Dynamic(strtod(numeric_buffer_, NULL));
-      }
-      else if ((digits_count < INT_64_BOUNDERY_LEN)
-        || (digits_count == INT_64_BOUNDERY_LEN
-            && strcmp(digits, INT_64_BOUNDERY) <= 0))
-      {
-        int64_t tmp = NKIT_STRTOLL(numeric_buffer_, NULL, 10);
-        return Dynamic(tmp);
-      }
-      else
-      {
-        char * endptr = NULL;
-        uint64_t ui64 = NKIT_STRTOULL(numeric_buffer_, &endptr, 10);
-        if (unlikely((errno == ERANGE) || *endptr != '\0'))
-          return Dynamic(strtod(numeric_buffer_, NULL));
-        else
-          return Dynamic(ui64);
-      }
-    }
-
     bool OnNumber(const char * str, size_t len)
     {
       if (container_type_ == CT_MAP)
-        *current_value_ = ParseNumber(str, len);
+        *current_value_ = parse_number(str, len);
       else if (container_type_ == CT_ARRAY)
-        current_container_->PushBack(ParseNumber(str, len));
+        current_container_->PushBack(parse_number(str, len));
       else
         return false;
       return true;
@@ -262,9 +318,12 @@ namespace nkit
       return true;
     }
 
+    // Keys are not interned: StringDynamicMap owns its keys by value, so
+    // every node gets its own std::string anyway (short keys fit SSO buffer)
     bool OnMapKey(const char * str, size_t len)
     {
-      current_value_ = & (*current_container_)[std::string(str, len)];
+      key_.assign(str, len);
+      current_value_ = & (*current_container_)[key_];
       return true;
     }
 
@@ -323,12 +382,14 @@ namespace nkit
     Dynamic * current_value_;
     ContainerType container_type_;
     std::stack<Dynamic *> stack_;
-    char numeric_buffer_[NUMERIC_BUFFER_SIZE];
+    std::string key_;
   };
 
   static yajl_callbacks callbacks = {
     &DynamicConstructor::on_null,
     &DynamicConstructor::on_boolean,
+    // yajl_integer fails on numbers which don't fit long long,
+    // so all numbers go to on_number
     NULL, // &DynamicConstructor::on_integer,
     NULL, // &DynamicConstructor::on_double,
     &DynamicConstructor::on_number,
@@ -340,55 +401,121 @@ namespace nkit
     &DynamicConstructor::on_end_array
   };
 
-  Dynamic DynamicFromYajl(const std::string & json, std::string * error)
+  //----------------------------------------------------------------------------
+  DynamicJsonParser::DynamicJsonParser()
+    : constructor_(new DynamicConstructor(&result_))
+    , handle_(yajl_alloc(&callbacks, NULL, (void *) constructor_))
   {
-    Dynamic result;
-    DynamicConstructor constructor(&result);
-    yajl_handle hand = yajl_alloc(&callbacks, NULL, (void *) &constructor);
-    if (!hand)
+    if (handle_)
+      yajl_config(handle_, yajl_allow_comments, 1);
+  }
+
+  DynamicJsonParser::~DynamicJsonParser()
+  {
+    if (handle_)
+      yajl_free(handle_);
+    delete constructor_;
+  }
+
+  bool DynamicJsonParser::Feed(const char * chunk, size_t len,
+      std::string * const error)
+  {
+    if (!handle_)
     {
       *error = "Could not allocate yajl handler";
-      return Dynamic();
+      return false;
     }
 
-    yajl_config(hand, yajl_allow_comments, 1);
-
-    yajl_status st = yajl_parse(hand,
-        (unsigned const char *)(json.c_str()), json.size());
-    if (st == yajl_status_ok)
-      st = yajl_complete_parse(hand);
-
+    yajl_status st = yajl_parse(handle_, (unsigned const char *)chunk, len);
     if (st != yajl_status_ok)
     {
       unsigned char * message =
-          yajl_get_error(hand, 1,
-              (unsigned const char *)json.c_str(), json.size());
+          yajl_get_error(handle_, 1, (unsigned const char *)chunk, len);
       *error = std::string((const char *)message);
-      yajl_free_error(hand, message);
-      result = Dynamic();
+      yajl_free_error(handle_, message);
+      return false;
     }
+    return true;
+  }
 
-    yajl_free(hand);
+  Dynamic DynamicJsonParser::Finish(std::string * const error)
+  {
+    if (!handle_)
+    {
+      *error = "Could not allocate yajl handler";
+      return Dynamic();
+    }
+
+    if (yajl_complete_parse(handle_) != yajl_status_ok)
+    {
+      unsigned char * message = yajl_get_error(handle_, 0, NULL, 0);
+      *error = std::string((const char *)message);
+      yajl_free_error(handle_, message);
+      return Dynamic();
+    }
+    return result_;
+  }
 
-    return result;
+  //----------------------------------------------------------------------------
+  Dynamic DynamicFromYajl(const char * json, size_t size, std::string * error)
+  {
+    DynamicJsonParser parser;
+    if (!parser.Feed(json, size, error))
+      return Dynamic();
+    return parser.Finish(error);
   }
 
   Dynamic DynamicFromJson(const std::string & json, std::string * error)
   {
-    return DynamicFromYajl(json, error);
+    return DynamicFromYajl(json.data(), json.size(), error);
+  }
+
+  Dynamic DynamicFromJson(const char * json, size_t size, std::string * error)
+  {
+    return DynamicFromYajl(json, size, error);
   }
 
+  static const size_t JSON_FILE_CHUNK_SIZE = 64 * 1024;
+
   Dynamic DynamicFromJsonFile(const std::string & path, std::string * error)
   {
-    std::string json;
-    if (!path.empty() && !text_file_to_string(path, &json, error))
+    if (path.empty())
+      return Dynamic::Dict();
+
+    FILE * source = std::fopen(path.c_str(), "rb");
+    if (!source)
     {
       *error = "Could not open file: '" + path + "'";
       return Dynamic();
     }
-    if (json.empty())
-      json = "{}";
-    return DynamicFromJson(json, error);
+
+    DynamicJsonParser parser;
+    std::vector<char> buf(JSON_FILE_CHUNK_SIZE);
+    bool empty = true;
+    bool ok = true;
+    size_t size;
+    while ((size = std::fread(&buf[0], 1, buf.size(), source)) > 0)
+    {
+      empty = false;
+      if (!parser.Feed(&buf[0], size, error))
+      {
+        ok = false;
+        break;
+      }
+    }
+
+    if (ok && std::ferror(source))
+    {
+      *error = strerror(errno);
+      ok = false;
+    }
+    std::fclose(source);
+
+    if (!ok)
+      return Dynamic();
+    if (empty)
+      return Dynamic::Dict();
+    return parser.Finish(error);
   }
 
   //--------------------------------------------------------------------------
@@ -17,9 +17,72 @@
 #include "nkit/xml2var.h"
 #include "nkit/dynamic/dynamic_builder.h"
 #include "nkit/dynamic_xml.h"
+#include "nkit/thread.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
 
 namespace nkit
 {
+  static const size_t XML_FILE_CHUNK_SIZE = 64 * 1024;
+  static const size_t XML_PARALLEL_SHARD_SIZE = 4 * 1024 * 1024;
+
+  // Reads file straight into Expat's buffer, chunk by chunk
+  template <typename Builder>
+  static bool FeedFile(Builder & builder, const std::string & path,
+      std::string * const error)
+  {
+    FILE * source = std::fopen(path.c_str(), "rb");
+    if (!source)
+    {
+      *error = "Could not open file: '" + path + "': " + strerror(errno);
+      return false;
+    }
+
+    bool result = true;
+    bool empty = true;
+    while (true)
+    {
+      void * buf = builder.GetBuffer(XML_FILE_CHUNK_SIZE);
+      if (!buf)
+      {
+        *error = "Out of memory";
+        result = false;
+        break;
+      }
+
+      size_t size = std::fread(buf, 1, XML_FILE_CHUNK_SIZE, source);
+      if (size == 0 && std::ferror(source))
+      {
+        *error = strerror(errno);
+        result = false;
+        break;
+      }
+
+      bool last = size < XML_FILE_CHUNK_SIZE;
+      if (empty && size == 0 && last)
+      {
+        *error = "Could not open file: '" + path + "'";
+        result = false;
+        break;
+      }
+      empty = false;
+
+      if (!builder.ParseBuffer(size, last, error))
+      {
+        result = false;
+        break;
+      }
+
+      if (last)
+        break;
+    }
+
+    std::fclose(source);
+    return result;
+  }
+
   Dynamic DynamicFromAnyXml(const std::string & xml,
       const std::string & options,
       std::string * const root_name,
@@ -55,17 +118,14 @@ namespace nkit
       std::string * const root_name,
       std::string * const error)
   {
-    std::string xml;
-    if (!path.empty() && !text_file_to_string(path, &xml, error))
+    AnyXml2VarBuilder<DynamicBuilder>::Ptr builder = AnyXml2VarBuilder<
+        DynamicBuilder>::Create(options, error);
+    if(!builder)
       return Dynamic();
-
-    if (xml.empty())
-    {
-      *error = "Could not open file: '" + path + "'";
+    if (!FeedFile(*builder, path, error))
       return Dynamic();
-    }
-
-    return DynamicFromAnyXml(xml, options, root_name, error);
+    *root_name = builder->root_name();
+    return builder->var();
   }
 
   Dynamic DynamicFromAnyXmlFile(const std::string & path,
@@ -73,17 +133,14 @@ namespace nkit
       std::string * const root_name,
       std::string * const error)
   {
-    std::string xml;
-    if (!path.empty() && !text_file_to_string(path, &xml, error))
+    AnyXml2VarBuilder<DynamicBuilder>::Ptr builder = AnyXml2VarBuilder<
+        DynamicBuilder>::Create(options, error);
+    if(!builder)
       return Dynamic();
-
-    if (xml.empty())
-    {
-      *error = "Could not open file: '" + path + "'";
+    if (!FeedFile(*builder, path, error))
       return Dynamic();
-    }
-
-    return DynamicFromAnyXml(xml, options, root_name, error);
+    *root_name = builder->root_name();
+    return builder->var();
   }
 
   Dynamic DynamicFromXml(const std::string & xml,
@@ -137,16 +194,573 @@ namespace nkit
         const std::string & mapping,
         std::string * const error)
   {
-    std::string xml;
-    if (!path.empty() && !text_file_to_string(path, &xml, error))
+    StructXml2VarBuilder<DynamicBuilder>::Ptr builder = StructXml2VarBuilder<
+        DynamicBuilder>::Create(options, error);
+    if(!builder)
+      return Dynamic();
+    if (!builder->AddMapping(S_EMPTY_, mapping, error))
       return Dynamic();
+    if (!FeedFile(*builder, path, error))
+      return Dynamic();
+    return builder->var(S_EMPTY_);
+  }
+
+  //----------------------------------------------------------------------------
+  // Parallel parsing of '<root><record/><record/>...</root>' documents
+  //----------------------------------------------------------------------------
+  namespace
+  {
+    const char * find_str(const char * begin, const char * end,
+        const char * str)
+    {
+      size_t len = strlen(str);
+      while (begin < end)
+      {
+        const char * p = static_cast<const char *>(
+            memchr(begin, *str, end - begin));
+        if (!p || static_cast<size_t>(end - p) < len)
+          return NULL;
+        if (memcmp(p, str, len) == 0)
+          return p;
+        begin = p + 1;
+      }
+      return NULL;
+    }
+
+    // Returns pointer past '>' of tag starting at 'p', skipping quoted
+    // attribute values
+    const char * skip_tag(const char * p, const char * end)
+    {
+      char quote = 0;
+      for (; p < end; ++p)
+      {
+        if (quote)
+        {
+          if (*p == quote)
+            quote = 0;
+        }
+        else if (*p == '"' || *p == '\'')
+          quote = *p;
+        else if (*p == '>')
+          return p + 1;
+      }
+      return NULL;
+    }
+
+    // Skips '<!...>' or '<?...?>' markup at 'p'. Returns NULL on error.
+    const char * skip_markup(const char * p, const char * end)
+    {
+      const char * close = NULL;
+      if (end - p >= 4 && memcmp(p, "<!--", 4) == 0)
+        close = find_str(p + 4, end, "-->");
+      else if (end - p >= 9 && memcmp(p, "<![CDATA[", 9) == 0)
+        close = find_str(p + 9, end, "]]>");
+      else if (p[1] == '?')
+        close = find_str(p + 2, end, "?>");
+      else
+      {
+        // <!DOCTYPE ...> with optional internal subset
+        const char * subset = NULL;
+        const char * gt = skip_tag(p, end);
+        for (const char * c = p; gt && c < gt; ++c)
+          if (*c == '[')
+          {
+            subset = c;
+            break;
+          }
+        if (!subset)
+          return gt;
+        close = find_str(subset, end, "]");
+        return close ? skip_tag(close, end) : NULL;
+      }
+
+      if (!close)
+        return NULL;
+      return close + (p[1] == '?' ? 2 : 3);
+    }
+
+    bool is_space(char c)
+    {
+      return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    enum XmlHeadState
+    {
+      XML_HEAD_FOUND,
+      XML_HEAD_INCOMPLETE, // more data is needed
+      XML_HEAD_UNSUPPORTED // '<root/>'
+    };
+
+    // Skips prolog and finds root start tag. '*head_end' is set past its '>'
+    XmlHeadState find_xml_head(const char * p, const char * end,
+        std::string * root_name, const char ** head_end)
+    {
+      while (true)
+      {
+        while (p < end && *p != '<')
+          ++p;
+        if (end - p < 2)
+          return XML_HEAD_INCOMPLETE;
+        if (p[1] != '!' && p[1] != '?')
+          break;
+        if (!(p = skip_markup(p, end)))
+          return XML_HEAD_INCOMPLETE;
+      }
+
+      const char * name = p + 1, * name_end = name;
+      while (name_end < end && !is_space(*name_end) && *name_end != '>'
+          && *name_end != '/')
+        ++name_end;
+      if (!(*head_end = skip_tag(name_end, end)))
+        return XML_HEAD_INCOMPLETE;
+      if (*(*head_end - 2) == '/')
+        return XML_HEAD_UNSUPPORTED;
+      root_name->assign(name, name_end);
+      return XML_HEAD_FOUND;
+    }
+
+    struct XmlShards
+    {
+      std::string root_name_;
+      const char * head_end_; // past '>' of root start tag
+      std::vector<const char *> bounds_; // shard i is [bounds_[i], bounds_[i+1])
+    };
 
-    if (xml.empty())
+    // Finds up to 'count' shards of root content, each one starting and
+    // ending at the boundary between root's child elements
+    bool split_xml(const std::string & xml, size_t count, XmlShards * shards)
     {
-      *error = "Could not open file: '" + path + "'";
+      const char * p = xml.data(), * end = p + xml.size();
+      if (find_xml_head(p, end, &shards->root_name_, &shards->head_end_) !=
+          XML_HEAD_FOUND)
+        return false;
+
+      // root end tag
+      const char * tail = end;
+      while (true)
+      {
+        const char * lt = NULL;
+        for (const char * c = tail - 1; c >= shards->head_end_; --c)
+          if (*c == '<')
+          {
+            lt = c;
+            break;
+          }
+        if (!lt)
+          return false;
+        if (lt[1] == '/')
+        {
+          tail = lt;
+          break;
+        }
+        tail = lt; // trailing comment or PI
+      }
+      if (static_cast<size_t>(end - tail) < shards->root_name_.size() + 2 ||
+          memcmp(tail + 2, shards->root_name_.data(),
+              shards->root_name_.size()) != 0)
+        return false;
+
+      // scan root content tracking element depth
+      const char * body = shards->head_end_;
+      size_t step = (tail - body) / count + 1;
+      const char * next_target = body + step;
+      shards->bounds_.push_back(body);
+      size_t depth = 0;
+      p = body;
+      while (p < tail)
+      {
+        p = static_cast<const char *>(memchr(p, '<', tail - p));
+        if (!p)
+          break;
+        bool closed = false;
+        if (p[1] == '/')
+        {
+          if (depth == 0 || !(p = skip_tag(p, tail)))
+            return false;
+          closed = --depth == 0;
+        }
+        else if (p[1] == '!' || p[1] == '?')
+        {
+          if (!(p = skip_markup(p, tail)))
+            return false;
+        }
+        else
+        {
+          if (!(p = skip_tag(p, tail)))
+            return false;
+          if (*(p - 2) == '/')
+            closed = depth == 0;
+          else
+            ++depth;
+        }
+
+        if (closed && p >= next_target && p < tail)
+        {
+          shards->bounds_.push_back(p);
+          while (next_target <= p)
+            next_target += step;
+        }
+      }
+
+      if (depth != 0)
+        return false;
+      shards->bounds_.push_back(tail);
+      return true;
+    }
+
+    class ParseShardTask: public Runnable
+    {
+    public:
+      ParseShardTask(StructXml2VarBuilder<DynamicBuilder>::Ptr builder,
+          const std::string & head, const char * begin, const char * end,
+          const std::string & tail)
+        : builder_(builder)
+        , head_(head)
+        , begin_(begin)
+        , end_(end)
+        , tail_(tail)
+        , ok_(false)
+      {}
+
+      void Run()
+      {
+        ok_ = builder_->Feed(head_.data(), head_.size(), false, &error_) &&
+          builder_->Feed(begin_, end_ - begin_, false, &error_) &&
+          builder_->Feed(tail_.data(), tail_.size(), true, &error_);
+        if (ok_)
+          result_ = builder_->var(S_EMPTY_);
+      }
+
+      bool ok() const { return ok_; }
+      const std::string & error() const { return error_; }
+      const Dynamic & result() const { return result_; }
+
+    private:
+      StructXml2VarBuilder<DynamicBuilder>::Ptr builder_;
+      const std::string & head_;
+      const char * begin_;
+      const char * end_;
+      const std::string & tail_;
+      bool ok_;
+      std::string error_;
+      Dynamic result_;
+    };
+
+    // Parses shards [bounds[i], bounds[i + 1]) in parallel, each one as
+    // 'head + shard + tail' ('last_tail' for the last one), and appends
+    // their records to 'result'
+    bool parse_shards(const Dynamic & options, const Dynamic & mapping,
+        const std::string & head, const std::vector<const char *> & bounds,
+        const std::string & tail, const std::string & last_tail,
+        Dynamic * result, std::string * const error)
+    {
+      // Builders are created here, because Dynamic's reference counters
+      // (options and mapping) must not be touched from worker threads.
+      std::vector<ParseShardTask *> tasks;
+      std::vector<Runnable *> runnables;
+      bool ok = true;
+      for (size_t i = 0; ok && i + 1 < bounds.size(); ++i)
+      {
+        StructXml2VarBuilder<DynamicBuilder>::Ptr builder =
+            StructXml2VarBuilder<DynamicBuilder>::Create(options, error);
+        ok = builder && builder->AddMapping(S_EMPTY_, mapping, error);
+        if (ok)
+        {
+          tasks.push_back(new ParseShardTask(builder, head, bounds[i],
+              bounds[i + 1], i + 2 < bounds.size() ? tail : last_tail));
+          runnables.push_back(tasks.back());
+        }
+      }
+
+      if (ok)
+        RunInParallel(runnables);
+
+      for (size_t i = 0; ok && i < tasks.size(); ++i)
+      {
+        if (!tasks[i]->ok())
+        {
+          *error = tasks[i]->error();
+          ok = false;
+        }
+        else if (result->IsUndef())
+          *result = tasks[i]->result();
+        else
+          result->Extend(tasks[i]->result());
+      }
+
+      for (size_t i = 0; i < tasks.size(); ++i)
+        delete tasks[i];
+
+      return ok;
+    }
+
+    // Finds boundaries between root's children in root content read so far.
+    // Markup cut by the end of data is scanned again when more data comes.
+    class XmlRecordScanner
+    {
+    public:
+      XmlRecordScanner()
+        : depth_(0)
+        , offset_(0)
+        , boundary_(0)
+        , root_end_(false)
+      {}
+
+      // Scans 'data' up to its end, up to root end tag or up to the first
+      // boundary at 'limit' offset or further
+      void Scan(const std::string & data, size_t limit)
+      {
+        const char * begin = data.data(), * end = begin + data.size();
+        const char * p = begin + offset_;
+        while (p < end && !root_end_ && boundary_ < limit)
+        {
+          const char * lt = static_cast<const char *>(
+              memchr(p, '<', end - p));
+          if (!lt)
+          {
+            p = end;
+            break;
+          }
+          if (end - lt < 2)
+          {
+            p = lt;
+            break;
+          }
+
+          const char * next = NULL;
+          bool closed = false;
+          if (lt[1] == '/')
+          {
+            if (depth_ == 0)
+              root_end_ = true;
+            else if ((next = skip_tag(lt, end)))
+              closed = --depth_ == 0;
+          }
+          else if (lt[1] == '!' || lt[1] == '?')
+            next = skip_markup(lt, end);
+          else if ((next = skip_tag(lt, end)))
+          {
+            if (*(next - 2) == '/')
+              closed = depth_ == 0;
+            else
+              ++depth_;
+          }
+
+          if (!next)
+          {
+            p = lt;
+            break;
+          }
+          p = next;
+          if (closed)
+            boundary_ = p - begin;
+        }
+        offset_ = p - begin;
+      }
+
+      // Offset of the last boundary found
+      size_t boundary() const { return boundary_; }
+
+      // First 'size' bytes were removed from the beginning of data
+      void Consume(size_t size)
+      {
+        offset_ -= size;
+        boundary_ -= size;
+      }
+
+    private:
+      size_t depth_;
+      size_t offset_;
+      size_t boundary_;
+      bool root_end_;
+    };
+
+    Dynamic dynamic_from_xml_file(const std::string & path,
+        const Dynamic & options, const Dynamic & mapping,
+        std::string * const error)
+    {
+      StructXml2VarBuilder<DynamicBuilder>::Ptr builder = StructXml2VarBuilder<
+          DynamicBuilder>::Create(options, error);
+      if(!builder)
+        return Dynamic();
+      if (!builder->AddMapping(S_EMPTY_, mapping, error))
+        return Dynamic();
+      if (!FeedFile(*builder, path, error))
+        return Dynamic();
+      return builder->var(S_EMPTY_);
+    }
+  } // namespace
+
+  Dynamic DynamicFromXmlParallel(const std::string & xml,
+      const Dynamic & options,
+      const Dynamic & mapping,
+      size_t threads,
+      std::string * const error)
+  {
+    if (!mapping.IsList())
+    {
+      *error = "Parallel parsing supports list mappings only";
       return Dynamic();
     }
 
-    return DynamicFromXml(xml, options, mapping, error);
+    if (threads == 0)
+      threads = hardware_concurrency();
+
+    XmlShards shards;
+    if (threads < 2 || !split_xml(xml, threads, &shards) ||
+        shards.bounds_.size() < 3)
+      return DynamicFromXml(xml, options, mapping, error);
+
+    // Every shard is parsed as '<?xml ...?><root ...>records</root>'
+    std::string head(xml.data(), shards.head_end_);
+    std::string tail("</" + shards.root_name_ + ">");
+
+    Dynamic result;
+    if (!parse_shards(options, mapping, head, shards.bounds_, tail, tail,
+        &result, error))
+      return Dynamic();
+    return result;
+  }
+
+  Dynamic DynamicFromXmlParallel(const std::string & xml,
+      const std::string & options,
+      const std::string & mapping,
+      size_t threads,
+      std::string * const error)
+  {
+    Dynamic options_var = DynamicFromJson(options.empty() ? "{}" : options,
+        error);
+    if (!options_var)
+      return Dynamic();
+    Dynamic mapping_var = DynamicFromJson(mapping, error);
+    if (!mapping_var)
+      return Dynamic();
+    return DynamicFromXmlParallel(xml, options_var, mapping_var, threads,
+        error);
+  }
+
+  Dynamic DynamicFromXmlFileParallel(const std::string & path,
+      const Dynamic & options,
+      const Dynamic & mapping,
+      size_t threads,
+      size_t shard_size,
+      std::string * const error)
+  {
+    if (!mapping.IsList())
+    {
+      *error = "Parallel parsing supports list mappings only";
+      return Dynamic();
+    }
+
+    if (threads == 0)
+      threads = hardware_concurrency();
+    if (shard_size == 0)
+      shard_size = XML_PARALLEL_SHARD_SIZE;
+    if (threads < 2)
+      return dynamic_from_xml_file(path, options, mapping, error);
+
+    FILE * source = std::fopen(path.c_str(), "rb");
+    if (!source)
+    {
+      *error = "Could not open file: '" + path + "': " + strerror(errno);
+      return Dynamic();
+    }
+
+    // 'data' holds root content which is not parsed yet. As soon as
+    // 'threads' shards of 'shard_size' bytes are found in it, they are
+    // parsed in parallel and removed, so file is never read into memory
+    // as a whole. The rest of the file after the last boundary (records,
+    // root end tag and trailing markup) is parsed as the last shard.
+    std::string data, head, tail;
+    XmlRecordScanner scanner;
+    std::vector<size_t> bounds(1, 0);
+    std::vector<const char *> shard_bounds;
+    Dynamic result;
+    bool ok = true, last = false, sequential = false;
+    while (ok && !last)
+    {
+      size_t offset = data.size();
+      data.resize(offset + XML_FILE_CHUNK_SIZE);
+      size_t size = std::fread(&data[offset], 1, XML_FILE_CHUNK_SIZE, source);
+      data.resize(offset + size);
+      if (size == 0 && std::ferror(source))
+      {
+        *error = strerror(errno);
+        ok = false;
+        break;
+      }
+      last = size < XML_FILE_CHUNK_SIZE;
+
+      if (head.empty())
+      {
+        std::string root_name;
+        const char * head_end;
+        XmlHeadState state = find_xml_head(data.data(),
+            data.data() + data.size(), &root_name, &head_end);
+        if (state == XML_HEAD_INCOMPLETE && !last)
+          continue;
+        if (state != XML_HEAD_FOUND)
+        {
+          sequential = true;
+          break;
+        }
+        head.assign(data, 0, head_end - data.data());
+        tail = "</" + root_name + ">";
+        data.erase(0, head.size());
+      }
+
+      while (true)
+      {
+        size_t limit = bounds.back() + shard_size;
+        scanner.Scan(data, limit);
+        if (scanner.boundary() < limit)
+          break;
+        bounds.push_back(scanner.boundary());
+        if (bounds.size() <= threads)
+          continue;
+
+        shard_bounds.clear();
+        for (size_t i = 0; i < bounds.size(); ++i)
+          shard_bounds.push_back(data.data() + bounds[i]);
+        if (!(ok = parse_shards(options, mapping, head, shard_bounds, tail,
+            tail, &result, error)))
+          break;
+        data.erase(0, bounds.back());
+        scanner.Consume(bounds.back());
+        bounds.assign(1, 0);
+      }
+    }
+    std::fclose(source);
+
+    if (sequential)
+      return dynamic_from_xml_file(path, options, mapping, error);
+    if (!ok)
+      return Dynamic();
+
+    bounds.push_back(data.size());
+    shard_bounds.clear();
+    for (size_t i = 0; i < bounds.size(); ++i)
+      shard_bounds.push_back(data.data() + bounds[i]);
+    if (!parse_shards(options, mapping, head, shard_bounds, tail, S_EMPTY_,
+        &result, error))
+      return Dynamic();
+    return result;
+  }
+
+  Dynamic DynamicFromXmlFileParallel(const std::string & path,
+      const std::string & options,
+      const std::string & mapping,
+      size_t threads,
+      std::string * const error)
+  {
+    Dynamic options_var = DynamicFromJson(options.empty() ? "{}" : options,
+        error);
+    if (!options_var)
+      return Dynamic();
+    Dynamic mapping_var = DynamicFromJson(mapping, error);
+    if (!mapping_var)
+      return Dynamic();
+    return DynamicFromXmlFileParallel(path, options_var, mapping_var, threads,
+        0, error);
   }
 } // namespace nkit
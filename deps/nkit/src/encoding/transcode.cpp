@@ -16,12 +16,15 @@
 
 #include "nkit/tools.h"
 #include "nkit/transcode.h"
+#include "nkit/detail/char_scan.h"
+#include "nkit/detail/string_hash.h"
 
 #ifdef max
 #undef max
 #endif
 
 #define ALL_CHARS_LEN 0x100
+#define MAX_ENCODING_NAME_LEN 64
 
 namespace nkit
 {
@@ -64,6 +67,28 @@ namespace nkit
     return all_transcoders;
   }
 
+  //----------------------------------------------------------------------------
+  // Encoding names and aliases in lower case
+  typedef detail::StringHashMap<const Transcoder *> TranscoderIndex;
+  TranscoderIndex & get_transcoder_index()
+  {
+    static TranscoderIndex transcoder_index;
+    return transcoder_index;
+  }
+
+  // Returns false if 'name' is too long to be encoding name
+  bool fold_encoding_name(const char * name, size_t len, char * folded)
+  {
+    if (len > MAX_ENCODING_NAME_LEN)
+      return false;
+    for (size_t i = 0; i < len; ++i)
+    {
+      char c = name[i];
+      folded[i] = (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+    }
+    return true;
+  }
+
   //----------------------------------------------------------------------------
   void Transcoder::Build()
   {
@@ -78,35 +103,50 @@ namespace nkit
       Transcoder transcoder(codepage.map);
       all_transcoders.insert(std::make_pair(codepage.codepage_id, transcoder));
     }
+
+    TranscoderIndex & index = get_transcoder_index();
+    const Lang * all_langs = get_langs();
+    for (size_t l = 0; all_langs[l].name != NULL; ++l)
+    {
+      Transcoders::const_iterator it =
+          all_transcoders.find(all_langs[l].codepage_id);
+      if (it == all_transcoders.end())
+        continue;
+
+      char folded[MAX_ENCODING_NAME_LEN];
+      size_t len = strlen(all_langs[l].name);
+      if (!fold_encoding_name(all_langs[l].name, len, folded))
+        continue;
+      std::string name(folded, len);
+      if (!index.Find(name)) // first alias wins
+        index.Insert(name, &it->second);
+    }
   }
 
   //----------------------------------------------------------------------------
   Transcoder::Transcoder(const uint16_t * char_to_single_utf16_map)
     : char_to_single_utf16_map_(char_to_single_utf16_map)
-    , single_utf16_to_char_hash_table_(ALL_CHARS_LEN)
+    , reverse_pages_(ALL_CHARS_LEN, 0)
+    , ascii_compatible_(true)
   {
-
+    memset(reverse_page_index_, 0, sizeof(reverse_page_index_));
     for (size_t i = 0; i < ALL_CHARS_LEN; ++i)
+    {
       AddMapping(char_to_single_utf16_map_[i], i);
+      if (i < 0x80 && char_to_single_utf16_map_[i] != i)
+        ascii_compatible_ = false;
+    }
   }
 
   //----------------------------------------------------------------------------
   const Transcoder * Transcoder::Find(const std::string & name)
   {
-    const Lang * all_langs = get_langs();
-    for (size_t l = 0; all_langs[l].name != NULL; ++l)
-    {
-      if (NKIT_STRCASECMP(all_langs[l].name, name.c_str()) == 0)
-      {
-        const Transcoders & all_transcoders = get_all_transcoders();
-        Transcoders::const_iterator it =
-                  all_transcoders.find(all_langs[l].codepage_id);
-        if (it != all_transcoders.end())
-          return & it->second;
-      }
-    }
-
-    return NULL;
+    char folded[MAX_ENCODING_NAME_LEN];
+    if (!fold_encoding_name(name.data(), name.size(), folded))
+      return NULL;
+    const Transcoder * const * transcoder =
+        get_transcoder_index().Find(folded, name.size());
+    return transcoder ? *transcoder : NULL;
   }
 
   //----------------------------------------------------------------------------
@@ -190,20 +230,34 @@ namespace nkit
   //----------------------------------------------------------------------------
   bool Transcoder::FromUtf8(const std::string & src, std::string * out) const
   {
-    const char * p = src.data();
-    size_t bytes_left = src.size();
-    while (bytes_left > 0)
-    {
-      if (!FromUtf8(&p, &bytes_left, out))
-        return false;
-    }
-    return true;
+    return FromUtf8(src.data(), src.size(), out);
   }
 
   bool Transcoder::FromUtf8(const char * src, size_t size,
       std::string * out) const
   {
-    return FromUtf8(&src, &size, out);
+    // result is never longer than UTF-8 source
+    size_t free_space = out->capacity() - out->size();
+    if (free_space < size)
+      out->reserve(std::max(out->size() + size, out->capacity() * 2));
+
+    const char * end = src + size;
+    while (src < end)
+    {
+      if (ascii_compatible_)
+      {
+        const char * non_ascii = detail::find_non_ascii(src, end);
+        out->append(src, non_ascii);
+        src = non_ascii;
+        if (src == end)
+          break;
+      }
+
+      size_t bytes_left = end - src;
+      if (!FromUtf8(&src, &bytes_left, out))
+        return false;
+    }
+    return true;
   }
 
   bool Transcoder::ToUtf8(const std::string & src, std::string * out) const
@@ -227,19 +281,14 @@ namespace nkit
   //----------------------------------------------------------------------------
   void Transcoder::AddMapping(uint16_t single_utf16_c, char c)
   {
-    single_utf16_to_char_hash_table_[
-            single_utf16_c % ALL_CHARS_LEN][single_utf16_c] = c;
-  }
-
-  bool Transcoder::GetChar(uint16_t single_utf16_c, char * c) const
-  {
-    const SingleUtf16ToCharMap & mapping =
-            single_utf16_to_char_hash_table_[single_utf16_c % ALL_CHARS_LEN];
-    SingleUtf16ToCharMap::const_iterator it = mapping.find(single_utf16_c);
-    if (unlikely(it == mapping.end()))
-      return false;
-    *c = it->second;
-    return true;
+    uint8_t & page = reverse_page_index_[single_utf16_c >> 8];
+    if (!page)
+    {
+      page = static_cast<uint8_t>(reverse_pages_.size() / ALL_CHARS_LEN);
+      reverse_pages_.resize(reverse_pages_.size() + ALL_CHARS_LEN, 0);
+    }
+    reverse_pages_[(static_cast<size_t>(page) << 8) | (single_utf16_c & 0xFF)]
+        = MAPPED | static_cast<uint8_t>(c);
   }
 
   //----------------------------------------------------------------------------
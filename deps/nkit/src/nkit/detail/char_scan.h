@@ -0,0 +1,250 @@
+/*
+   Copyright 2010-2014 Boris T. Darchiev (boris.darchiev@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __NKIT__DETAIL__CHAR__SCAN__H__
+#define __NKIT__DETAIL__CHAR__SCAN__H__
+
+#include <string.h>
+
+#include <nkit/types.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define NKIT_SSE2 1
+#  include <emmintrin.h>
+#endif
+
+namespace nkit
+{
+  namespace detail
+  {
+    inline unsigned first_bit(unsigned mask)
+    {
+#if defined(__GNUC__)
+      return static_cast<unsigned>(__builtin_ctz(mask));
+#else
+      unsigned i = 0;
+      while (!(mask & 1))
+      {
+        mask >>= 1;
+        ++i;
+      }
+      return i;
+#endif
+    }
+
+    //--------------------------------------------------------------------------
+    // Returns first byte with high bit set or 'end'
+    inline const char * find_non_ascii(const char * begin, const char * end)
+    {
+#if defined(NKIT_SSE2)
+      for (; end - begin >= 16; begin += 16)
+      {
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(begin))));
+        if (mask)
+          return begin + first_bit(mask);
+      }
+#endif
+      for (; begin < end; ++begin)
+        if (static_cast<uint8_t>(*begin) & 0x80)
+          return begin;
+      return end;
+    }
+
+    //--------------------------------------------------------------------------
+    // Returns first byte which must be escaped in JSON string ('"', '\\', '/'
+    // or control character) or 'end'
+    inline const char * find_json_special(const char * begin, const char * end)
+    {
+#if defined(NKIT_SSE2)
+      const __m128i quote = _mm_set1_epi8('"');
+      const __m128i backslash = _mm_set1_epi8('\\');
+      const __m128i slash = _mm_set1_epi8('/');
+      const __m128i max_control = _mm_set1_epi8(0x1F);
+      for (; end - begin >= 16; begin += 16)
+      {
+        __m128i block = _mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(begin));
+        __m128i eq = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(block, quote),
+                _mm_cmpeq_epi8(block, backslash)),
+            _mm_or_si128(_mm_cmpeq_epi8(block, slash),
+                // unsigned block <= 0x1F
+                _mm_cmpeq_epi8(_mm_max_epu8(block, max_control),
+                    max_control)));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(eq));
+        if (mask)
+          return begin + first_bit(mask);
+      }
+#endif
+      for (; begin < end; ++begin)
+      {
+        uint8_t c = static_cast<uint8_t>(*begin);
+        if (c <= 0x1F || c == '"' || c == '\\' || c == '/')
+          return begin;
+      }
+      return end;
+    }
+
+    //--------------------------------------------------------------------------
+    // Returns first byte which is 'c1', 'c2', control character other than
+    // '\t' and '\n', or byte with high bit set; 'end' if nothing found
+    inline const char * find_xml_special(const char * begin, const char * end,
+        char c1, char c2)
+    {
+#if defined(NKIT_SSE2)
+      const __m128i v1 = _mm_set1_epi8(c1);
+      const __m128i v2 = _mm_set1_epi8(c2);
+      const __m128i tab = _mm_set1_epi8('\t');
+      const __m128i newline = _mm_set1_epi8('\n');
+      const __m128i max_control = _mm_set1_epi8(0x1F);
+      for (; end - begin >= 16; begin += 16)
+      {
+        __m128i block = _mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(begin));
+        // unsigned block <= 0x1F, except '\t' and '\n'
+        __m128i control = _mm_andnot_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(block, tab),
+                _mm_cmpeq_epi8(block, newline)),
+            _mm_cmpeq_epi8(_mm_max_epu8(block, max_control), max_control));
+        __m128i eq = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(block, v1),
+                _mm_cmpeq_epi8(block, v2)),
+            control);
+        unsigned mask = static_cast<unsigned>(
+            _mm_movemask_epi8(eq) | _mm_movemask_epi8(block));
+        if (mask)
+          return begin + first_bit(mask);
+      }
+#endif
+      for (; begin < end; ++begin)
+      {
+        uint8_t c = static_cast<uint8_t>(*begin);
+        if (c == static_cast<uint8_t>(c1) || c == static_cast<uint8_t>(c2) ||
+            (c <= 0x1F && c != '\t' && c != '\n') || (c & 0x80))
+          return begin;
+      }
+      return end;
+    }
+
+    //--------------------------------------------------------------------------
+    // Returns length of valid UTF-8 sequence of XML character at 'p' (which
+    // has high bit set), 0 if sequence is invalid (overlong form, surrogate,
+    // U+FFFE, U+FFFF, beyond U+10FFFF) and -1 if it is cut by 'end'
+    inline int xml_utf8_sequence_length(const char * p, const char * end)
+    {
+      const uint8_t * s = reinterpret_cast<const uint8_t *>(p);
+      size_t avail = static_cast<size_t>(end - p);
+      uint8_t c = s[0];
+      int len;
+      uint32_t min, code;
+      if (c >= 0xC2 && c <= 0xDF)
+      {
+        len = 2;
+        min = 0x80;
+        code = c & 0x1F;
+      }
+      else if (c >= 0xE0 && c <= 0xEF)
+      {
+        len = 3;
+        min = 0x800;
+        code = c & 0x0F;
+      }
+      else if (c >= 0xF0 && c <= 0xF4)
+      {
+        len = 4;
+        min = 0x10000;
+        code = c & 0x07;
+      }
+      else
+        return 0;
+
+      for (int i = 1; i < len; ++i)
+      {
+        if (static_cast<size_t>(i) >= avail)
+          return -1;
+        if ((s[i] & 0xC0) != 0x80)
+          return 0;
+        code = (code << 6) | (s[i] & 0x3F);
+      }
+
+      if (code < min || code > 0x10FFFF ||
+          (code >= 0xD800 && code <= 0xDFFF) || code == 0xFFFE ||
+          code == 0xFFFF)
+        return 0;
+      return len;
+    }
+
+    //--------------------------------------------------------------------------
+    // Finds first byte from small set of characters (up to MAX_CHARS).
+    // Scans 16 bytes at a time with SSE2, byte-by-byte otherwise.
+    class CharScanner
+    {
+    public:
+      static const size_t MAX_CHARS = 8;
+
+      explicit CharScanner(const char * chars)
+        : count_(0)
+      {
+        memset(table_, 0, sizeof(table_));
+        for (; *chars && count_ < MAX_CHARS; ++chars, ++count_)
+        {
+          chars_[count_] = *chars;
+          table_[static_cast<uint8_t>(*chars)] = true;
+        }
+      }
+
+      bool Has(char c) const
+      {
+        return table_[static_cast<uint8_t>(c)];
+      }
+
+      // Returns 'end' if nothing found
+      const char * Find(const char * begin, const char * end) const
+      {
+#if defined(NKIT_SSE2)
+        __m128i chars[MAX_CHARS];
+        for (size_t i = 0; i < count_; ++i)
+          chars[i] = _mm_set1_epi8(chars_[i]);
+
+        for (; end - begin >= 16; begin += 16)
+        {
+          __m128i block = _mm_loadu_si128(
+              reinterpret_cast<const __m128i *>(begin));
+          __m128i eq = _mm_cmpeq_epi8(block, chars[0]);
+          for (size_t i = 1; i < count_; ++i)
+            eq = _mm_or_si128(eq, _mm_cmpeq_epi8(block, chars[i]));
+          unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(eq));
+          if (mask)
+            return begin + first_bit(mask);
+        }
+#endif
+        for (; begin < end; ++begin)
+          if (table_[static_cast<uint8_t>(*begin)])
+            return begin;
+        return end;
+      }
+
+    private:
+      char chars_[MAX_CHARS];
+      size_t count_;
+      bool table_[256];
+    };
+  } // namespace detail
+} // namespace nkit
+
+#endif // __NKIT__DETAIL__CHAR__SCAN__H__
@@ -0,0 +1,167 @@
+/*
+   Copyright 2010-2014 Boris T. Darchiev (boris.darchiev@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __NKIT__DETAIL__DATE__TIME__FORMAT__H__
+#define __NKIT__DETAIL__DATE__TIME__FORMAT__H__
+
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace nkit
+{
+  namespace detail
+  {
+    //--------------------------------------------------------------------------
+    // strftime() format compiled once into literal text and numeric fields.
+    // Formats with directives other than %Y %m %d %H %M %S %f (and %%) are
+    // not supported and must be left to strftime().
+    // Compiled format is immutable, so it can be used from several threads.
+    class DateTimeFormat
+    {
+      struct Field
+      {
+        char directive_; // 0 for literal
+        std::string literal_;
+      };
+
+    public:
+      DateTimeFormat() : supported_(false) {}
+
+      explicit DateTimeFormat(const std::string & format)
+        : supported_(false)
+      {
+        Compile(format);
+      }
+
+      const std::string & format() const { return format_; }
+
+      void Compile(const std::string & format)
+      {
+        format_ = format;
+        fields_.clear();
+        supported_ = true;
+
+        Field literal;
+        literal.directive_ = 0;
+        for (size_t i = 0; i < format.size(); ++i)
+        {
+          if (format[i] != '%')
+          {
+            literal.literal_ += format[i];
+            continue;
+          }
+          if (++i == format.size())
+          {
+            supported_ = false;
+            return;
+          }
+
+          char directive = format[i];
+          if (directive == '%')
+          {
+            literal.literal_ += '%';
+            continue;
+          }
+          if (!strchr("YmdHMSf", directive))
+          {
+            supported_ = false;
+            return;
+          }
+
+          if (!literal.literal_.empty())
+          {
+            fields_.push_back(literal);
+            literal.literal_.clear();
+          }
+          Field field;
+          field.directive_ = directive;
+          fields_.push_back(field);
+        }
+
+        if (!literal.literal_.empty())
+          fields_.push_back(literal);
+      }
+
+      // Returns false if value must be formatted by strftime()
+      bool Format(int year, int month, int day, int hour, int minute,
+          int second, int microsecond, std::string * out) const
+      {
+        // strftime() output for years before 1000 is platform specific
+        if (!supported_ || year < 1000)
+          return false;
+
+        out->clear();
+        std::vector<Field>::const_iterator field = fields_.begin(),
+            end = fields_.end();
+        for (; field != end; ++field)
+        {
+          switch (field->directive_)
+          {
+          case 0:
+            out->append(field->literal_);
+            break;
+          case 'Y':
+            AppendNumber(year, 4, out);
+            break;
+          case 'm':
+            AppendNumber(month, 2, out);
+            break;
+          case 'd':
+            AppendNumber(day, 2, out);
+            break;
+          case 'H':
+            AppendNumber(hour, 2, out);
+            break;
+          case 'M':
+            AppendNumber(minute, 2, out);
+            break;
+          case 'S':
+            AppendNumber(second, 2, out);
+            break;
+          case 'f':
+            AppendNumber(microsecond, 6, out);
+            break;
+          }
+        }
+        return true;
+      }
+
+    private:
+      static void AppendNumber(int value, size_t width, std::string * out)
+      {
+        char tmp[16];
+        char * end = tmp + sizeof(tmp), * begin = end;
+        do
+        {
+          *--begin = static_cast<char>('0' + value % 10);
+          value /= 10;
+        } while (value);
+        while (static_cast<size_t>(end - begin) < width)
+          *--begin = '0';
+        out->append(begin, end);
+      }
+
+    private:
+      std::string format_;
+      std::vector<Field> fields_;
+      bool supported_;
+    };
+
+  } // namespace detail
+} // namespace nkit
+
+#endif // __NKIT__DETAIL__DATE__TIME__FORMAT__H__
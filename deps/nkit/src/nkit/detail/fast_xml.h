@@ -0,0 +1,730 @@
+/*
+   Copyright 2010-2014 Boris T. Darchiev (boris.darchiev@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __NKIT__DETAIL__FAST__XML__H__
+#define __NKIT__DETAIL__FAST__XML__H__
+
+#include <string>
+#include <vector>
+
+#include "expat.h"
+
+#include "nkit/detail/char_scan.h"
+
+namespace nkit
+{
+  namespace detail
+  {
+    //--------------------------------------------------------------------------
+    // Tokenizer for the simple subset of XML that machine-generated UTF-8
+    // documents usually are: elements, attributes, text, predefined entities
+    // and character references.
+    // Document is processed as a stream: Scan() finds complete top level
+    // elements (children of root) in the data collected so far, Parse() calls
+    // handler for them, so only unfinished element has to be kept by caller.
+    // Scan() also validates what Parse() relies on (UTF-8, characters, ASCII
+    // names) and reports FAST_UNSUPPORTED at anything else (DTD, comments,
+    // CDATA, processing instructions, CR characters, non UTF-8 encoding,
+    // non ASCII names, invalid characters), so caller can hand the rest of
+    // document to Expat, see ExpatPrefix().
+    class FastXmlTokenizer
+    {
+      enum ScanMode
+      {
+        SCAN_TEXT,
+        SCAN_TAG,
+        SCAN_QUOTE
+      };
+
+    public:
+      enum Result
+      {
+        FAST_OK,
+        FAST_ERROR,
+        FAST_ABORTED,
+        FAST_UNSUPPORTED
+      };
+
+      FastXmlTokenizer()
+        : text_scanner_("<&")
+        , dquote_scanner_("\"&<\t\n")
+        , squote_scanner_("'&<\t\n")
+      {
+        Reset();
+      }
+
+      // Prepares tokenizer for new document
+      void Reset()
+      {
+        prolog_done_ = false;
+        prolog_len_ = 0;
+        scan_mode_ = SCAN_TEXT;
+        scan_pos_ = 0;
+        scan_depth_ = 0;
+        scan_boundary_ = 0;
+        quote_ = 0;
+        end_tag_ = false;
+        slash_ = false;
+        in_name_ = false;
+        after_eq_ = false;
+        started_ = false;
+        depth_ = 0;
+        root_done_ = false;
+        boundary_depth_ = 0;
+        boundary_root_done_ = false;
+        error_code_ = XML_ERROR_NONE;
+        error_pos_ = 0;
+      }
+
+      // Checks next part of document. 'doc' holds not yet parsed part of
+      // document: data of previous call (without prefix given to Consume())
+      // followed by new data. Sets '*parsable' to length of prefix of 'doc'
+      // which Parse() can take: complete top level elements, or whole 'doc'
+      // if 'last'. On FAST_UNSUPPORTED, '*parsable' bytes can still be parsed
+      // and the rest of document must be given to Expat.
+      Result Scan(const char * doc, size_t len, bool last, size_t * parsable)
+      {
+        const char * end = doc + len;
+        *parsable = 0;
+        if (!prolog_done_)
+        {
+          Result result = ScanProlog(doc, end, last);
+          if (!prolog_done_)
+            return result;
+        }
+
+        const char * p = doc + scan_pos_;
+        while (p < end)
+        {
+          if (scan_mode_ == SCAN_TEXT)
+          {
+            p = find_xml_special(p, end, '<', ']');
+            if (p == end)
+              break;
+            if (*p == '<')
+            {
+              if (end - p < 2)
+              {
+                // Parse() will report unclosed token
+                if (last)
+                  p = end;
+                break;
+              }
+              if (p[1] == '!' || p[1] == '?')
+                return Unsupported(parsable);
+              end_tag_ = p[1] == '/';
+              p += end_tag_ ? 2 : 1;
+              scan_mode_ = SCAN_TAG;
+              slash_ = false;
+              in_name_ = false;
+              after_eq_ = false;
+            }
+            else if (*p == ']')
+            {
+              if (end - p < 3 && !last)
+                break;
+              // ']]>' is not allowed in text
+              if (end - p >= 3 && p[1] == ']' && p[2] == '>')
+                return Unsupported(parsable);
+              ++p;
+            }
+            else
+            {
+              int len = CharLength(p, end, last);
+              if (len < 0)
+                return Unsupported(parsable);
+              if (len == 0)
+                break;
+              p += len;
+            }
+          }
+          else if (scan_mode_ == SCAN_TAG)
+          {
+            char c = *p;
+            if (IsSpace(c))
+            {
+              slash_ = false;
+              in_name_ = false;
+              ++p;
+            }
+            else if (after_eq_)
+            {
+              // only quoted attribute value may follow '='
+              if (c != '"' && c != '\'')
+                return Unsupported(parsable);
+              quote_ = c;
+              scan_mode_ = SCAN_QUOTE;
+              after_eq_ = false;
+              ++p;
+            }
+            else if (c == '>')
+            {
+              if (end_tag_)
+              {
+                if (scan_depth_ == 0)
+                  return Unsupported(parsable);
+                --scan_depth_;
+              }
+              else if (!slash_)
+                ++scan_depth_;
+              scan_mode_ = SCAN_TEXT;
+              ++p;
+              if (scan_depth_ <= 1)
+                scan_boundary_ = p - doc;
+            }
+            else if (IsNameChar(c))
+            {
+              if (!in_name_ && !IsNameStartChar(c))
+                return Unsupported(parsable);
+              in_name_ = true;
+              slash_ = false;
+              ++p;
+            }
+            else if (c == '=' || c == '/')
+            {
+              after_eq_ = c == '=';
+              slash_ = c == '/';
+              in_name_ = false;
+              ++p;
+            }
+            else
+              return Unsupported(parsable);
+          }
+          else
+          {
+            p = find_xml_special(p, end, quote_, quote_);
+            if (p == end)
+              break;
+            if (*p == quote_)
+            {
+              scan_mode_ = SCAN_TAG;
+              ++p;
+            }
+            else
+            {
+              int len = CharLength(p, end, last);
+              if (len < 0)
+                return Unsupported(parsable);
+              if (len == 0)
+                break;
+              p += len;
+            }
+          }
+        }
+
+        scan_pos_ = p - doc;
+        *parsable = last ? len : scan_boundary_;
+        return FAST_OK;
+      }
+
+      // Parses 'len' bytes from the beginning of 'doc', found by Scan()
+      template<typename Handler>
+      Result Parse(Handler * handler, const char * doc, size_t len, bool last)
+      {
+        const char * p = doc, * end = doc + len;
+        if (!started_)
+        {
+          p += prolog_len_;
+          started_ = true;
+        }
+
+        doc_ = doc;
+        while (true)
+        {
+          if (depth_ == 0)
+          {
+            p = SkipSpaces(p, end);
+            if (p == end)
+            {
+              if (last && !root_done_)
+                return Fail(XML_ERROR_NO_ELEMENTS, p);
+              break;
+            }
+            if (root_done_)
+              return Fail(XML_ERROR_JUNK_AFTER_DOC_ELEMENT, p);
+            if (*p != '<')
+              return Fail(XML_ERROR_SYNTAX, p);
+          }
+          else
+          {
+            while (true)
+            {
+              const char * q = text_scanner_.Find(p, end);
+              if (q != p && !handler->FastText(p, static_cast<int>(q - p)))
+                return FAST_ABORTED;
+              p = q;
+              if (p == end || *p == '<')
+                break;
+
+              text_.clear();
+              if (!(q = DecodeReference(p, end, &text_)))
+                return FAST_ERROR;
+              if (!handler->FastText(text_.data(),
+                  static_cast<int>(text_.size())))
+                return FAST_ABORTED;
+              p = q;
+            }
+            if (p == end)
+            {
+              if (last)
+                return Fail(XML_ERROR_NO_ELEMENTS, p);
+              break;
+            }
+          }
+
+          // p points to '<'
+          if (end - p < 2)
+            return Fail(XML_ERROR_UNCLOSED_TOKEN, p);
+
+          if (p[1] == '/')
+          {
+            const char * name = p + 2, * q = SkipName(name, end);
+            if (depth_ == 0)
+              return Fail(XML_ERROR_INVALID_TOKEN, p);
+            const std::string & open = names_[depth_ - 1];
+            if (open.size() != static_cast<size_t>(q - name) ||
+                memcmp(open.data(), name, open.size()) != 0)
+              return Fail(XML_ERROR_TAG_MISMATCH, name);
+            q = SkipSpaces(q, end);
+            if (q == end || *q != '>')
+              return Fail(XML_ERROR_UNCLOSED_TOKEN, p);
+            p = q + 1;
+            if (!handler->FastEndElement(names_[--depth_].c_str()))
+              return FAST_ABORTED;
+            root_done_ = depth_ == 0;
+            continue;
+          }
+
+          bool empty;
+          if (!(p = ParseStartTag(p, end, &empty)))
+            return FAST_ERROR;
+          const char * name = names_[depth_].c_str();
+          if (!handler->FastStartElement(name, &attrs_[0]))
+            return FAST_ABORTED;
+          if (!empty)
+            ++depth_;
+          else if (!handler->FastEndElement(name))
+            return FAST_ABORTED;
+          else
+            root_done_ = depth_ == 0;
+        }
+
+        boundary_depth_ = depth_;
+        boundary_root_done_ = root_done_;
+        return FAST_OK;
+      }
+
+      // Tells that first 'len' bytes of document have been parsed and
+      // removed by caller, so next Scan() gets the rest
+      void Consume(size_t len)
+      {
+        scan_pos_ -= len;
+        scan_boundary_ -= len;
+      }
+
+      // Markup which brings Expat to the state of tokenizer after the last
+      // successful Parse(). Empty if Expat must start from the beginning of
+      // document.
+      std::string ExpatPrefix() const
+      {
+        if (boundary_root_done_)
+          return "<" + names_[0] + "/>";
+        if (boundary_depth_)
+          return "<" + names_[0] + ">";
+        return std::string();
+      }
+
+      // Whole document in one call
+      template<typename Handler>
+      Result ParseDocument(Handler * handler, const char * doc, size_t len)
+      {
+        Reset();
+        size_t parsable;
+        if (Scan(doc, len, true, &parsable) != FAST_OK)
+          return FAST_UNSUPPORTED;
+        return Parse(handler, doc, len, true);
+      }
+
+      XML_Error error_code() const { return error_code_; }
+
+      // Byte offset of error in data given to last Parse()
+      size_t error_pos() const { return error_pos_; }
+
+    private:
+      static bool IsSpace(char c)
+      {
+        return c == ' ' || c == '\n' || c == '\t';
+      }
+
+      static bool IsNameEnd(char c)
+      {
+        return IsSpace(c) || c == '>' || c == '/' || c == '=' || c == '<' ||
+            c == '"' || c == '\'';
+      }
+
+      static const char * SkipSpaces(const char * p, const char * end)
+      {
+        while (p < end && IsSpace(*p))
+          ++p;
+        return p;
+      }
+
+      static const char * SkipName(const char * p, const char * end)
+      {
+        while (p < end && !IsNameEnd(*p))
+          ++p;
+        return p;
+      }
+
+      Result Fail(XML_Error code, const char * pos)
+      {
+        error_code_ = code;
+        error_pos_ = pos - doc_;
+        return FAST_ERROR;
+      }
+
+      const char * FailPtr(XML_Error code, const char * pos)
+      {
+        Fail(code, pos);
+        return NULL;
+      }
+
+      static bool IsNameStartChar(char c)
+      {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' ||
+            c == ':';
+      }
+
+      static bool IsNameChar(char c)
+      {
+        return IsNameStartChar(c) || (c >= '0' && c <= '9') || c == '-' ||
+            c == '.';
+      }
+
+      Result Unsupported(size_t * parsable) const
+      {
+        *parsable = scan_boundary_;
+        return FAST_UNSUPPORTED;
+      }
+
+      // Skips optional BOM and XML declaration, see IsSimpleDeclaration().
+      // Leaves 'prolog_done_' false if more data is needed.
+      Result ScanProlog(const char * doc, const char * end, bool last)
+      {
+        static const ptrdiff_t MAX_PROLOG_LEN = 1024;
+        // enough to recognize BOM and '<?xml '
+        if (!last && end - doc < 9)
+          return FAST_OK;
+
+        const char * p = doc;
+        if (end - p >= 3 && memcmp(p, "\xEF\xBB\xBF", 3) == 0)
+          p += 3;
+
+        if (end - p >= 6 && memcmp(p, "<?xml", 5) == 0 && IsSpace(p[5]))
+        {
+          const char * decl_end = p;
+          while (decl_end + 1 < end &&
+              !(decl_end[0] == '?' && decl_end[1] == '>'))
+            ++decl_end;
+          if (decl_end + 1 >= end)
+            return last || end - doc > MAX_PROLOG_LEN ?
+                FAST_UNSUPPORTED : FAST_OK;
+
+          if (!IsSimpleDeclaration(p + 5, decl_end))
+            return FAST_UNSUPPORTED;
+          p = decl_end + 2;
+        }
+
+        prolog_done_ = true;
+        prolog_len_ = scan_pos_ = p - doc;
+        return FAST_OK;
+      }
+
+      // Checks pseudo-attributes of XML declaration: version="1.0", then
+      // optional encoding="UTF-8" and standalone="yes|no". Anything else is
+      // left to Expat.
+      static bool IsSimpleDeclaration(const char * p, const char * end)
+      {
+        static const char * const NAMES[] =
+        {
+          "version", "encoding", "standalone", NULL
+        };
+
+        size_t next = 0;
+        while (true)
+        {
+          const char * q = SkipSpaces(p, end);
+          if (q == end)
+            return next > 0;
+          if (q == p)
+            return false;
+
+          const char * name = q;
+          while (q < end && IsNameChar(*q))
+            ++q;
+          size_t i = next;
+          for (; NAMES[i]; ++i)
+            if (strlen(NAMES[i]) == static_cast<size_t>(q - name) &&
+                memcmp(NAMES[i], name, q - name) == 0)
+              break;
+          if (!NAMES[i] || (next == 0 && i != 0))
+            return false;
+          next = i + 1;
+
+          q = SkipSpaces(q, end);
+          if (q == end || *q != '=')
+            return false;
+          q = SkipSpaces(q + 1, end);
+          if (q == end || (*q != '"' && *q != '\''))
+            return false;
+          const char * value = q + 1;
+          const char * value_end = static_cast<const char *>(
+              memchr(value, *q, end - value));
+          if (!value_end)
+            return false;
+
+          std::string v(value, value_end);
+          if ((i == 0 && v != "1.0") ||
+              (i == 1 && NKIT_STRCASECMP(v.c_str(), "UTF-8") != 0) ||
+              (i == 2 && v != "yes" && v != "no"))
+            return false;
+          p = value_end + 1;
+        }
+      }
+
+      // p points to control character or to byte with high bit set.
+      // Returns length of valid UTF-8 character, 0 if character is cut by
+      // 'end' and more data will come, -1 if character is not allowed.
+      static int CharLength(const char * p, const char * end, bool last)
+      {
+        if (!(static_cast<uint8_t>(*p) & 0x80))
+          return -1;
+        int len = xml_utf8_sequence_length(p, end);
+        if (len < 0)
+          return last ? -1 : 0;
+        return len ? len : -1;
+      }
+
+      // p points to '&'. Appends decoded character to 'out', returns pointer
+      // past ';'
+      const char * DecodeReference(const char * p, const char * end,
+          std::string * out)
+      {
+        const char * start = p++;
+        const char * semicolon = p;
+        while (semicolon < end && semicolon - p < 12 && *semicolon != ';')
+          ++semicolon;
+        if (semicolon == end || *semicolon != ';')
+          return FailPtr(XML_ERROR_INVALID_TOKEN, start);
+
+        size_t len = semicolon - p;
+        if (*p != '#')
+        {
+          char c = 0;
+          if (len == 2 && p[0] == 'l' && p[1] == 't') c = '<';
+          else if (len == 2 && p[0] == 'g' && p[1] == 't') c = '>';
+          else if (len == 3 && memcmp(p, "amp", 3) == 0) c = '&';
+          else if (len == 4 && memcmp(p, "quot", 4) == 0) c = '"';
+          else if (len == 4 && memcmp(p, "apos", 4) == 0) c = '\'';
+          else
+            return FailPtr(XML_ERROR_UNDEFINED_ENTITY, start);
+          out->push_back(c);
+          return semicolon + 1;
+        }
+
+        uint32_t code = 0;
+        bool hex = len > 1 && p[1] == 'x';
+        const char * digit = p + (hex ? 2 : 1);
+        if (digit == semicolon)
+          return FailPtr(XML_ERROR_INVALID_TOKEN, start);
+        for (; digit < semicolon; ++digit)
+        {
+          char c = *digit;
+          uint32_t d;
+          if (c >= '0' && c <= '9') d = c - '0';
+          else if (hex && c >= 'a' && c <= 'f') d = c - 'a' + 10;
+          else if (hex && c >= 'A' && c <= 'F') d = c - 'A' + 10;
+          else
+            return FailPtr(XML_ERROR_INVALID_TOKEN, start);
+          code = code * (hex ? 16 : 10) + d;
+          if (code > 0x10FFFF)
+            return FailPtr(XML_ERROR_BAD_CHAR_REF, start);
+        }
+
+        if ((code < 0x20 && code != 0x9 && code != 0xA && code != 0xD) ||
+            (code >= 0xD800 && code <= 0xDFFF) || code == 0xFFFE ||
+            code == 0xFFFF)
+          return FailPtr(XML_ERROR_BAD_CHAR_REF, start);
+
+        if (code < 0x80)
+          out->push_back(static_cast<char>(code));
+        else if (code < 0x800)
+        {
+          out->push_back(static_cast<char>(0xC0 | (code >> 6)));
+          out->push_back(static_cast<char>(0x80 | (code & 0x3F)));
+        }
+        else if (code < 0x10000)
+        {
+          out->push_back(static_cast<char>(0xE0 | (code >> 12)));
+          out->push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+          out->push_back(static_cast<char>(0x80 | (code & 0x3F)));
+        }
+        else
+        {
+          out->push_back(static_cast<char>(0xF0 | (code >> 18)));
+          out->push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3F)));
+          out->push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+          out->push_back(static_cast<char>(0x80 | (code & 0x3F)));
+        }
+        return semicolon + 1;
+      }
+
+      // p points to '<'. Fills names_[depth_] and attrs_, returns pointer
+      // past '>'
+      const char * ParseStartTag(const char * p, const char * end,
+          bool * empty)
+      {
+        const char * name = p + 1, * q = SkipName(name, end);
+        if (q == name)
+          return FailPtr(XML_ERROR_INVALID_TOKEN, p);
+        if (depth_ == names_.size())
+          names_.push_back(std::string());
+        names_[depth_].assign(name, q);
+
+        attr_buf_.clear();
+        attr_offsets_.clear();
+        p = q;
+        while (true)
+        {
+          q = SkipSpaces(p, end);
+          if (q == end)
+            return FailPtr(XML_ERROR_UNCLOSED_TOKEN, name - 1);
+          if (*q == '>')
+          {
+            *empty = false;
+            p = q + 1;
+            break;
+          }
+          if (*q == '/')
+          {
+            if (end - q < 2 || q[1] != '>')
+              return FailPtr(XML_ERROR_INVALID_TOKEN, q);
+            *empty = true;
+            p = q + 2;
+            break;
+          }
+          if (q == p)
+            return FailPtr(XML_ERROR_INVALID_TOKEN, q);
+
+          // attribute name
+          p = SkipName(q, end);
+          if (p == q)
+            return FailPtr(XML_ERROR_INVALID_TOKEN, q);
+          for (size_t i = 0; i < attr_offsets_.size(); i += 2)
+          {
+            const char * other = attr_buf_.data() + attr_offsets_[i];
+            if (strlen(other) == static_cast<size_t>(p - q) &&
+                memcmp(other, q, p - q) == 0)
+              return FailPtr(XML_ERROR_DUPLICATE_ATTRIBUTE, q);
+          }
+          attr_offsets_.push_back(attr_buf_.size());
+          attr_buf_.append(q, p);
+          attr_buf_.push_back('\0');
+
+          // = "value"
+          p = SkipSpaces(p, end);
+          if (p == end || *p != '=')
+            return FailPtr(XML_ERROR_INVALID_TOKEN, p);
+          p = SkipSpaces(p + 1, end);
+          if (p == end || (*p != '"' && *p != '\''))
+            return FailPtr(XML_ERROR_INVALID_TOKEN, p);
+          char quote = *p++;
+          const CharScanner & scanner =
+              quote == '"' ? dquote_scanner_ : squote_scanner_;
+
+          attr_offsets_.push_back(attr_buf_.size());
+          while (true)
+          {
+            q = scanner.Find(p, end);
+            attr_buf_.append(p, q);
+            if (q == end)
+              return FailPtr(XML_ERROR_UNCLOSED_TOKEN, name - 1);
+            if (*q == quote)
+            {
+              p = q + 1;
+              break;
+            }
+            if (*q == '<')
+              return FailPtr(XML_ERROR_INVALID_TOKEN, q);
+            if (*q == '&')
+            {
+              if (!(p = DecodeReference(q, end, &attr_buf_)))
+                return NULL;
+            }
+            else
+            {
+              attr_buf_.push_back(' '); // attribute value normalization
+              p = q + 1;
+            }
+          }
+          attr_buf_.push_back('\0');
+        }
+
+        attrs_.clear();
+        for (size_t i = 0; i < attr_offsets_.size(); ++i)
+          attrs_.push_back(attr_buf_.data() + attr_offsets_[i]);
+        attrs_.push_back(NULL);
+        return p;
+      }
+
+    private:
+      CharScanner text_scanner_;
+      CharScanner dquote_scanner_;
+      CharScanner squote_scanner_;
+
+      // Scan() state, positions are offsets in not yet consumed data
+      bool prolog_done_;
+      size_t prolog_len_;
+      ScanMode scan_mode_;
+      size_t scan_pos_;
+      size_t scan_depth_;
+      size_t scan_boundary_; // end of last complete top level element
+      char quote_;
+      bool end_tag_;
+      bool slash_;
+      bool in_name_;
+      bool after_eq_;
+
+      // Parse() state
+      bool started_;
+      const char * doc_;
+      std::vector<std::string> names_; // open element names
+      size_t depth_;
+      bool root_done_;
+      size_t boundary_depth_;
+      bool boundary_root_done_;
+      std::string attr_buf_;
+      std::vector<size_t> attr_offsets_;
+      std::vector<const char *> attrs_;
+      std::string text_;
+
+      XML_Error error_code_;
+      size_t error_pos_;
+    };
+  } // namespace detail
+} // namespace nkit
+
+#endif // __NKIT__DETAIL__FAST__XML__H__
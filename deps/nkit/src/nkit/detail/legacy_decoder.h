@@ -0,0 +1,239 @@
+/*
+   Copyright 2010-2014 Boris T. Darchiev (boris.darchiev@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __NKIT__DETAIL__LEGACY__DECODER__H__
+#define __NKIT__DETAIL__LEGACY__DECODER__H__
+
+#include <string.h>
+#include <string>
+#include <algorithm>
+
+#include <nkit/types.h>
+#include <nkit/ctools.h>
+
+#if defined(NKIT_POSIX_PLATFORM)
+#  define NKIT_ICONV 1
+#  include <errno.h>
+#  include <iconv.h>
+#endif
+
+namespace nkit
+{
+  namespace detail
+  {
+    //--------------------------------------------------------------------------
+    // Looks for encoding name in XML declaration at the beginning of 'p'.
+    // Returns false if declaration is not complete yet. 'name' stays empty
+    // if there is no declaration or no encoding in it.
+    inline bool get_declared_encoding(const char * p, const char * end,
+        std::string * name)
+    {
+      name->clear();
+      if (end - p >= 3 && memcmp(p, "\xEF\xBB\xBF", 3) == 0)
+        p += 3;
+      if (end - p < 6)
+        return false;
+      if (memcmp(p, "<?xml", 5) != 0 ||
+          (p[5] != ' ' && p[5] != '\t' && p[5] != '\r' && p[5] != '\n'))
+        return true;
+
+      const char * decl_end = p;
+      while (decl_end + 1 < end && !(decl_end[0] == '?' && decl_end[1] == '>'))
+        ++decl_end;
+      if (decl_end + 1 >= end)
+        return false;
+
+      static const char ENCODING[] = "encoding";
+      const char * e = std::search(p, decl_end, ENCODING,
+          ENCODING + sizeof(ENCODING) - 1);
+      if (e == decl_end)
+        return true;
+      e += sizeof(ENCODING) - 1;
+      while (e < decl_end && *e != '"' && *e != '\'')
+        ++e;
+      if (e == decl_end)
+        return true;
+      const char * value_end = std::find(e + 1, decl_end, *e);
+      name->assign(e + 1, value_end);
+      return true;
+    }
+
+    //--------------------------------------------------------------------------
+    // Streaming conversion of multi-byte legacy encodings (Shift_JIS, GB18030,
+    // Big5, EUC-KR, ...) to UTF-8. Incomplete character at the end of chunk
+    // is kept and completed by the next chunk.
+    // Works through iconv, so it is available on POSIX platforms only.
+    class LegacyDecoder
+    {
+      // longest character of supported encodings (GB18030) is 4 bytes
+      static const size_t MAX_CHAR_LEN = 8;
+
+    public:
+      LegacyDecoder()
+#if defined(NKIT_ICONV)
+        : cd_(reinterpret_cast<iconv_t>(-1))
+#endif
+      {}
+
+      ~LegacyDecoder()
+      {
+        Close();
+      }
+
+      // Returns false if encoding is unknown to the platform
+      bool Open(const std::string & encoding)
+      {
+        Close();
+#if defined(NKIT_ICONV)
+        cd_ = iconv_open("UTF-8", encoding.c_str());
+        if (cd_ == reinterpret_cast<iconv_t>(-1))
+          return false;
+        encoding_ = encoding;
+        return true;
+#else
+        NKIT_FORCE_USED(encoding);
+        return false;
+#endif
+      }
+
+      void Close()
+      {
+#if defined(NKIT_ICONV)
+        if (is_open())
+          iconv_close(cd_);
+        cd_ = reinterpret_cast<iconv_t>(-1);
+#endif
+        encoding_.clear();
+        tail_.clear();
+      }
+
+      bool is_open() const
+      {
+#if defined(NKIT_ICONV)
+        return cd_ != reinterpret_cast<iconv_t>(-1);
+#else
+        return false;
+#endif
+      }
+
+      // Replaces content of 'out' with UTF-8 text of 'chunk'
+      bool Decode(const char * chunk, size_t len, bool last,
+          std::string * out, std::string * error)
+      {
+        out->clear();
+        if (!tail_.empty() && !CompleteTail(&chunk, &len, out, error))
+          return false;
+
+        if (tail_.empty() && len)
+        {
+          if (!Convert(&chunk, &len, out, error))
+            return false;
+          tail_.assign(chunk, len);
+        }
+
+        if (last && !tail_.empty())
+        {
+          *error = "Incomplete " + encoding_ +
+              " character at the end of input";
+          return false;
+        }
+        return true;
+      }
+
+    private:
+      // Finishes character, that was split between chunks,
+      // with few first bytes of the next chunk
+      bool CompleteTail(const char ** chunk, size_t * len, std::string * out,
+          std::string * error)
+      {
+        size_t pending = tail_.size();
+        size_t take = std::min(*len, MAX_CHAR_LEN - pending);
+        tail_.append(*chunk, take);
+
+        const char * p = tail_.data();
+        size_t left = tail_.size();
+        if (!Convert(&p, &left, out, error))
+          return false;
+
+        size_t consumed = tail_.size() - left;
+        if (consumed < pending)
+        {
+          if (take < *len)
+          {
+            *error = "Invalid " + encoding_ + " byte sequence";
+            return false;
+          }
+          // chunk is too short, wait for the next one
+          *chunk += take;
+          *len = 0;
+          return true;
+        }
+
+        *chunk += consumed - pending;
+        *len -= consumed - pending;
+        tail_.clear();
+        return true;
+      }
+
+      // Appends to 'out', stops at incomplete character at the end
+      bool Convert(const char ** src, size_t * len, std::string * out,
+          std::string * error)
+      {
+#if defined(NKIT_ICONV)
+        while (*len)
+        {
+          size_t used = out->size();
+          // two-byte CJK characters take three bytes in UTF-8
+          out->resize(used + *len * 2 + MAX_CHAR_LEN);
+          char * in = const_cast<char *>(*src);
+          char * dst = &(*out)[used];
+          size_t dst_left = out->size() - used;
+          size_t rc = iconv(cd_, &in, len, &dst, &dst_left);
+          out->resize(out->size() - dst_left);
+          *src = in;
+          if (rc != static_cast<size_t>(-1) || errno == EINVAL)
+            return true;
+          if (errno != E2BIG)
+          {
+            *error = "Invalid " + encoding_ + " byte sequence";
+            return false;
+          }
+        }
+        return true;
+#else
+        NKIT_FORCE_USED(src);
+        NKIT_FORCE_USED(len);
+        NKIT_FORCE_USED(out);
+        *error = "Multi-byte encodings are not supported on this platform";
+        return false;
+#endif
+      }
+
+    private:
+      LegacyDecoder(const LegacyDecoder &);
+      LegacyDecoder & operator=(const LegacyDecoder &);
+
+    private:
+#if defined(NKIT_ICONV)
+      iconv_t cd_;
+#endif
+      std::string encoding_;
+      std::string tail_;
+    };
+  } // namespace detail
+} // namespace nkit
+
+#endif // __NKIT__DETAIL__LEGACY__DECODER__H__
@@ -29,15 +29,32 @@ namespace nkit
 
     typedef std::map<char *, size_t, CompareStrings> Name2Id;
 
+    // Expat hands element names out of a small set of recycled tag buffers,
+    // so the same pointer usually carries the same name. The cache is
+    // direct-mapped on pointer bits; a hit is confirmed with strcmp against
+    // the map-owned copy of the name, since a recycled buffer may hold
+    // another name by now.
+    struct CacheEntry
+    {
+      const char * ptr_;
+      const char * name_;
+      size_t id_;
+    };
+
+    static const size_t CACHE_SIZE = 64;
+
   public:
     String2IdMap()
       : max_element_id_(1)
     {
+      ResetCache();
       name2id_[NKIT_STRDUP(S_STAR_.c_str())] = STAR_ID;
     }
 
     String2IdMap(const String2IdMap & from)
+      : max_element_id_(1)
     {
+      ResetCache();
       Set(from);
     }
 
@@ -56,13 +73,19 @@ namespace nkit
 
     size_t GetId(const char * str)
     {
-      Name2Id::const_iterator it = name2id_.find(const_cast<char *>(str)), end =
-          name2id_.end();
-      if (it != end)
-        return it->second;
-      size_t element_id = max_element_id_++;
-      name2id_.insert(std::make_pair(NKIT_STRDUP(str), element_id));
-      return element_id;
+      CacheEntry & entry = cache_[CacheIndex(str)];
+      if (entry.ptr_ == str && strcmp(entry.name_, str) == 0)
+        return entry.id_;
+
+      Name2Id::const_iterator it = name2id_.find(const_cast<char *>(str));
+      if (it == name2id_.end())
+        it = name2id_.insert(
+            std::make_pair(NKIT_STRDUP(str), max_element_id_++)).first;
+
+      entry.ptr_ = str;
+      entry.name_ = it->first;
+      entry.id_ = it->second;
+      return it->second;
     }
 
     std::string GetString(size_t id) const
@@ -86,13 +109,25 @@ namespace nkit
     }
 
   private:
+    static size_t CacheIndex(const char * str)
+    {
+      return (reinterpret_cast<size_t>(str) >> 3) & (CACHE_SIZE - 1);
+    }
+
+    void ResetCache()
+    {
+      memset(cache_, 0, sizeof(cache_));
+    }
+
     void Clear()
     {
       max_element_id_ = 1;
+      ResetCache();
 
       Name2Id::const_iterator it = name2id_.begin(), end = name2id_.end();
       for (; it != end; ++it)
         free(it->first);
+      name2id_.clear();
     }
 
     void Set(const String2IdMap & from)
@@ -109,6 +144,7 @@ namespace nkit
   private:
     Name2Id name2id_;
     size_t max_element_id_;
+    CacheEntry cache_[CACHE_SIZE];
   };
 
   inline std::ostream & operator << (std::ostream & str, const String2IdMap & map)
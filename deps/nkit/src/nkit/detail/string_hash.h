@@ -0,0 +1,130 @@
+/*
+   Copyright 2010-2014 Boris T. Darchiev (boris.darchiev@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __NKIT__DETAIL__STRING__HASH__H__
+#define __NKIT__DETAIL__STRING__HASH__H__
+
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include <nkit/types.h>
+
+namespace nkit
+{
+  namespace detail
+  {
+    // FNV-1a
+    inline uint32_t string_hash(const char * str, size_t len)
+    {
+      uint32_t hash = 2166136261u;
+      for (size_t i = 0; i < len; ++i)
+      {
+        hash ^= static_cast<uint8_t>(str[i]);
+        hash *= 16777619u;
+      }
+      return hash;
+    }
+
+    //--------------------------------------------------------------------------
+    // Small open addressing hash table for lookups by string keys which are
+    // built once and searched many times (option sets, name indexes).
+    template <typename V>
+    class StringHashMap
+    {
+      struct Slot
+      {
+        Slot() : hash_(0), used_(false), value_() {}
+
+        std::string key_;
+        uint32_t hash_;
+        bool used_;
+        V value_;
+      };
+
+    public:
+      StringHashMap() : size_(0) {}
+
+      void Insert(const std::string & key, const V & value)
+      {
+        if ((size_ + 1) * 2 > slots_.size())
+          Rehash(slots_.empty() ? 16 : slots_.size() * 2);
+
+        uint32_t hash = string_hash(key.data(), key.size());
+        Slot & slot = slots_[Lookup(key.data(), key.size(), hash)];
+        if (!slot.used_)
+        {
+          slot.used_ = true;
+          slot.hash_ = hash;
+          slot.key_ = key;
+          ++size_;
+        }
+        slot.value_ = value;
+      }
+
+      const V * Find(const char * key, size_t len) const
+      {
+        if (!size_)
+          return NULL;
+        const Slot & slot = slots_[Lookup(key, len, string_hash(key, len))];
+        return slot.used_ ? &slot.value_ : NULL;
+      }
+
+      const V * Find(const std::string & key) const
+      {
+        return Find(key.data(), key.size());
+      }
+
+      bool empty() const { return size_ == 0; }
+      size_t size() const { return size_; }
+
+    private:
+      // Returns index of slot with 'key' or of empty slot for it
+      size_t Lookup(const char * key, size_t len, uint32_t hash) const
+      {
+        size_t mask = slots_.size() - 1;
+        for (size_t i = hash & mask; ; i = (i + 1) & mask)
+        {
+          const Slot & slot = slots_[i];
+          if (!slot.used_ ||
+              (slot.hash_ == hash && slot.key_.size() == len &&
+                  memcmp(slot.key_.data(), key, len) == 0))
+            return i;
+        }
+      }
+
+      void Rehash(size_t capacity)
+      {
+        std::vector<Slot> old;
+        old.swap(slots_);
+        slots_.resize(capacity);
+        for (size_t i = 0; i < old.size(); ++i)
+        {
+          if (!old[i].used_)
+            continue;
+          slots_[Lookup(old[i].key_.data(), old[i].key_.size(),
+              old[i].hash_)] = old[i];
+        }
+      }
+
+    private:
+      std::vector<Slot> slots_;
+      size_t size_;
+    };
+  } // namespace detail
+} // namespace nkit
+
+#endif // __NKIT__DETAIL__STRING__HASH__H__
@@ -676,6 +676,7 @@ namespace nkit
     const Dynamic & back() const;
     Dynamic & back();
     Dynamic & Extend(const Dynamic & v);
+    void Reserve(const size_t size);
 
     template <typename T>
     void Join(const std::string & delimiter, const std::string & prefix,
@@ -149,7 +149,7 @@ namespace nkit
       return data.end_l();
     }
 
-    static std::string First(const DictConstIterator & it)
+    static const std::string & First(const DictConstIterator & it)
     {
       return it->first;
     }
@@ -164,6 +164,25 @@ namespace nkit
       return *it;
     }
 
+    static Var2XmlValueKind Kind(const Dynamic & data)
+    {
+      switch (data.type())
+      {
+      case detail::DICT:
+        return V2X_DICT;
+      case detail::LIST:
+        return V2X_LIST;
+      case detail::DATE_TIME:
+        return V2X_DATETIME;
+      case detail::FLOAT:
+        return V2X_FLOAT;
+      case detail::BOOL:
+        return V2X_BOOL;
+      default:
+        return V2X_SCALAR;
+      }
+    }
+
     static bool IsList(const Dynamic & data)
     {
       return data.IsList();
@@ -200,9 +219,9 @@ namespace nkit
     }
 
     static std::string GetStringAsDateTime(const Dynamic & data,
-            const std::string & format)
+            const detail::DateTimeFormat & format)
     {
-      return data.GetString(format.c_str());
+      return data.GetString(format.format().c_str());
     }
 
     static std::string GetStringAsFloat(const Dynamic & data,
@@ -218,6 +237,11 @@ namespace nkit
       return data ? bool_true_format: bool_false_format;
     }
 
+    static size_t ListSize(const Dynamic & data)
+    {
+      return data.size();
+    }
+
     static Dynamic GetByKey(const Dynamic & data, const std::string & key,
         bool * found)
     {
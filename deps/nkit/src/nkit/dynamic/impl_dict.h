@@ -130,6 +130,11 @@ namespace nkit
       static Dynamic & Get(Dynamic & v, const std::string & key)
       {
         StringDynamicMap & map = GetMap(v.data_);
+        // keys often come in sorted order (e.g. from JSON written by nkit),
+        // so new last key is appended without search
+        if (!map.empty() && map.rbegin()->first < key)
+          return map.insert(map.end(),
+              StringDynamicMap::value_type(key, Dynamic()))->second;
         return map[key];
       }
 
@@ -288,6 +288,11 @@ namespace nkit
         GetVector(v.data_).push_back(rv);
       }
 
+      static void Reserve(Dynamic & v, const size_t size)
+      {
+        GetVector(v.data_).reserve(size);
+      }
+
       static void PushFront(Dynamic & v, const Dynamic & rv)
       {
         DynamicVector & to = GetVector(v.data_);
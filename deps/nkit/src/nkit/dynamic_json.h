@@ -22,8 +22,11 @@
 #include <iomanip>
 
 #include <nkit/detail/push_options.h>
+#include <nkit/detail/char_scan.h>
 #include <nkit/dynamic.h>
 
+struct yajl_handle_t;
+
 #define __NKIT__WRITE__JSON__(src, dst) \
   nkit::detail::JsonWriter<T>::write_json(src, sizeof(src) - 1, dst);
 
@@ -40,6 +43,93 @@ namespace nkit
     std::string indent_newline;
   };
 
+  //----------------------------------------------------------------------------
+  // Destination of JSON written through JsonBuffer
+  class JsonSink
+  {
+  public:
+    virtual ~JsonSink() {}
+    virtual bool Write(const char * data, size_t size, std::string * error) = 0;
+  };
+
+  class JsonStreamSink : public JsonSink
+  {
+  public:
+    explicit JsonStreamSink(std::ostream & os) : os_(os) {}
+
+    bool Write(const char * data, size_t size, std::string * error)
+    {
+      os_.write(data, static_cast<std::streamsize>(size));
+      if (os_.good())
+        return true;
+      if (error)
+        *error = "Could not write JSON to stream";
+      return false;
+    }
+
+  private:
+    std::ostream & os_;
+  };
+
+  //----------------------------------------------------------------------------
+  // Output buffer for DynamicToJson. Fragments are copied to one big block,
+  // which is passed to sink when full; without sink the whole output is kept.
+  // Errors of sink are reported by Flush().
+  class JsonBuffer
+  {
+  public:
+    static const size_t DEFAULT_BLOCK_SIZE = 64 * 1024;
+
+    explicit JsonBuffer(JsonSink * sink = NULL,
+        size_t block_size = DEFAULT_BLOCK_SIZE)
+      : sink_(sink)
+      , block_size_(block_size ? block_size : DEFAULT_BLOCK_SIZE)
+      , failed_(false)
+    {
+      data_.reserve(block_size_);
+    }
+
+    void Append(const char * s, size_t size)
+    {
+      if (sink_ && data_.size() + size > block_size_)
+        WriteToSink();
+      data_.append(s, size);
+    }
+
+    // Passes rest of output to sink
+    bool Flush(std::string * error)
+    {
+      WriteToSink();
+      if (failed_ && error)
+        *error = error_;
+      return !failed_;
+    }
+
+    // Output which is not passed to sink yet
+    const std::string & str() const { return data_; }
+
+  private:
+    void WriteToSink()
+    {
+      if (!sink_ || data_.empty())
+        return;
+      if (!failed_)
+        failed_ = !sink_->Write(data_.data(), data_.size(), &error_);
+      data_.clear();
+    }
+
+  private:
+    JsonBuffer(const JsonBuffer &);
+    JsonBuffer & operator=(const JsonBuffer &);
+
+  private:
+    JsonSink * sink_;
+    size_t block_size_;
+    std::string data_;
+    bool failed_;
+    std::string error_;
+  };
+
   namespace detail
   {
     enum JsonHumanReadable
@@ -75,12 +165,76 @@ namespace nkit
       }
     };
 
+    // for JsonBuffer
+    template<>
+    struct JsonWriter<JsonBuffer>
+    {
+      static inline void write_json(const char * s, size_t size,
+          JsonBuffer * dst)
+      {
+        dst->Append(s, size);
+      }
+    };
+
+    //--------------------------------------------------------------------------
+    // Writes digits of 'v' before 'end', returns pointer to the first one
+    inline char * format_uint64(uint64_t v, char * end)
+    {
+      static const char DIGIT_PAIRS[] =
+          "00010203040506070809101112131415161718192021222324252627282930313233"
+          "34353637383940414243444546474849505152535455565758596061626364656667"
+          "6869707172737475767778798081828384858687888990919293949596979899";
+      while (v >= 100)
+      {
+        const char * pair = DIGIT_PAIRS + (v % 100) * 2;
+        v /= 100;
+        *--end = pair[1];
+        *--end = pair[0];
+      }
+      if (v >= 10)
+      {
+        const char * pair = DIGIT_PAIRS + v * 2;
+        *--end = pair[1];
+        *--end = pair[0];
+      }
+      else
+        *--end = static_cast<char>('0' + v);
+      return end;
+    }
+
+    inline char * format_int64(int64_t v, char * end)
+    {
+      if (v >= 0)
+        return format_uint64(static_cast<uint64_t>(v), end);
+      char * begin = format_uint64(0 - static_cast<uint64_t>(v), end);
+      *--begin = '-';
+      return begin;
+    }
+
+    // enough for "%f" of any double
+    static const size_t MAX_JSON_NUMBER_LEN = 512;
+
     template<typename T>
     inline void write_number(const Dynamic & v, T * t,
         const DynamicToJsonOptions & NKIT_UNUSED(options))
     {
-      const std::string tmp(v.GetString());
-      JsonWriter<T>::write_json(tmp.c_str(), tmp.size(), t);
+      char buffer[MAX_JSON_NUMBER_LEN];
+      char * end = buffer + sizeof(buffer);
+      char * begin;
+      if (v.IsFloat())
+      {
+        int size = NKIT_SNPRINTF(buffer, sizeof(buffer), "%f",
+            v.GetFloat());
+        if (unlikely(size < 0))
+          size = 0;
+        begin = buffer;
+        end = buffer + std::min(static_cast<size_t>(size), sizeof(buffer) - 1);
+      }
+      else if (v.IsUnsignedInteger())
+        begin = format_uint64(v.GetUnsignedInteger(), end);
+      else
+        begin = format_int64(v.GetSignedInteger(), end);
+      JsonWriter<T>::write_json(begin, static_cast<size_t>(end - begin), t);
     }
 
     template<typename T>
@@ -93,86 +247,76 @@ namespace nkit
       __NKIT__WRITE__JSON__("\"", t);
     }
 
+    // Writes quoted string. Runs of characters without escaping are written
+    // by one call.
     template<typename T>
-    void write_string_or_mongodb_oid(const Dynamic & v, T * t,
-        const DynamicToJsonOptions & NKIT_UNUSED(options))
+    void write_escaped_string(const char * begin, const char * end, T * t)
     {
-      std::string::const_iterator it = v.GetConstString().begin(), end =
-          v.GetConstString().end(), next;
       __NKIT__WRITE__JSON__("\"", t);
-      while (it != end)
+      while (begin < end)
       {
-        next = it;
-        ++next;
-        char ch = *it;
-        if (unlikely((ch == '\\') && (next != end) && (*next == '"')))
+        const char * special = find_json_special(begin, end);
+        if (special > begin)
+          JsonWriter<T>::write_json(begin,
+              static_cast<size_t>(special - begin), t);
+        if (special == end)
+          break;
+
+        switch (*special)
         {
+        case '\\':
+          __NKIT__WRITE__JSON__("\\\\", t);
+          break;
+        case '\"':
           __NKIT__WRITE__JSON__("\\\"", t);
-          ++it;
-        }
-        else
-        {
-          switch (ch)
+          break;
+        case '/':
+          __NKIT__WRITE__JSON__("\\/", t);
+          break;
+        case '\b':
+          __NKIT__WRITE__JSON__("\\b", t);
+          break;
+        case '\f':
+          __NKIT__WRITE__JSON__("\\f", t);
+          break;
+        case '\n':
+          __NKIT__WRITE__JSON__("\\n", t);
+          break;
+        case '\r':
+          __NKIT__WRITE__JSON__("\\r", t);
+          break;
+        case '\t':
+          __NKIT__WRITE__JSON__("\\t", t);
+          break;
+        default:
           {
-          case '\\':
-            __NKIT__WRITE__JSON__("\\\\", t)
-            ;
-            break;
-          case '\"':
-            __NKIT__WRITE__JSON__("\\\"", t)
-            ;
-            break;
-          case '/':
-            __NKIT__WRITE__JSON__("\\/", t)
-            ;
-            break;
-          case '\b':
-            __NKIT__WRITE__JSON__("\\b", t)
-            ;
-            break;
-          case '\f':
-            __NKIT__WRITE__JSON__("\\f", t)
-            ;
-            break;
-          case '\n':
-            __NKIT__WRITE__JSON__("\\n", t)
-            ;
-            break;
-          case '\r':
-            __NKIT__WRITE__JSON__("\\r", t)
-            ;
-            break;
-          case '\t':
-            __NKIT__WRITE__JSON__("\\t", t)
-            ;
-            break;
-          default:
-            if (unlikely(ch > 0 && ch <= 0x1F))
-            {
-              std::ostringstream oss;
-              oss << "\\u" << std::hex << std::uppercase << std::setfill('0')
-                  << std::setw(4) << static_cast<int>(ch);
-              const std::string str = oss.str();
-              JsonWriter<T>::write_json(str.c_str(), str.size() - 1, t);
-            }
-            else
-              JsonWriter<T>::write_json((char *) &ch, 1, t);
-            break;
+            static const char HEX[] = "0123456789ABCDEF";
+            char u[] = "\\u0000";
+            u[4] = HEX[(*special >> 4) & 0xF];
+            u[5] = HEX[*special & 0xF];
+            JsonWriter<T>::write_json(u, sizeof(u) - 1, t);
           }
+          break;
         }
-        ++it;
+        begin = special + 1;
       }
-
       __NKIT__WRITE__JSON__("\"", t);
     }
 
+    template<typename T>
+    void write_string_or_mongodb_oid(const Dynamic & v, T * t,
+        const DynamicToJsonOptions & NKIT_UNUSED(options))
+    {
+      const std::string & str = v.GetConstString();
+      write_escaped_string(str.data(), str.data() + str.size(), t);
+    }
+
     template<typename T>
     bool write_dict_item(const std::string & key, const Dynamic & v, T * t,
         const DynamicToJsonOptions & options)
     {
-      __NKIT__WRITE__JSON__("\"", t);
-      JsonWriter<T>::write_json(key.c_str(), key.size(), t);
-      __NKIT__WRITE__JSON__("\":", t);
+      write_escaped_string(key.data(), key.data() + key.size(), t);
+      __NKIT__WRITE__JSON__(":", t);
       return DynamicToJson(v, t, options);
     }
 
@@ -376,6 +520,22 @@ namespace nkit
     return out;
   }
 
+  // Writes 'v' to 'sink' by blocks of 'block_size' bytes
+  template<typename T>
+  bool DynamicToJsonSink(const T & v, JsonSink * sink, std::string * error,
+      const DynamicToJsonOptions & options = DEFAULT_DYNAMIC_TO_JSON_OPTIONS_,
+      size_t block_size = JsonBuffer::DEFAULT_BLOCK_SIZE)
+  {
+    JsonBuffer buffer(sink, block_size);
+    if (!DynamicToJson(v, &buffer, options))
+    {
+      if (error)
+        *error = "Could not convert value to JSON";
+      return false;
+    }
+    return buffer.Flush(error);
+  }
+
   template<typename T>
   bool DynamicToJsonFile(const T & v, const std::string & file_path,
       std::string * error,
@@ -390,7 +550,8 @@ namespace nkit
       return false;
     }
 
-    return DynamicToJson(v, &file_stream, options);
+    JsonStreamSink sink(file_stream);
+    return DynamicToJsonSink(v, &sink, error, options);
   }
 
   template <typename T>
@@ -406,7 +567,10 @@ namespace nkit
       return true;
     default:
     case detail::JSON_HR_ONE_LINE:
-      return DynamicToJson(v, &os, options);
+      {
+        JsonStreamSink sink(os);
+        return DynamicToJsonSink(v, &sink, NULL, options);
+      }
     }
   }
 
@@ -420,9 +584,36 @@ namespace nkit
   }
 
   Dynamic DynamicFromJson(const std::string & json, std::string * const error);
+  Dynamic DynamicFromJson(const char * json, size_t size,
+      std::string * const error);
+  // Reads file by fixed size chunks
   Dynamic DynamicFromJsonFile(const std::string & path,
       std::string * const error);
 
+  //----------------------------------------------------------------------------
+  class DynamicConstructor;
+
+  // Incremental JSON parser: JSON text is given by chunks of any size with
+  // Feed(), Finish() returns result. Parser can't be reused after Finish().
+  class DynamicJsonParser
+  {
+  public:
+    DynamicJsonParser();
+    ~DynamicJsonParser();
+
+    bool Feed(const char * chunk, size_t len, std::string * const error);
+    Dynamic Finish(std::string * const error);
+
+  private:
+    DynamicJsonParser(const DynamicJsonParser &);
+    DynamicJsonParser & operator=(const DynamicJsonParser &);
+
+  private:
+    Dynamic result_;
+    DynamicConstructor * constructor_;
+    yajl_handle_t * handle_;
+  };
+
 } // namespace nkit
 
 #undef __NKIT__WRITE__JSON__
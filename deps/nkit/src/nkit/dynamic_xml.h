@@ -58,6 +58,37 @@ namespace nkit
   Dynamic DynamicFromXmlFile(const std::string & path,
       const std::string & mapping,
       std::string * const error);
+
+  // For documents like '<root><record/>...<record/></root>' with list
+  // mapping: splits root content between root's children and parses parts
+  // in 'threads' threads (0 - number of processors). Falls back to
+  // DynamicFromXml() if document can not be split.
+  Dynamic DynamicFromXmlParallel(const std::string & xml,
+      const Dynamic & options,
+      const Dynamic & mapping,
+      size_t threads,
+      std::string * const error);
+  Dynamic DynamicFromXmlParallel(const std::string & xml,
+      const std::string & options,
+      const std::string & mapping,
+      size_t threads,
+      std::string * const error);
+
+  // Same as DynamicFromXmlParallel(), but reads file in chunks and splits
+  // root content while reading. Every 'threads' shards of about
+  // 'shard_size' bytes (0 - default size) are parsed in parallel before
+  // the rest of the file is read.
+  Dynamic DynamicFromXmlFileParallel(const std::string & path,
+      const Dynamic & options,
+      const Dynamic & mapping,
+      size_t threads,
+      size_t shard_size,
+      std::string * const error);
+  Dynamic DynamicFromXmlFileParallel(const std::string & path,
+      const std::string & options,
+      const std::string & mapping,
+      size_t threads,
+      std::string * const error);
 } // namespace nkit
 
 
@@ -5,37 +5,133 @@
 #include "expat.h"
 
 #include "nkit/transcode.h"
+#include "nkit/detail/fast_xml.h"
+#include "nkit/detail/legacy_decoder.h"
 
 namespace nkit
 {
+  //----------------------------------------------------------------------------
+  struct ExpatOptions
+  {
+    ExpatOptions()
+      : dtd_(true)
+      , entities_(true)
+      , hash_salt_(0)
+      , fast_lane_(false)
+    {}
+
+    // If not empty, namespace processing is on and element/attribute names
+    // are reported as 'namespace_uri<ns_separator[0]>local_name'
+    std::string ns_separator_;
+    // If false, documents with DOCTYPE declaration are rejected
+    bool dtd_;
+    // If false, documents with ENTITY declarations are rejected.
+    // This stops 'billion laughs' kind of attacks before any expansion.
+    bool entities_;
+    // Salt for Expat's internal hash tables; 0 - Expat's default
+    uint64_t hash_salt_;
+    // If true, document is parsed with detail::FastXmlTokenizer by complete
+    // top level elements as they arrive, with Expat as fallback for the rest
+    // of document (see ExpatParser::FeedFastLane())
+    bool fast_lane_;
+  };
+
   //----------------------------------------------------------------------------
   template<typename T>
   class ExpatParser
   {
   public:
-    ExpatParser() :
-        parser_(XML_ParserCreate(NULL))
+    explicit ExpatParser(const ExpatOptions & options = ExpatOptions())
+      : options_(options)
+      , parser_(options.ns_separator_.empty() ?
+          XML_ParserCreate(NULL) :
+          XML_ParserCreateNS(NULL, options.ns_separator_[0]))
     {
+      // fast lane knows nothing about namespaces
+      if (!options_.ns_separator_.empty())
+        options_.fast_lane_ = false;
       Reset();
     }
 
     bool Feed(const char* chunk, size_t len, bool last, std::string * error)
     {
+      std::string head;
+      if (!encoding_checked_)
+      {
+        if (!head_.empty())
+        {
+          head_.append(chunk, len);
+          head.swap(head_);
+          chunk = head.data();
+          len = head.size();
+        }
+
+        if (!CheckEncoding(chunk, len, last))
+        {
+          if (head.empty())
+            head_.assign(chunk, len);
+          else
+            head_.swap(head);
+          return true;
+        }
+      }
+
+      if (decoder_.is_open())
+      {
+        if (!decoder_.Decode(chunk, len, last, &decoded_, error))
+        {
+          Reset();
+          return false;
+        }
+        chunk = decoded_.data();
+        len = decoded_.size();
+      }
+
+      if (options_.fast_lane_ && !expat_started_)
+        return FeedFastLane(chunk, len, last, error);
+
+      expat_started_ = true;
       bool result = true;
       if (!XML_Parse(parser_, chunk, len, last))
       {
-        XML_Error code = XML_GetErrorCode(parser_);
-        if (code == XML_ERROR_ABORTED)
-          static_cast<T*>(this)->GetCustomError(error);
-        else
-          *error = "Parse error at (line:"
-              + nkit::string_cast(
-                  static_cast<uint64_t>(XML_GetCurrentLineNumber(parser_)))
-              + ", column:"
-              + nkit::string_cast(
-                  static_cast<uint64_t>(XML_GetCurrentColumnNumber(parser_)))
-              + ") " + XML_ErrorString(code);
+        GetParseError(error);
+        result = false;
+      }
+
+      if (last)
+        Reset();
+      return result;
+    }
+
+    // Fill-in-place alternative to Feed(): caller writes up to 'len' bytes
+    // directly into Expat's own buffer, then calls ParseBuffer() with the
+    // number of bytes actually written. Saves one copy of every chunk.
+    void * GetBuffer(size_t len)
+    {
+      // until encoding is known, for decoded input and for fast lane, data
+      // goes through Feed()
+      if (!encoding_checked_ || decoder_.is_open() ||
+          (options_.fast_lane_ && !expat_started_))
+      {
+        feed_buffer_.resize(len);
+        feed_buffer_used_ = true;
+        return &feed_buffer_[0];
+      }
+      return XML_GetBuffer(parser_, static_cast<int>(len));
+    }
+
+    bool ParseBuffer(size_t len, bool last, std::string * error)
+    {
+      if (feed_buffer_used_)
+      {
+        feed_buffer_used_ = false;
+        return Feed(feed_buffer_.data(), len, last, error);
+      }
 
+      bool result = true;
+      if (!XML_ParseBuffer(parser_, static_cast<int>(len), last))
+      {
+        GetParseError(error);
         result = false;
       }
 
@@ -56,14 +152,229 @@ namespace nkit
     {
       XML_ParserReset(parser_, NULL);
       XML_SetUserData(parser_, this);
-      XML_SetElementHandler(parser_, &ExpatParser::OnStartElement,
-          &ExpatParser::OnEndElement);
-      XML_SetCharacterDataHandler(parser_, &ExpatParser::OnText);
+      SetHandlers(true);
       XML_SetUnknownEncodingHandler(parser_, &ExpatParser::OnUnknownEncoding,
           this);
+      if (!options_.dtd_)
+        XML_SetStartDoctypeDeclHandler(parser_, &ExpatParser::OnStartDoctype);
+      if (!options_.entities_)
+      {
+        XML_SetParamEntityParsing(parser_, XML_PARAM_ENTITY_PARSING_NEVER);
+        XML_SetEntityDeclHandler(parser_, &ExpatParser::OnEntityDecl);
+      }
+      if (options_.hash_salt_)
+        XML_SetHashSalt(parser_,
+            static_cast<unsigned long>(options_.hash_salt_));
+      parser_error_.clear();
+      expat_started_ = false;
+      expat_line_offset_ = 0;
+      expat_column_offset_ = 0;
+      fast_lane_.Reset();
+      std::string().swap(fast_lane_buffer_);
+      fast_lane_line_ = 1;
+      fast_lane_column_ = 0;
+      encoding_checked_ = false;
+      feed_buffer_used_ = false;
+      head_.clear();
+      decoder_.Close();
     }
 
   private:
+    void SetHandlers(bool on)
+    {
+      if (on)
+      {
+        XML_SetElementHandler(parser_, &ExpatParser::OnStartElement,
+            &ExpatParser::OnEndElement);
+        XML_SetCharacterDataHandler(parser_, &ExpatParser::OnText);
+      }
+      else
+      {
+        XML_SetElementHandler(parser_, NULL, NULL);
+        XML_SetCharacterDataHandler(parser_, NULL);
+      }
+    }
+
+    // Complete top level elements are parsed by fast lane as soon as they
+    // arrive, so only the unfinished one is kept in 'fast_lane_buffer_'.
+    // Rest of document goes to Expat if fast lane can't handle it, or if
+    // unfinished element grows beyond FAST_LANE_MAX_PENDING.
+    bool FeedFastLane(const char* chunk, size_t len, bool last,
+        std::string * error)
+    {
+      fast_lane_buffer_.append(chunk, len);
+      const char * doc = fast_lane_buffer_.data();
+      size_t parsable;
+      bool supported = fast_lane_.Scan(doc, fast_lane_buffer_.size(), last,
+          &parsable) == detail::FastXmlTokenizer::FAST_OK;
+
+      if (parsable || (last && supported))
+      {
+        detail::FastXmlTokenizer::Result result =
+            fast_lane_.Parse(this, doc, parsable, last && supported);
+        if (result != detail::FastXmlTokenizer::FAST_OK)
+        {
+          if (result == detail::FastXmlTokenizer::FAST_ABORTED)
+            static_cast<T*>(this)->GetCustomError(error);
+          else
+            GetFastLaneError(last, error);
+          Reset();
+          return false;
+        }
+        AdvancePosition(doc, doc + parsable, &fast_lane_line_,
+            &fast_lane_column_);
+        fast_lane_.Consume(parsable);
+        fast_lane_buffer_.erase(0, parsable);
+      }
+
+      if (supported && fast_lane_buffer_.size() <= FAST_LANE_MAX_PENDING)
+      {
+        if (last)
+          Reset();
+        return true;
+      }
+
+      expat_started_ = true;
+      bool result = true;
+      if (!StartExpat(last, true))
+      {
+        GetParseError(error);
+        result = false;
+      }
+      std::string().swap(fast_lane_buffer_);
+      if (last)
+        Reset();
+      return result;
+    }
+
+    // Brings Expat to the state of fast lane, then parses data which fast
+    // lane has not parsed, with or without 'handlers'. Error positions are
+    // corrected to be relative to the beginning of document.
+    bool StartExpat(bool last, bool handlers)
+    {
+      std::string prefix = fast_lane_.ExpatPrefix();
+      expat_line_offset_ = fast_lane_line_ - 1;
+      expat_column_offset_ = static_cast<int64_t>(fast_lane_column_) -
+          static_cast<int64_t>(prefix.size());
+      SetHandlers(false);
+      if (!prefix.empty() && XML_Parse(parser_, prefix.data(),
+          static_cast<int>(prefix.size()), false) == XML_STATUS_ERROR)
+        return false;
+      SetHandlers(handlers);
+      return XML_Parse(parser_, fast_lane_buffer_.data(),
+          static_cast<int>(fast_lane_buffer_.size()), last) !=
+          XML_STATUS_ERROR;
+    }
+
+    // Fast lane has found error in the unparsed data. Error is reported as
+    // Expat reports it, Expat runs without handlers.
+    void GetFastLaneError(bool last, std::string * error)
+    {
+      if (!StartExpat(last, false))
+      {
+        GetParseError(error);
+        return;
+      }
+
+      const char * doc = fast_lane_buffer_.data();
+      uint64_t line = fast_lane_line_, column = fast_lane_column_;
+      AdvancePosition(doc, doc + fast_lane_.error_pos(), &line, &column);
+      FormatParseError(fast_lane_.error_code(), line, column, error);
+    }
+
+    // Expat counts columns in characters, BOM included
+    static void AdvancePosition(const char * begin, const char * end,
+        uint64_t * line, uint64_t * column)
+    {
+      for (const char * p = begin; p < end; ++p)
+      {
+        if (*p == '\n')
+        {
+          ++*line;
+          *column = 0;
+        }
+        else if ((static_cast<uint8_t>(*p) & 0xC0) != 0x80)
+          ++*column;
+      }
+    }
+
+    // Returns false if more data is needed to find declared encoding.
+    // Multi-byte encodings, which Expat can't handle even with
+    // OnUnknownEncoding(), are decoded to UTF-8 before parsing.
+    bool CheckEncoding(const char * chunk, size_t len, bool last)
+    {
+      std::string encoding;
+      if (!detail::get_declared_encoding(chunk, chunk + len, &encoding) &&
+          !last && len < MAX_DECLARATION_LEN)
+        return false;
+
+      encoding_checked_ = true;
+      if (encoding.empty() || IsExpatEncoding(encoding) ||
+          Transcoder::Find(encoding))
+        return true;
+      if (decoder_.Open(encoding))
+        XML_SetEncoding(parser_, "UTF-8");
+      return true;
+    }
+
+    static bool IsExpatEncoding(const std::string & encoding)
+    {
+      static const char * const names[] =
+      {
+        "UTF-8", "UTF-16", "UTF-16BE", "UTF-16LE", "ISO-8859-1", "US-ASCII",
+        NULL
+      };
+      for (size_t i = 0; names[i]; ++i)
+        if (NKIT_STRCASECMP(names[i], encoding.c_str()) == 0)
+          return true;
+      return false;
+    }
+
+
+    void GetParseError(std::string * error)
+    {
+      XML_Error code = XML_GetErrorCode(parser_);
+      if (code == XML_ERROR_ABORTED && !parser_error_.empty())
+        *error = parser_error_;
+      else if (code == XML_ERROR_ABORTED)
+        static_cast<T*>(this)->GetCustomError(error);
+      else
+      {
+        uint64_t line = XML_GetCurrentLineNumber(parser_);
+        int64_t column = XML_GetCurrentColumnNumber(parser_);
+        if (line == 1)
+          column += expat_column_offset_;
+        FormatParseError(code, line + expat_line_offset_,
+            static_cast<uint64_t>(column), error);
+      }
+    }
+
+    static void FormatParseError(XML_Error code, uint64_t line,
+        uint64_t column, std::string * error)
+    {
+      *error = "Parse error at (line:" + nkit::string_cast(line)
+          + ", column:" + nkit::string_cast(column)
+          + ") " + XML_ErrorString(code);
+    }
+
+    // detail::FastXmlTokenizer handler interface
+    friend class detail::FastXmlTokenizer;
+
+    bool FastStartElement(const char * el, const char ** attrs)
+    {
+      return static_cast<T *>(this)->OnStartElement(el, attrs);
+    }
+
+    bool FastEndElement(const char * el)
+    {
+      return static_cast<T *>(this)->OnEndElement(el);
+    }
+
+    bool FastText(const char * text, int len)
+    {
+      return static_cast<T *>(this)->OnText(text, len);
+    }
+
     void AbortParsing()
     {
       XML_StopParser(parser_, 0);
@@ -90,6 +401,33 @@ namespace nkit
         derived->AbortParsing();
     }
 
+    void AbortParsing(const char * reason)
+    {
+      parser_error_ = reason;
+      AbortParsing();
+    }
+
+    static void OnStartDoctype(void *data, const XML_Char * NKIT_UNUSED(name),
+        const XML_Char * NKIT_UNUSED(sysid),
+        const XML_Char * NKIT_UNUSED(pubid),
+        int NKIT_UNUSED(has_internal_subset))
+    {
+      static_cast<T *>(data)->AbortParsing("DTD is not allowed");
+    }
+
+    static void OnEntityDecl(void *data,
+        const XML_Char * NKIT_UNUSED(entity_name),
+        int NKIT_UNUSED(is_parameter_entity),
+        const XML_Char * NKIT_UNUSED(value), int NKIT_UNUSED(value_length),
+        const XML_Char * NKIT_UNUSED(base),
+        const XML_Char * NKIT_UNUSED(system_id),
+        const XML_Char * NKIT_UNUSED(public_id),
+        const XML_Char * NKIT_UNUSED(notation_name))
+    {
+      static_cast<T *>(data)->AbortParsing(
+          "Entity declarations are not allowed");
+    }
+
     static int OnUnknownEncoding(void * NKIT_UNUSED(data),
         const XML_Char * name,
         XML_Encoding * info)
@@ -112,7 +450,26 @@ namespace nkit
     }
 
   private:
+    ExpatOptions options_;
     XML_Parser parser_;
+    std::string parser_error_;
+    bool expat_started_;
+    // Expat has started from the middle of document
+    uint64_t expat_line_offset_;
+    int64_t expat_column_offset_;
+    detail::FastXmlTokenizer fast_lane_;
+    // unparsed data of fast lane and position of its beginning
+    std::string fast_lane_buffer_;
+    uint64_t fast_lane_line_;
+    uint64_t fast_lane_column_;
+    static const size_t FAST_LANE_MAX_PENDING = 1024 * 1024;
+    static const size_t MAX_DECLARATION_LEN = 1024;
+    bool encoding_checked_;
+    std::string head_;
+    detail::LegacyDecoder decoder_;
+    std::string decoded_;
+    bool feed_buffer_used_;
+    std::string feed_buffer_;
   };
 
 } // namespace nkit
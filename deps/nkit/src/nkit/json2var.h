@@ -0,0 +1,271 @@
+#ifndef NKIT_JSON2VAR_H
+#define NKIT_JSON2VAR_H
+
+#include <vector>
+
+#include <yajl/yajl_parse.h>
+
+#include "nkit/xml2var.h"
+
+namespace nkit
+{
+  //----------------------------------------------------------------------------
+  // Applies xml2var mappings to JSON stream. JSON is seen as XML written by
+  // var2xml with default options:
+  //  - object keys are element names;
+  //  - list under the key is a sequence of elements with key name;
+  //  - items of top level list and of lists in lists are 'item' elements;
+  //  - scalars are element texts, null is empty element.
+  // Only mapped parts of document are built, so memory usage does not depend
+  // on document size.
+  template <typename T>
+  class Json2VarBuilder
+  {
+  private:
+    typedef StructXml2VarBuilder<T> Mapper;
+
+    struct Frame
+    {
+      Frame(const std::string & name, const std::string & item_name,
+          bool is_map, bool opened)
+        : name_(name)
+        , item_name_(item_name)
+        , is_map_(is_map)
+        , opened_(opened)
+      {}
+
+      // name of the element opened for container (if any)
+      std::string name_;
+      // name of elements for list items
+      std::string item_name_;
+      bool is_map_;
+      bool opened_;
+    };
+
+  public:
+    typedef NKIT_SHARED_PTR(Json2VarBuilder<T>) Ptr;
+
+  public:
+    static Ptr Create(const std::string & options,
+        const std::string & mappings, std::string * error)
+    {
+      typename Mapper::Ptr mapper = Mapper::Create(options, mappings, error);
+      if (!mapper)
+        return Ptr();
+      return Create(mapper, error);
+    }
+
+    static Ptr Create(const Dynamic & options, const Dynamic & mappings,
+        std::string * error)
+    {
+      typename Mapper::Ptr mapper = Mapper::Create(options, mappings, error);
+      if (!mapper)
+        return Ptr();
+      return Create(mapper, error);
+    }
+
+    static Ptr Create(const Dynamic & options, std::string * error)
+    {
+      typename Mapper::Ptr mapper = Mapper::Create(options, error);
+      if (!mapper)
+        return Ptr();
+      return Create(mapper, error);
+    }
+
+    ~Json2VarBuilder()
+    {
+      yajl_free(handle_);
+    }
+
+    bool AddMapping(const std::string & target_name,
+        const Dynamic & mapping, std::string * error)
+    {
+      return mapper_->AddMapping(target_name, mapping, error);
+    }
+
+    StringList mapping_names() const
+    {
+      return mapper_->mapping_names();
+    }
+
+    const typename T::type & var(const std::string & target_name) const
+    {
+      return mapper_->var(target_name);
+    }
+
+    bool Feed(const char * chunk, size_t len, bool last, std::string * error)
+    {
+      const unsigned char * json =
+          reinterpret_cast<const unsigned char *>(chunk);
+      yajl_status st = yajl_parse(handle_, json, len);
+      if (st == yajl_status_ok && last)
+        st = yajl_complete_parse(handle_);
+
+      if (st == yajl_status_ok)
+        return true;
+
+      if (st == yajl_status_client_canceled)
+      {
+        mapper_->GetCustomError(error);
+      }
+      else
+      {
+        unsigned char * message = yajl_get_error(handle_, 1, json, len);
+        *error = reinterpret_cast<const char *>(message);
+        yajl_free_error(handle_, message);
+      }
+      return false;
+    }
+
+  private:
+    static Ptr Create(const typename Mapper::Ptr & mapper,
+        std::string * error)
+    {
+      Ptr ret(new Json2VarBuilder<T>(mapper));
+      if (!ret->handle_)
+      {
+        *error = "Could not allocate yajl handler";
+        return Ptr();
+      }
+      return ret;
+    }
+
+    Json2VarBuilder(const typename Mapper::Ptr & mapper)
+      : mapper_(mapper)
+      , handle_(yajl_alloc(&callbacks_, NULL, this))
+    {
+      if (handle_)
+        yajl_config(handle_, yajl_allow_comments, 1);
+    }
+
+    Json2VarBuilder(const Json2VarBuilder &);
+    Json2VarBuilder & operator=(const Json2VarBuilder &);
+
+    // Name of element for the next value
+    const std::string & ValueName() const
+    {
+      static const std::string ROOT("root");
+      if (stack_.empty())
+        return ROOT;
+      const Frame & top = stack_.back();
+      return top.is_map_ ? key_ : top.item_name_;
+    }
+
+    bool Scalar(const char * text, size_t len)
+    {
+      const char * name = ValueName().c_str();
+      return mapper_->OnStartElement(name, NoAttrs()) &&
+          (!len || mapper_->OnText(text, static_cast<int>(len))) &&
+          mapper_->OnEndElement(name);
+    }
+
+    bool StartMap()
+    {
+      const std::string & name = ValueName();
+      stack_.push_back(Frame(name, S_EMPTY_, true, true));
+      return mapper_->OnStartElement(stack_.back().name_.c_str(), NoAttrs());
+    }
+
+    bool StartArray()
+    {
+      static const std::string ITEM("item");
+      const std::string & name = ValueName();
+      // list of object member is a sequence of elements with member name
+      if (!stack_.empty() && stack_.back().is_map_)
+      {
+        stack_.push_back(Frame(name, name, false, false));
+        return true;
+      }
+      stack_.push_back(Frame(name, ITEM, false, true));
+      return mapper_->OnStartElement(stack_.back().name_.c_str(), NoAttrs());
+    }
+
+    bool EndContainer()
+    {
+      bool ok = true;
+      if (stack_.back().opened_)
+        ok = mapper_->OnEndElement(stack_.back().name_.c_str());
+      stack_.pop_back();
+      return ok;
+    }
+
+    static const char ** NoAttrs()
+    {
+      static const char * no_attrs[] = { NULL };
+      return no_attrs;
+    }
+
+    //--------------------------------------------------------------------------
+    static Json2VarBuilder * Self(void * ctx)
+    {
+      return static_cast<Json2VarBuilder *>(ctx);
+    }
+
+    static int OnNull(void * ctx)
+    {
+      return Self(ctx)->Scalar(NULL, 0);
+    }
+
+    static int OnBoolean(void * ctx, int v)
+    {
+      return v ? Self(ctx)->Scalar("true", 4) : Self(ctx)->Scalar("false", 5);
+    }
+
+    static int OnNumber(void * ctx, const char * str, size_t len)
+    {
+      return Self(ctx)->Scalar(str, len);
+    }
+
+    static int OnString(void * ctx, const unsigned char * str, size_t len)
+    {
+      return Self(ctx)->Scalar(reinterpret_cast<const char *>(str), len);
+    }
+
+    static int OnStartMap(void * ctx)
+    {
+      return Self(ctx)->StartMap();
+    }
+
+    static int OnMapKey(void * ctx, const unsigned char * str, size_t len)
+    {
+      Self(ctx)->key_.assign(reinterpret_cast<const char *>(str), len);
+      return 1;
+    }
+
+    static int OnEndContainer(void * ctx)
+    {
+      return Self(ctx)->EndContainer();
+    }
+
+    static int OnStartArray(void * ctx)
+    {
+      return Self(ctx)->StartArray();
+    }
+
+  private:
+    static yajl_callbacks callbacks_;
+    typename Mapper::Ptr mapper_;
+    yajl_handle handle_;
+    std::vector<Frame> stack_;
+    std::string key_;
+  }; // Json2VarBuilder
+
+  template <typename T>
+  yajl_callbacks Json2VarBuilder<T>::callbacks_ =
+  {
+    Json2VarBuilder<T>::OnNull,
+    Json2VarBuilder<T>::OnBoolean,
+    NULL, // integers and doubles go to OnNumber as they are written
+    NULL,
+    Json2VarBuilder<T>::OnNumber,
+    Json2VarBuilder<T>::OnString,
+    Json2VarBuilder<T>::OnStartMap,
+    Json2VarBuilder<T>::OnMapKey,
+    Json2VarBuilder<T>::OnEndContainer,
+    Json2VarBuilder<T>::OnStartArray,
+    Json2VarBuilder<T>::OnEndContainer
+  };
+
+} // namespace nkit
+
+#endif // NKIT_JSON2VAR_H
@@ -0,0 +1,97 @@
+/*
+   Copyright 2010-2014 Boris T. Darchiev (boris.darchiev@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __NKIT__THREADING__THREAD__IMPL__H__
+#define __NKIT__THREADING__THREAD__IMPL__H__
+
+#include <nkit/detail/push_options.h>
+
+#if defined(NKIT_PTHREAD)
+#  include <nkit/threading/pthread_thread.h>
+#elif defined(NKIT_WINNT)
+#  include <nkit/threading/winnt_thread.h>
+#endif
+
+#include <vector>
+
+namespace nkit
+{
+  class Runnable
+  {
+  public:
+    virtual ~Runnable() {}
+    virtual void Run() = 0;
+  };
+
+  class Thread
+  {
+    Thread(const Thread &);
+    Thread & operator=(const Thread &);
+  public:
+    Thread() : impl_() {}
+    ~Thread() {}
+
+    // Returns false if thread could not be created
+    bool Start(Runnable * task) { return impl_.Start(&Thread::Main, task); }
+    void Join() { impl_.Join(); }
+
+  private:
+    static void Main(void * task) { static_cast<Runnable *>(task)->Run(); }
+
+  private:
+    ThreadImpl impl_;
+  }; // class Thread
+
+  // Number of processors available, at least 1
+  inline size_t hardware_concurrency()
+  {
+    return ThreadImpl::HardwareConcurrency();
+  }
+
+  // Runs every task in its own thread (first one - in calling thread) and
+  // waits for all of them. If thread could not be created, its task is run
+  // in calling thread.
+  inline void RunInParallel(const std::vector<Runnable *> & tasks)
+  {
+    if (tasks.empty())
+      return;
+
+    std::vector<Thread *> threads;
+    threads.reserve(tasks.size() - 1);
+    for (size_t i = 1; i < tasks.size(); ++i)
+    {
+      Thread * thread = new Thread;
+      if (thread->Start(tasks[i]))
+        threads.push_back(thread);
+      else
+      {
+        delete thread;
+        tasks[i]->Run();
+      }
+    }
+
+    tasks[0]->Run();
+
+    for (size_t i = 0; i < threads.size(); ++i)
+    {
+      threads[i]->Join();
+      delete threads[i];
+    }
+  }
+
+} // namespace nkit
+
+#endif // __NKIT__THREADING__THREAD__IMPL__H__
@@ -0,0 +1,81 @@
+/*
+   Copyright 2010-2014 Boris T. Darchiev (boris.darchiev@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __NKIT__DETAIL__PTHREAD__THREAD__IMPL__H__
+#define __NKIT__DETAIL__PTHREAD__THREAD__IMPL__H__
+
+#include <nkit/tools.h>
+
+#include <pthread.h>
+#include <unistd.h>
+
+namespace nkit
+{
+  class ThreadImpl
+  {
+    ThreadImpl(const ThreadImpl &);
+    ThreadImpl & operator =(const ThreadImpl &);
+  public:
+    typedef void (*Routine)(void * arg);
+
+    ThreadImpl() : t_(), started_(false), routine_(NULL), arg_(NULL) {}
+
+    ~ThreadImpl()
+    {
+      Join();
+    }
+
+    bool Start(Routine routine, void * arg)
+    {
+      routine_ = routine;
+      arg_ = arg;
+      started_ = pthread_create(&t_, NULL, &ThreadImpl::Main, this) == 0;
+      return started_;
+    }
+
+    static size_t HardwareConcurrency()
+    {
+      long count = sysconf(_SC_NPROCESSORS_ONLN);
+      return count > 0 ? static_cast<size_t>(count) : 1;
+    }
+
+    void Join()
+    {
+      if (started_)
+      {
+        pthread_join(t_, NULL);
+        started_ = false;
+      }
+    }
+
+  private:
+    static void * Main(void * self)
+    {
+      ThreadImpl * t = static_cast<ThreadImpl *>(self);
+      t->routine_(t->arg_);
+      return NULL;
+    }
+
+  private:
+    pthread_t t_;
+    bool started_;
+    Routine routine_;
+    void * arg_;
+  }; // class ThreadImpl
+
+} // namespace nkit
+
+#endif
@@ -0,0 +1,79 @@
+/*
+   Copyright 2010-2014 Boris T. Darchiev (boris.darchiev@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __NKIT__DETAIL__WINNT__THREAD__IMPL__H__
+#define __NKIT__DETAIL__WINNT__THREAD__IMPL__H__
+
+#include <windows.h>
+#include <nkit/tools.h>
+
+namespace nkit
+{
+  class ThreadImpl
+  {
+    ThreadImpl(const ThreadImpl &);
+    ThreadImpl & operator=(const ThreadImpl &);
+  public:
+    typedef void (*Routine)(void * arg);
+
+    ThreadImpl() : t_(NULL), routine_(NULL), arg_(NULL) {}
+
+    ~ThreadImpl()
+    {
+      Join();
+    }
+
+    bool Start(Routine routine, void * arg)
+    {
+      routine_ = routine;
+      arg_ = arg;
+      t_ = CreateThread(NULL, 0, &ThreadImpl::Main, this, 0, NULL);
+      return t_ != NULL;
+    }
+
+    static size_t HardwareConcurrency()
+    {
+      SYSTEM_INFO info;
+      GetSystemInfo(&info);
+      return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+    }
+
+    void Join()
+    {
+      if (t_ != NULL)
+      {
+        WaitForSingleObject(t_, INFINITE);
+        CloseHandle(t_);
+        t_ = NULL;
+      }
+    }
+
+  private:
+    static DWORD WINAPI Main(LPVOID self)
+    {
+      ThreadImpl * t = static_cast<ThreadImpl *>(self);
+      t->routine_(t->arg_);
+      return 0;
+    }
+
+  private:
+    HANDLE t_;
+    Routine routine_;
+    void * arg_;
+  };
+} // namespace nkit
+
+#endif
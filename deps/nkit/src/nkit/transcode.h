@@ -32,7 +32,6 @@ namespace nkit
             std::string * to);
 
   private:
-    typedef std::map<uint16_t, char> SingleUtf16ToCharMap;
     typedef bool (*SPECIAL_CHAR_CALLBACK)(char ch, std::string * out);
 
   public:
@@ -52,11 +51,26 @@ namespace nkit
     bool FromUtf8(const char ** src, size_t * bytes_left,
             std::string * out) const;
     void AddMapping(uint16_t single_utf16_c, char c);
-    bool GetChar(uint16_t single_utf16_c, char * c) const;
+    bool GetChar(uint16_t single_utf16_c, char * c) const
+    {
+      uint16_t entry = reverse_pages_[
+          (static_cast<size_t>(reverse_page_index_[single_utf16_c >> 8]) << 8)
+          | (single_utf16_c & 0xFF)];
+      if (unlikely(!entry))
+        return false;
+      *c = static_cast<char>(entry);
+      return true;
+    }
 
   private:
     const uint16_t * char_to_single_utf16_map_;
-    std::vector<SingleUtf16ToCharMap> single_utf16_to_char_hash_table_;
+    // Two-level UTF-16 -> char table: page number by high byte of UTF-16
+    // character, then entry by low byte. Page 0 is always empty.
+    // Entry is (MAPPED | char), 0 means 'no mapping'.
+    static const uint16_t MAPPED = 0x100;
+    uint8_t reverse_page_index_[0x100];
+    std::vector<uint16_t> reverse_pages_;
+    bool ascii_compatible_;
   };
 
 } // namespace nkit
@@ -17,17 +17,37 @@
 #ifndef NKIT__XML2VAR__H__
 #define NKIT__XML2VAR__H__
 
+#include <new>
 #include <stack>
+#include <vector>
 
 #include "nkit/dynamic_getter.h"
 #include "nkit/transcode.h"
+#include "nkit/thread.h"
+#include "nkit/detail/char_scan.h"
+#include "nkit/detail/date_time_format.h"
+#include "nkit/detail/string_hash.h"
 
 namespace nkit
 {
+  //----------------------------------------------------------------------------
+  // Kinds of values distinguished by Var2XmlConverter. Reader policies
+  // classify each value once by T::Kind() instead of chain of T::IsXxx()
+  enum Var2XmlValueKind
+  {
+    V2X_SCALAR = 0, // written as T::GetString()
+    V2X_DICT,
+    V2X_LIST,
+    V2X_DATETIME,
+    V2X_FLOAT,
+    V2X_BOOL
+  };
+
   //----------------------------------------------------------------------------
   struct Var2XmlOptions
   {
     static const size_t DEFAULT_FLOAT_PRECISION;
+    static const size_t DEFAULT_BUFFER_SIZE;
     static const std::string ITEM_NAME_DEFAULT;
     static const std::string BOOL_TRUE;
     static const std::string BOOL_FALSE;
@@ -70,6 +90,8 @@ namespace nkit
                 S_DATE_TIME_DEFAULT_FORMAT_)
         .Get(".bool_true", &res->bool_true_, BOOL_TRUE)
         .Get(".bool_false", &res->bool_false_, BOOL_FALSE)
+        .Get(".buffer_size", &res->buffer_size_, DEFAULT_BUFFER_SIZE)
+        .Get(".parallel", &res->parallel_, size_t(1))
       ;
 
       if (!op.ok())
@@ -78,8 +100,10 @@ namespace nkit
         return Ptr();
       }
 
-      std::copy(res->priority_list_.begin(), res->priority_list_.end(),
-          std::inserter(res->priority_set_, res->priority_set_.begin()));
+      StringList::const_iterator pr_it = res->priority_list_.begin(),
+          pr_end = res->priority_list_.end();
+      for (; pr_it != pr_end; ++pr_it)
+        res->priority_index_.Insert(*pr_it, true);
 
       if (res->cdata_.empty())
       {
@@ -104,6 +128,11 @@ namespace nkit
           res->cdata_exclude_ = true;
       }
 
+      StringSet::const_iterator cd_it = res->cdata_.begin(),
+          cd_end = res->cdata_.end();
+      for (; cd_it != cd_end; ++cd_it)
+        res->cdata_index_.Insert(*cd_it, true);
+
       if (!istrequal(encoding, S_UTF_8_))
       {
         res->transcoder_ = Transcoder::Find(encoding);
@@ -114,6 +143,11 @@ namespace nkit
         }
       }
 
+      if (res->parallel_ == 0)
+        res->parallel_ = hardware_concurrency();
+
+      res->compiled_date_time_format_.Compile(res->date_time_format_);
+
       if (!version.empty())
       {
         res->xml_dec_ = "<?xml version=\"" + version +
@@ -128,6 +162,9 @@ namespace nkit
       : transcoder_(NULL)
       , cdata_exclude_(false)
       , float_precision_(DEFAULT_FLOAT_PRECISION)
+      , buffer_size_(DEFAULT_BUFFER_SIZE)
+      , parallel_(1)
+      , special_chars_("<>&\"'")
     {}
 
     const Transcoder * transcoder_;
@@ -138,15 +175,36 @@ namespace nkit
     std::string xml_dec_;
     Pretty pretty_;
     StringSet cdata_;
-    StringSet priority_set_;
     StringList priority_list_;
+    // hashed copies of 'cdata_' and 'priority_list_' for per-element lookups
+    detail::StringHashMap<bool> cdata_index_;
+    detail::StringHashMap<bool> priority_index_;
     bool cdata_exclude_;
     size_t float_precision_;
     std::string date_time_format_;
+    // 'date_time_format_' compiled once for all values of all conversions
+    // with these options
+    detail::DateTimeFormat compiled_date_time_format_;
     std::string bool_true_;
     std::string bool_false_;
+    size_t buffer_size_;
+    size_t parallel_;
+    // characters escaped in text and attributes; built here, before
+    // parallel workers share these options
+    detail::CharScanner special_chars_;
   };  // struct Var2XmlOptions
 
+  //----------------------------------------------------------------------------
+  // Destination of XML produced by Var2XmlConverter. Data is written in
+  // blocks of about Var2XmlOptions::buffer_size_ bytes, always cut at element
+  // boundaries.
+  class Var2XmlSink
+  {
+  public:
+    virtual ~Var2XmlSink() {}
+    virtual bool Write(const char * data, size_t size, std::string * error) = 0;
+  };
+
   //----------------------------------------------------------------------------
   template <typename T>
   class Var2XmlConverter
@@ -156,6 +214,111 @@ namespace nkit
     typedef typename T::ListConstIterator ListConstIterator;
 
   public:
+    typedef NKIT_SHARED_PTR(Var2XmlConverter) Ptr;
+
+    //--------------------------------------------------------------------------
+    // Incremental conversion: Begin(), any number of Write() and End().
+    // Output goes to 'sink' by blocks; without sink it is accumulated and
+    // can be taken by TakeOutput() after each call.
+    static Ptr Create(const Dynamic & options, Var2XmlSink * sink,
+        std::string * error)
+    {
+      Var2XmlOptions::Ptr op = Var2XmlOptions::Create(options, error);
+      if (!op)
+        return Ptr();
+
+      Ptr res(new Var2XmlConverter(op, sink));
+      if (sink)
+        res->out_.reserve(op->buffer_size_ + op->buffer_size_ / 4);
+      return res;
+    }
+
+    //--------------------------------------------------------------------------
+    // Writes xml declaration and opens root element. Empty 'root_name' means
+    // 'rootname' option; if it is empty too, items are written without root.
+    bool Begin(const std::string & root_name, std::string * error)
+    {
+      if (failed_)
+        return Failed(error);
+      if (started_ || ended_)
+      {
+        *error = "Begin() must be called once before any Write()";
+        return false;
+      }
+
+      started_ = true;
+      failed_ = true;
+
+      // options may be shared by several converters
+      if (!root_name.empty())
+        root_name_ = root_name;
+
+      if (!root_name_.empty())
+      {
+        OpenTag(root_name_, &out_);
+        CloseTag(&out_);
+        root_opened_ = true;
+      }
+
+      return Check(Flush(&out_, false, error));
+    }
+
+    //--------------------------------------------------------------------------
+    // Writes 'item' as element named by 'itemname' option
+    bool Write(const DataType & item, std::string * error)
+    {
+      if (!CheckWritable(error))
+        return false;
+      failed_ = true;
+
+      Var2XmlValueKind kind = T::Kind(item);
+      BeginElement(options_->item_name_, item, kind, &out_);
+      if (!Convert("", item, kind, *this, &out_, error))
+        return false;
+      EndElement(&out_);
+      return Check(Flush(&out_, false, error));
+    }
+
+    //--------------------------------------------------------------------------
+    // Writes 'item' as dictionary value with key 'name' (i.e. list is written
+    // as sequence of 'name' elements)
+    bool Write(const std::string & name, const DataType & item,
+        std::string * error)
+    {
+      if (!CheckWritable(error))
+        return false;
+      failed_ = true;
+      return Check(ConvertValue(name, item, &out_, error));
+    }
+
+    //--------------------------------------------------------------------------
+    // Closes root element and passes rest of output to sink
+    bool End(std::string * error)
+    {
+      if (failed_)
+        return Failed(error);
+      if (ended_)
+      {
+        *error = "End() has been already called";
+        return false;
+      }
+
+      if (!started_ && !Begin(S_EMPTY_, error))
+        return false;
+      ended_ = true;
+      failed_ = true;
+      if (root_opened_)
+        EndElement(&out_);
+      return Check(Flush(&out_, true, error));
+    }
+
+    //--------------------------------------------------------------------------
+    void TakeOutput(std::string * out)
+    {
+      out->clear();
+      out->swap(out_);
+    }
+
     //--------------------------------------------------------------------------
     static bool Process(const std::string & options, const DataType & data,
         std::string * out, std::string * error)
@@ -173,53 +336,227 @@ namespace nkit
       Var2XmlOptions::Ptr op = Var2XmlOptions::Create(options, error);
       if (!op)
         return false;
+      return Process(op, data, out, error);
+    }
 
-      Var2XmlConverter builder(op);
+    //--------------------------------------------------------------------------
+    // With options compiled once by Var2XmlOptions::Create()
+    static bool Process(const Var2XmlOptions::Ptr & options,
+        const DataType & data, std::string * out, std::string * error)
+    {
+      Var2XmlConverter builder(options, NULL);
+      return builder.Run(data, out, error);
+    }
 
-      if (T::IsDict(data))
-      {
-        if (!op->root_name_.empty())
-          builder.BeginElement(op->root_name_, data, out);
+    //--------------------------------------------------------------------------
+    static bool Process(const Dynamic & options, const DataType & data,
+        Var2XmlSink * sink, std::string * error)
+    {
+      Var2XmlOptions::Ptr op = Var2XmlOptions::Create(options, error);
+      if (!op)
+        return false;
 
-        if (!builder.Convert(op->item_name_, data, builder, out, error))
-          return false;
+      std::string out;
+      out.reserve(op->buffer_size_ + op->buffer_size_ / 4);
+      Var2XmlConverter builder(op, sink);
+      return builder.Run(data, &out, error) &&
+          builder.Flush(&out, true, error);
+    }
 
-        if (!op->root_name_.empty())
-          builder.EndElement(out);
+    //--------------------------------------------------------------------------
+    // Converts 'data' as Process() does, but items of lists with at least
+    // 'min_items' items (top level list, lists in top level dict and so on,
+    // except lists inside items which are already converted in parallel)
+    // are converted in up to 'parallel' option threads: every thread
+    // converts contiguous range of items by its own converter and results
+    // are joined in order. Reading of DataType values MUST be safe from
+    // several threads at once (e.g. snapshot of Python data).
+    static bool ProcessParallel(const Var2XmlOptions::Ptr & options,
+        const DataType & data, size_t min_items, std::string * out,
+        std::string * error)
+    {
+      Var2XmlConverter builder(options, NULL);
+      builder.parallel_min_items_ = min_items > 0 ? min_items : 1;
+      return builder.Run(data, out, error);
+    }
+
+  private:
+    //--------------------------------------------------------------------------
+    class ConvertRangeTask: public Runnable
+    {
+    public:
+      ConvertRangeTask(Var2XmlConverter * converter, const std::string & name,
+          const std::vector<DataType> & items, size_t from, size_t to)
+        : converter_(converter)
+        , name_(name)
+        , items_(items)
+        , from_(from)
+        , to_(to)
+        , ok_(false)
+      {}
+
+      // exceptions must not leave thread
+      void Run()
+      {
+        ok_ = true;
+        try
+        {
+          for (size_t i = from_; ok_ && i < to_; ++i)
+            ok_ = converter_->ConvertListItem(name_, items_[i],
+                &converter_->out_, &error_);
+        }
+        catch (const std::bad_alloc &)
+        {
+          ok_ = false;
+          error_ = "Out of memory";
+        }
+        catch (const std::exception & e)
+        {
+          ok_ = false;
+          error_ = e.what();
+        }
       }
-      else if (T::IsList(data))
+
+      bool ok() const { return ok_; }
+      const std::string & error() const { return error_; }
+
+    private:
+      Var2XmlConverter * converter_;
+      const std::string & name_;
+      const std::vector<DataType> & items_;
+      size_t from_;
+      size_t to_;
+      bool ok_;
+      std::string error_;
+    };
+
+    //--------------------------------------------------------------------------
+    // Worker converters and their tasks; they are created and destroyed in
+    // calling thread only, because reference counter of options is not
+    // atomic
+    struct ParallelWorkers
+    {
+      ~ParallelWorkers()
       {
-        if (!op->root_name_.empty())
-          builder.BeginElement(op->root_name_, data, out);
+        for (size_t i = 0; i < tasks_.size(); ++i)
+          delete tasks_[i];
+        for (size_t i = 0; i < converters_.size(); ++i)
+          delete converters_[i];
+      }
 
-        if (!builder.Convert(op->item_name_, data, builder, out, error))
-          return false;
+      std::vector<Var2XmlConverter *> converters_;
+      std::vector<ConvertRangeTask *> tasks_;
+      std::vector<Runnable *> runnables_;
+    };
 
-        if (!op->root_name_.empty())
-          builder.EndElement(out);
+    static const size_t MAX_TAG_CACHE_SIZE = 1024;
+    static const size_t MIN_ESTIMATED_LIST_SIZE = 16;
+    static const size_t MAX_ESTIMATED_RESERVE = 64 * 1024 * 1024;
+
+    //--------------------------------------------------------------------------
+    Var2XmlConverter(Var2XmlOptions::Ptr options, Var2XmlSink * sink)
+      : options_(options)
+      , sink_(sink)
+      , root_name_(options->root_name_)
+      , first_end_after_begin_(false)
+      , begin_(true)
+      , started_(false)
+      , root_opened_(false)
+      , ended_(false)
+      , failed_(false)
+      , reserved_(false)
+      , parallel_min_items_(0)
+    {}
+
+    //--------------------------------------------------------------------------
+    // Output of failed item is incomplete, so nothing can be written after
+    // it. Incremental calls set failed_ before conversion, so it stays set
+    // if exception (e.g. std::bad_alloc) interrupts them.
+    bool Check(bool ok)
+    {
+      failed_ = !ok;
+      return ok;
+    }
+
+    bool Failed(std::string * error)
+    {
+      *error = "Writer has failed on previous call";
+      return false;
+    }
+
+    //--------------------------------------------------------------------------
+    bool CheckWritable(std::string * error)
+    {
+      if (failed_)
+        return Failed(error);
+      if (ended_)
+      {
+        *error = "Write() after End()";
+        return false;
       }
-      else
+      if (!started_)
+        return Begin(S_EMPTY_, error);
+      return true;
+    }
+
+    //--------------------------------------------------------------------------
+    bool Run(const DataType & data, std::string * out, std::string * error)
+    {
+      const Var2XmlOptions::Ptr & op = options_;
+      Var2XmlValueKind kind = T::Kind(data);
+      if (kind != V2X_DICT && kind != V2X_LIST)
       {
         *error = "Variable MUST be object (dict) or list";
         return false;
       }
 
+      if (!op->root_name_.empty())
+        BeginElement(op->root_name_, data, kind, out);
+
+      if (!Convert(op->item_name_, data, kind, *this, out, error))
+        return false;
+
+      if (!op->root_name_.empty())
+        EndElement(out);
+
       return true;
     }
 
-  private:
     //--------------------------------------------------------------------------
-    Var2XmlConverter(Var2XmlOptions::Ptr options)
-      : options_(options)
-      , first_end_after_begin_(false)
-      , begin_(true)
-    {}
+    // Passes accumulated output to sink (if any) when buffer is full
+    bool Flush(std::string * out, bool force, std::string * error)
+    {
+      if (!sink_ || out->empty() ||
+          (!force && out->size() < options_->buffer_size_))
+        return true;
+      bool ok = sink_->Write(out->data(), out->size(), error);
+      out->clear();
+      return ok;
+    }
+
+    //--------------------------------------------------------------------------
+    // Writes dictionary value 'v' with key 'key'
+    bool ConvertValue(const std::string & key, const DataType & v,
+        std::string * out, std::string * error)
+    {
+      Var2XmlValueKind kind = T::Kind(v);
+      if (kind != V2X_LIST)
+        BeginElement(key, v, kind, out);
+      if (!Convert(key, v, kind, *this, out, error))
+        return false;
+      if (kind != V2X_LIST)
+        EndElement(out);
+      return Flush(out, false, error);
+    }
 
     //--------------------------------------------------------------------------
     bool Convert(const std::string & item_name, const DataType & data,
-        Var2XmlConverter & builder, std::string * out, std::string * error)
+        Var2XmlValueKind kind, Var2XmlConverter & builder, std::string * out,
+        std::string * error)
     {
-      if (T::IsDict(data))
+      switch (kind)
+      {
+      case V2X_DICT:
       {
         bool dict_is_empty = true;
 //        bool dict_has_attrkey = false;
@@ -227,7 +564,7 @@ namespace nkit
             pr_end = options_->priority_list_.end();
         for (; pr_it != pr_end; ++pr_it)
         {
-          std::string key(*pr_it);
+          const std::string & key = *pr_it;
           if (options_->attr_key_ == key)
           {
 //            dict_has_attrkey = true;
@@ -240,37 +577,27 @@ namespace nkit
           if (found)
           {
             dict_is_empty = false;
-            if (!T::IsList(v))
-              builder.BeginElement(key, v, out);
-            if (!Convert(key, v, builder, out, error))
+            if (!builder.ConvertValue(key, v, out, error))
               return false;
-            if (!T::IsList(v))
-              builder.EndElement(out);
           }
         }
 
-        StringSet::const_iterator prset_end = options_->priority_set_.end();
         DictConstIterator it = T::begin_d(data), end = T::end_d(data);
         for (; it != end; ++it)
         {
-          std::string key(T::First(it));
+          const std::string & key = T::First(it);
           if (options_->attr_key_ == key)
           {
 //            dict_has_attrkey = true;
             continue;
           }
           else if ( options_->text_key_ == key ||
-              (options_->priority_set_.find(key) != prset_end) )
+              options_->priority_index_.Find(key) )
             continue;
 
           dict_is_empty = false;
-          DataType v = T::Second(it);
-          if (!T::IsList(v))
-            builder.BeginElement(key, v, out);
-          if (!Convert(key, v, builder, out, error))
+          if (!builder.ConvertValue(key, T::Second(it), out, error))
             return false;
-          if (!T::IsList(v))
-            builder.EndElement(out);
         }
 
         // textkey option ('_')
@@ -280,75 +607,186 @@ namespace nkit
         {
           bool newline = // dict_has_attrkey ||
               !dict_is_empty;
-          builder.PutText(text, newline, out);
+          builder.PutText(text, T::Kind(text), newline, out);
           first_end_after_begin_ = !newline;
         }
+        break;
       }
-      else if (T::IsList(data))
+      case V2X_LIST:
       {
-        bool use_item_name = !item_name.empty();
+        const std::string & name =
+            item_name.empty() ? options_->item_name_ : item_name;
+        if (parallel_min_items_ && options_->parallel_ > 1 &&
+            T::ListSize(data) >= parallel_min_items_)
+          return ConvertListParallel(name, data, out, error);
+
+        bool estimate = !reserved_ && !sink_;
+        size_t first_item_begin = out->size();
         ListConstIterator it = T::begin_l(data), end = T::end_l(data);
-        for (size_t counter = 0; it != end; ++it, ++counter)
+        for (; it != end; ++it)
         {
-          builder.BeginElement(
-                  use_item_name ? item_name :
-                          options_->item_name_, // + string_cast(counter),
-                  T::Value(it), out);
-          if (!Convert("", T::Value(it), builder, out, error))
+          const DataType & v = T::Value(it);
+          Var2XmlValueKind v_kind = T::Kind(v);
+          builder.BeginElement(name, v, v_kind, out);
+          if (!Convert(S_EMPTY_, v, v_kind, builder, out, error))
             return false;
           builder.EndElement(out);
+          if (estimate)
+          {
+            estimate = false;
+            Reserve(out->size() - first_item_begin, T::ListSize(data), out);
+          }
+          if (!Flush(out, false, error))
+            return false;
         }
+        break;
       }
-      else
-      {
-        builder.PutText(data, false, out);
+      default:
+        builder.PutText(data, kind, false, out);
+        break;
       }
 
       return true;
     }
 
     //--------------------------------------------------------------------------
-    void BeginElement(const std::string & name, const DataType & data,
-        std::string * out)
+    bool ConvertListItem(const std::string & name, const DataType & v,
+        std::string * out, std::string * error)
     {
-      if (begin_)
+      Var2XmlValueKind kind = T::Kind(v);
+      BeginElement(name, v, kind, out);
+      if (!Convert(S_EMPTY_, v, kind, *this, out, error))
+        return false;
+      EndElement(out);
+      return true;
+    }
+
+    //--------------------------------------------------------------------------
+    // Workers continue output of this converter from current nesting level
+    bool ConvertListParallel(const std::string & name, const DataType & data,
+        std::string * out, std::string * error)
+    {
+      std::vector<DataType> items;
+      items.reserve(T::ListSize(data));
+      ListConstIterator it = T::begin_l(data), end = T::end_l(data);
+      for (; it != end; ++it)
+        items.push_back(T::Value(it));
+
+      size_t count = items.size();
+      if (count == 0)
+        return true;
+      size_t threads = options_->parallel_;
+      if (threads > count)
+        threads = count;
+
+      ParallelWorkers workers;
+      for (size_t i = 0; i < threads; ++i)
       {
-        begin_ = false;
-        if (!options_->xml_dec_.empty() && !options_->root_name_.empty())
+        Var2XmlConverter * worker = new Var2XmlConverter(options_, NULL);
+        workers.converters_.push_back(worker);
+        worker->root_name_ = root_name_;
+        worker->path_ = path_;
+        worker->indents_ = indents_;
+        worker->reserved_ = true;
+        // state after previous item for the rest of workers
+        worker->begin_ = i == 0 && begin_;
+        worker->first_end_after_begin_ = i == 0 && first_end_after_begin_;
+
+        size_t from = count * i / threads, to = count * (i + 1) / threads;
+        workers.tasks_.push_back(
+            new ConvertRangeTask(worker, name, items, from, to));
+        workers.runnables_.push_back(workers.tasks_.back());
+      }
+
+      RunInParallel(workers.runnables_);
+
+      for (size_t i = 0; i < threads; ++i)
+      {
+        if (!workers.tasks_[i]->ok())
         {
-          out->append(options_->xml_dec_);
-          out->append(options_->pretty_.newline_);
+          *error = workers.tasks_[i]->error();
+          return false;
         }
+        out->append(workers.converters_[i]->out_);
       }
-      else
-        out->append(options_->pretty_.newline_);
 
-      path_.push(name);
-      out->append(current_indent_);
-      out->append("<");
-      AppendTranscoded(name, out);
+      begin_ = false;
+      first_end_after_begin_ = false;
+      return true;
+    }
+
+    //--------------------------------------------------------------------------
+    // Reserves output once, for the first big enough list, by size of its
+    // first item. Estimation is capped, because first item may be much
+    // bigger than others. Later growth (if estimation was low) is usual
+    // doubling
+    void Reserve(size_t item_size, size_t count, std::string * out)
+    {
+      if (count < MIN_ESTIMATED_LIST_SIZE)
+        return;
+      reserved_ = true;
+      size_t rest = MAX_ESTIMATED_RESERVE;
+      if (item_size < MAX_ESTIMATED_RESERVE / (count - 1))
+        rest = item_size * (count - 1);
+      size_t need = out->size() + rest + rest / 8;
+      if (need > out->capacity())
+        out->reserve(need);
+    }
+
+    //--------------------------------------------------------------------------
+    void BeginElement(const std::string & name, const DataType & data,
+        Var2XmlValueKind kind, std::string * out)
+    {
+      OpenTag(name, out);
 
       // attrkey option ('$')
-      if (T::IsDict(data))
+      if (kind == V2X_DICT)
       {
         bool found = false;
         DataType attrs = T::GetByKey(data, options_->attr_key_, &found);
-        if (found && T::IsDict(attrs))
+        if (found && T::Kind(attrs) == V2X_DICT)
         {
           DictConstIterator pair = T::begin_d(attrs), end = T::end_d(attrs);
           for (; pair != end; ++pair)
           {
             (*out) += ' ';
-            AppendTranscoded(T::First(pair), out);
+            AppendTag(T::First(pair), out);
             out->append("=\"");
-            PutText(T::Second(pair), out);
+            DataType v = T::Second(pair);
+            PutText(v, T::Kind(v), out);
             (*out) += '\"';
           }
         }
       }
 
+      CloseTag(out);
+    }
+
+    //--------------------------------------------------------------------------
+    void OpenTag(const std::string & name, std::string * out)
+    {
+      if (begin_)
+      {
+        begin_ = false;
+        if (!options_->xml_dec_.empty() && !root_name_.empty())
+        {
+          out->append(options_->xml_dec_);
+          out->append(options_->pretty_.newline_);
+        }
+      }
+      else
+        out->append(options_->pretty_.newline_);
+
+      AppendIndent(path_.size(), out);
+      path_.push(name);
+      out->append("<");
+      AppendTag(name, out);
+    }
+
+    //--------------------------------------------------------------------------
+    void CloseTag(std::string * out)
+    {
       out->append(">");
-      current_indent_ += options_->pretty_.indent_;
       first_end_after_begin_ = true;
     }
 
@@ -357,20 +795,59 @@ namespace nkit
     {
       assert(!path_.empty());
 
-      current_indent_.resize(
-          current_indent_.size() - options_->pretty_.indent_.size());
       if (!first_end_after_begin_)
       {
         out->append(options_->pretty_.newline_);
-        out->append(current_indent_);
+        AppendIndent(path_.size() - 1, out);
       }
       first_end_after_begin_ = false;
       out->append("</");
-      AppendTranscoded(path_.top(), out);
+      AppendTag(path_.top(), out);
       out->append(">");
       path_.pop();
     }
 
+    //--------------------------------------------------------------------------
+    // Indentation strings are built once per nesting level
+    void AppendIndent(size_t depth, std::string * out)
+    {
+      if (options_->pretty_.indent_.empty())
+        return;
+      while (indents_.size() <= depth)
+        indents_.push_back(indents_.empty() ? S_EMPTY_ :
+            indents_.back() + options_->pretty_.indent_);
+      out->append(indents_[depth]);
+    }
+
+    //--------------------------------------------------------------------------
+    // Element and attribute names repeat from item to item, so their
+    // transcoded form is cached for the time of conversion
+    void AppendTag(const std::string & name, std::string * out)
+    {
+      if (!options_->transcoder_)
+      {
+        out->append(name);
+        return;
+      }
+
+      StringMap::const_iterator it = tag_cache_.find(name);
+      if (it != tag_cache_.end())
+      {
+        out->append(it->second);
+        return;
+      }
+
+      if (tag_cache_.size() >= MAX_TAG_CACHE_SIZE)
+      {
+        AppendTranscoded(name, out);
+        return;
+      }
+
+      std::string & tag = tag_cache_[name];
+      options_->transcoder_->FromUtf8(name, &tag);
+      out->append(tag);
+    }
+
     //--------------------------------------------------------------------------
     void AppendTranscoded(const std::string & text, std::string * out)
     {
@@ -390,39 +867,55 @@ namespace nkit
     }
 
     //--------------------------------------------------------------------------
-    void PutText(const DataType & data, bool newline, std::string * out)
+    void PutText(const DataType & data, Var2XmlValueKind kind, bool newline,
+        std::string * out)
     {
       // TODO: optimize by member string
-      if (T::IsDateTime(data))
-        PutText(T::GetStringAsDateTime(data, options_->date_time_format_),
+      switch (kind)
+      {
+      case V2X_DATETIME:
+        PutText(T::GetStringAsDateTime(data, options_->compiled_date_time_format_),
                 newline, out);
-      else if (T::IsFloat(data))
+        break;
+      case V2X_FLOAT:
         PutText(T::GetStringAsFloat(data, options_->float_precision_),
                 newline, out);
-      else if (T::IsBool(data))
+        break;
+      case V2X_BOOL:
         PutText(T::GetStringAsBool(data,
                   options_->bool_true_,
                   options_->bool_false_),
                 newline, out);
-      else
+        break;
+      default:
         PutText(T::GetString(data), newline, out);
+        break;
+      }
     }
 
     //--------------------------------------------------------------------------
-    void PutText(const DataType & data, std::string * out)
+    void PutText(const DataType & data, Var2XmlValueKind kind,
+        std::string * out)
     {
       // TODO: optimize by member string
-      if (T::IsDateTime(data))
-        PutText(T::GetStringAsDateTime(data, options_->date_time_format_), out);
-      else if (T::IsFloat(data))
+      switch (kind)
+      {
+      case V2X_DATETIME:
+        PutText(T::GetStringAsDateTime(data, options_->compiled_date_time_format_), out);
+        break;
+      case V2X_FLOAT:
         PutText(T::GetStringAsFloat(data, options_->float_precision_), out);
-      else if (T::IsBool(data))
+        break;
+      case V2X_BOOL:
         PutText(T::GetStringAsBool(data,
                   options_->bool_true_,
                   options_->bool_false_),
                 out);
-      else
+        break;
+      default:
         PutText(T::GetString(data), out);
+        break;
+      }
     }
 
     //--------------------------------------------------------------------------
@@ -434,17 +927,17 @@ namespace nkit
       if (newline)
       {
         out->append(options_->pretty_.newline_);
-        out->append(current_indent_);
+        AppendIndent(path_.size(), out);
       }
 
-      if (options_->cdata_.empty())
+      if (options_->cdata_index_.empty())
       {
         PutText(text, out);
       }
       else
       {
         bool found = !path_.empty() &&
-                options_->cdata_.find(path_.top()) != options_->cdata_.end();
+                options_->cdata_index_.Find(path_.top()) != NULL;
         if (( found && !options_->cdata_exclude_) ||
             (!found &&  options_->cdata_exclude_))
           PutCdata(text, out);
@@ -456,20 +949,19 @@ namespace nkit
     //--------------------------------------------------------------------------
     void PutText(const std::string & text, std::string * out)
     {
-      if (options_->transcoder_)
-      {
-        options_->transcoder_->FromUtf8(text, SpetialCharCallback, out);
-      }
-      else
+      // clean runs between special characters are appended (or transcoded)
+      // at once; special characters are ASCII, so they never split
+      // UTF-8 sequence
+      const detail::CharScanner & special = options_->special_chars_;
+      const char * begin = text.data(), * end = begin + text.size();
+      while (begin < end)
       {
-        size_t count = text.size();
-        for (size_t i=0; i < count; ++i)
-        {
-          char ch = text[i];
-          if (SpetialCharCallback(ch, out))
-            continue;
-          (*out) += ch;
-        }
+        const char * found = special.Find(begin, end);
+        AppendTranscoded(begin, found - begin, out);
+        if (found == end)
+          break;
+        SpetialCharCallback(*found, out);
+        begin = found + 1;
       }
     }
 
@@ -575,10 +1067,21 @@ namespace nkit
 
   private:
     Var2XmlOptions::Ptr options_;
+    Var2XmlSink * sink_;
+    std::string root_name_;
     std::stack<std::string> path_;
-    std::string current_indent_;
+    std::vector<std::string> indents_;
     bool first_end_after_begin_;
     bool begin_;
+    bool started_;
+    bool root_opened_;
+    bool ended_;
+    bool failed_;
+    bool reserved_;
+    // 0 - lists are converted in this thread only
+    size_t parallel_min_items_;
+    std::string out_;
+    StringMap tag_cache_;
   };  // Var2XmlConverter
 
 }  // namespace nkit
@@ -53,6 +53,11 @@ namespace nkit
           .Get(".attrkey", &ret->attrkey_, S_EMPTY_)
           .Get(".textkey", &ret->textkey_, S_EMPTY_)
           .Get(".ordered_dict", &ret->ordered_dict_, ORDERED_DICT)
+          .Get(".ns_separator", &ret->expat_.ns_separator_, S_EMPTY_)
+          .Get(".dtd", &ret->expat_.dtd_, true)
+          .Get(".entities", &ret->expat_.entities_, true)
+          .Get(".hash_salt", &ret->expat_.hash_salt_, uint64_t(0))
+          .Get(".fast_lane", &ret->expat_.fast_lane_, false)
         ;
 
         if (!config.ok())
@@ -61,6 +66,12 @@ namespace nkit
           return Ptr();
         }
 
+        if (ret->expat_.ns_separator_.size() > 1)
+        {
+          *error = "Option 'ns_separator' must be single character";
+          return Ptr();
+        }
+
         return ret;
       }
 
@@ -77,6 +88,7 @@ namespace nkit
       bool ordered_dict_;
       std::string attrkey_;
       std::string textkey_;
+      ExpatOptions expat_;
     };
   } // namespace detail
 
@@ -1038,6 +1050,7 @@ namespace nkit
   {
   private:
     friend class ExpatParser<StructXml2VarBuilder<T> > ;
+    template <typename U> friend class Json2VarBuilder;
     typedef typename TargetItem<T>::Ptr TargetItemPtr;
     typedef typename Target<T>::Ptr TargetPtr;
     typedef typename PathNode<T>::Ptr PathNodePtr;
@@ -1066,16 +1079,16 @@ namespace nkit
       Dynamic m = DynamicFromJson(mappings, error);
       if (!m)
         return Ptr();
+      return Create(o, m, error);
+    }
 
-      Ptr ret(new StructXml2VarBuilder<T>(o));
-
-      DDICT_FOREACH(pair, m)
-      {
-        if (!ret->AddMapping(pair->first, pair->second, error))
-          return Ptr();
-      }
-
-      return ret;
+    static Ptr Create(const Dynamic & options, const Dynamic & mappings,
+        std::string * error)
+    {
+      detail::Options::Ptr o = detail::Options::Create(options, error);
+      if (!o)
+        return Ptr();
+      return Create(o, mappings, error);
     }
 
     static Ptr Create(const Dynamic & options, std::string * error)
@@ -1086,6 +1099,22 @@ namespace nkit
       return Ptr(new StructXml2VarBuilder<T>(o));
     }
 
+  private:
+    static Ptr Create(const detail::Options::Ptr & o, const Dynamic & mappings,
+        std::string * error)
+    {
+      Ptr ret(new StructXml2VarBuilder<T>(o));
+
+      DDICT_FOREACH(pair, mappings)
+      {
+        if (!ret->AddMapping(pair->first, pair->second, error))
+          return Ptr();
+      }
+
+      return ret;
+    }
+
+  public:
     bool AddMapping(const std::string & target_name,
         const std::string & mapping, std::string * error)
     {
@@ -1135,7 +1164,8 @@ namespace nkit
 
   private:
     StructXml2VarBuilder(detail::Options::Ptr o)
-      : path_tree_(PathNode<T>::CreateRoot())
+      : ExpatParser<StructXml2VarBuilder<T> >(o->expat_)
+      , path_tree_(PathNode<T>::CreateRoot())
       , current_node_(path_tree_.get())
       , options_(o)
       , root_targets_()
@@ -1579,7 +1609,8 @@ namespace nkit
 
   private:
     AnyXml2VarBuilder(detail::Options::Ptr o)
-      : options_(o)
+      : ExpatParser<AnyXml2VarBuilder<T> >(o->expat_)
+      , options_(o)
       , first_(true)
     {
       Clear();
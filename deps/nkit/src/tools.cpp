@@ -17,6 +17,7 @@
 #include <string.h>
 #include <errno.h>
 #include <stdio.h>
+#include <math.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -208,24 +209,37 @@ namespace nkit
     return std::string(tmp);
   }
 
+  //----------------------------------------------------------------------------
+  // Writes decimal digits of 'v' backwards, so that they end at 'end'.
+  // Returns pointer to first digit
+  static char * format_uint64(uint64_t v, char * end)
+  {
+    do
+    {
+      *--end = static_cast<char>('0' + v % 10);
+      v /= 10;
+    } while (v);
+    return end;
+  }
+
   //----------------------------------------------------------------------------
   std::string string_cast(int64_t i)
   {
     char tmp[BUF_LEN];
-    const int rc = NKIT_SNPRINTF(tmp, BUF_LEN, NKIT_FORMAT_I64, i);
-    if (unlikely(rc > BUF_LEN || rc < 0))
-      return S_NAN_;
-    return std::string(tmp);
+    char * end = tmp + BUF_LEN;
+    char * begin = format_uint64(
+        i < 0 ? 0 - static_cast<uint64_t>(i) : static_cast<uint64_t>(i), end);
+    if (i < 0)
+      *--begin = '-';
+    return std::string(begin, end);
   }
 
   //----------------------------------------------------------------------------
     std::string string_cast(uint64_t i)
     {
         char tmp[BUF_LEN];
-        const int rc = NKIT_SNPRINTF(tmp, BUF_LEN, NKIT_FORMAT_U64, i);
-        if (unlikely(rc > BUF_LEN || rc < 0))
-            return S_NAN_;
-        return std::string(tmp);
+        char * end = tmp + BUF_LEN;
+        return std::string(format_uint64(i, end), end);
     }
 #if defined(__APPLE__)
     std::string string_cast(size_t i)
@@ -252,10 +266,50 @@ namespace nkit
   static const size_t formats_of_double_count =
       sizeof(formats_of_double) / sizeof(formats_of_double[0]);
 
+  static const double powers_of_ten[] =
+  { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13,
+      1e14, 1e15 };
+
+  // Below 2^40 error of v * 10^precision is less then 2^-13
+  static const double FAST_FIXED_LIMIT = 1099511627776.0;
+
   std::string string_cast(double v, size_t precision)
   {
     if (precision >= formats_of_double_count)
       return S_NAN_;
+
+    // Digits are produced by integer arithmetic when rounding of
+    // v * 10^precision is unambiguous. Values close to halfway between
+    // two results (and NaN, inf, big values) are left to printf, which
+    // rounds exact decimal representation.
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    bool negative = (bits >> 63) != 0;
+    double scaled = (negative ? -v : v) * powers_of_ten[precision];
+    if (scaled < FAST_FIXED_LIMIT)
+    {
+      double whole = floor(scaled);
+      double frac = scaled - whole;
+      if (frac < 0.499 || frac > 0.501)
+      {
+        uint64_t digits = static_cast<uint64_t>(whole) + (frac > 0.5 ? 1 : 0);
+        char tmp[BUF_LEN];
+        char * end = tmp + BUF_LEN;
+        char * begin = end;
+        for (size_t i = 0; i < precision; ++i)
+        {
+          *--begin = static_cast<char>('0' + digits % 10);
+          digits /= 10;
+        }
+        if (precision)
+          *--begin = '.';
+        begin = format_uint64(digits, begin);
+        if (negative)
+          *--begin = '-';
+        return std::string(begin, end);
+      }
+    }
+
     char tmp[BUF_LEN];
     if (unlikely(NKIT_SNPRINTF(tmp, BUF_LEN, formats_of_double[precision], v) >=
         BUF_LEN))
@@ -11,6 +11,7 @@ namespace nkit
   }
 
   const size_t Var2XmlOptions::DEFAULT_FLOAT_PRECISION = 2;
+  const size_t Var2XmlOptions::DEFAULT_BUFFER_SIZE = 64 * 1024;
   const std::string Var2XmlOptions::ITEM_NAME_DEFAULT = "item";
   const std::string Var2XmlOptions::BOOL_TRUE = "1";
   const std::string Var2XmlOptions::BOOL_FALSE = "0";
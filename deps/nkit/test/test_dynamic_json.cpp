@@ -103,6 +103,58 @@ namespace nkit_test
     std::remove(file_path.c_str());
   }
 
+  NKIT_TEST_CASE(DynamicJsonParserChunks)
+  {
+    Dynamic etalon = DDICT(
+         "list" << DLIST(1 << 2.5 << "str" << true << Dynamic())
+      << "dict" << DDICT("a" << "\xD1\x8D\xD0\xBB" << "b" << DLIST(-1)));
+    std::string json = DynamicToJson(etalon);
+
+    for (size_t chunk_size = 1; chunk_size <= json.size(); chunk_size *= 3)
+    {
+      std::string error;
+      DynamicJsonParser parser;
+      for (size_t pos = 0; pos < json.size(); pos += chunk_size)
+      {
+        NKIT_TEST_ASSERT_WITH_TEXT(parser.Feed(json.data() + pos,
+            std::min(chunk_size, json.size() - pos), &error), error);
+      }
+      Dynamic result = parser.Finish(&error);
+      NKIT_TEST_ASSERT_WITH_TEXT(result, error);
+      NKIT_TEST_EQ(result, etalon);
+    }
+
+    std::string error;
+    DynamicJsonParser incomplete;
+    NKIT_TEST_ASSERT(incomplete.Feed("[1, 2", 5, &error));
+    NKIT_TEST_ASSERT(!incomplete.Finish(&error));
+    NKIT_TEST_ASSERT(!error.empty());
+
+    error.clear();
+    DynamicJsonParser wrong;
+    NKIT_TEST_ASSERT(!wrong.Feed("[1, }", 5, &error));
+    NKIT_TEST_ASSERT(!error.empty());
+  }
+
+  NKIT_TEST_CASE(DynamicJsonBigFile)
+  {
+    // bigger than read buffer of DynamicFromJsonFile
+    Dynamic list = Dynamic::List();
+    for (int64_t i = 0; i < 20000; ++i)
+      list.PushBack(DDICT("id" << i << "name" << "name of item"));
+
+    std::string error, file_path("./DynamicJsonBigFile.tmp");
+    NKIT_TEST_ASSERT_WITH_TEXT(DynamicToJsonFile(list, file_path, &error),
+        error);
+    Dynamic result = DynamicFromJsonFile(file_path, &error);
+    std::remove(file_path.c_str());
+    NKIT_TEST_ASSERT_WITH_TEXT(result, error);
+    NKIT_TEST_EQ(result, list);
+
+    NKIT_TEST_ASSERT(!DynamicFromJsonFile("./no/such/file.json", &error));
+    NKIT_TEST_ASSERT(error.find("Could not open file") != std::string::npos);
+  }
+
   NKIT_TEST_CASE(DynamicJsonBigInts)
   {
     uint64_t ui64_max_minus_1 = std::numeric_limits<uint64_t>::max() - 1;
@@ -173,6 +225,83 @@ namespace nkit_test
     NKIT_TEST_ASSERT(DynamicFromJson(out, &error) == v);
   }
 
+  NKIT_TEST_CASE(DynamicJsonNumbers)
+  {
+    const char * doubles[] = {
+        "0.5", "-0.25", "1e5", "1E-5", "2.5e+3", "123456.789", "0.1", "1e22",
+        "1e23", "-1.7976931348623157e308", "4.9e-324", "9007199254740993.0",
+        "0.30000000000000004", "12345678901234567890.5", "1e-400",
+        "0.0000000000000000000000000001", "-0.0"
+    };
+    const size_t count = sizeof(doubles) / sizeof(doubles[0]);
+
+    std::string json("[");
+    for (size_t i = 0; i < count; ++i)
+      json += (i ? "," : "") + std::string(doubles[i]);
+    json += ",0,-0,7,-7,9223372036854775808,-9223372036854775809"
+        ",99999999999999999999]";
+
+    std::string error;
+    Dynamic v(DynamicFromJson(json, &error));
+    NKIT_TEST_ASSERT_WITH_TEXT(v.IsList(), error);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+      NKIT_TEST_ASSERT_WITH_TEXT(v[i].IsFloat(), doubles[i]);
+      NKIT_TEST_ASSERT_WITH_TEXT(
+          v[i].GetFloat() == strtod(doubles[i], NULL), doubles[i]);
+    }
+
+    NKIT_TEST_ASSERT(v[count + 0].IsSignedInteger() &&
+        v[count + 0].GetSignedInteger() == 0);
+    NKIT_TEST_ASSERT(v[count + 1].IsSignedInteger() &&
+        v[count + 1].GetSignedInteger() == 0);
+    NKIT_TEST_ASSERT(v[count + 2].IsSignedInteger() &&
+        v[count + 2].GetSignedInteger() == 7);
+    NKIT_TEST_ASSERT(v[count + 3].IsSignedInteger() &&
+        v[count + 3].GetSignedInteger() == -7);
+    NKIT_TEST_ASSERT(v[count + 4].IsInteger() &&
+        v[count + 4].GetUnsignedInteger() == 9223372036854775808ULL);
+    NKIT_TEST_ASSERT(v[count + 5].IsFloat());
+    NKIT_TEST_ASSERT(v[count + 6].IsFloat());
+  }
+
+  NKIT_TEST_CASE(DynamicJsonRecords)
+  {
+    Dynamic records = Dynamic::List();
+    for (int64_t i = 0; i < 100; ++i)
+    {
+      Dynamic tags = Dynamic::List();
+      for (int64_t t = 0; t < i % 7; ++t)
+        tags.PushBack(Dynamic(t % 2 ? "odd" : "even"));
+      records.PushBack(DDICT(
+           "status" << (i % 3 ? "active" : "disabled")
+        << "id" << i
+        << "tags" << tags
+        << "zz_long_key_which_is_not_short_at_all" << std::string(40, 'x')));
+    }
+
+    std::string error;
+    Dynamic result = DynamicFromJson(DynamicToJson(records), &error);
+    NKIT_TEST_ASSERT_WITH_TEXT(result, error);
+    NKIT_TEST_EQ(result, records);
+
+    // equal parsed strings are independent values
+    const size_t first = 0, second = 1, third = 2, fourth = 3;
+    result[first]["status"] += Dynamic("_x");
+    result[second]["tags"][first].Clear();
+    NKIT_TEST_EQ(result[first]["status"].GetConstString(), "disabled_x");
+    NKIT_TEST_EQ(result[fourth]["status"].GetConstString(), "disabled");
+    NKIT_TEST_EQ(result[second]["tags"][first].GetConstString(), "");
+    NKIT_TEST_EQ(result[third]["tags"][first].GetConstString(), "even");
+
+    // keys in reverse order
+    result = DynamicFromJson("{\"c\": 3, \"b\": 2, \"a\": 1, \"b\": 4}",
+        &error);
+    NKIT_TEST_ASSERT_WITH_TEXT(result, error);
+    NKIT_TEST_EQ(result, DDICT("a" << 1 << "b" << 4 << "c" << 3));
+  }
+
   bool compare_by_pdate(const Dynamic & match1, const Dynamic & match2)
   {
     NKIT_TEST_ASSERT(match1.IsDict());
@@ -253,6 +382,65 @@ namespace nkit_test
     NKIT_TEST_ASSERT_WITH_TEXT(res == dict, error);
   }
 
+  class ChunksSink : public JsonSink
+  {
+  public:
+    bool Write(const char * data, size_t size, std::string * NKIT_UNUSED(error))
+    {
+      chunks_.push_back(std::string(data, size));
+      return true;
+    }
+
+    StringVector chunks_;
+  };
+
+  NKIT_TEST_CASE(DynamicJsonEscapingAndSink)
+  {
+    std::string control("long enough string with all controls:");
+    for (char c = 1; c < 0x20; ++c)
+      control += c;
+    control += " \\ \" / \xD1\x8D end";
+
+    Dynamic dict = DDICT(
+         "key \"quoted\"\n" << control
+      << "i64_min" << std::numeric_limits<int64_t>::min()
+      << "i64_max" << std::numeric_limits<int64_t>::max()
+      << "ui64" << Dynamic::UInt64(std::numeric_limits<uint64_t>::max())
+      << "small" << DLIST(0 << 7 << -7 << 99 << 100 << -1000000)
+      << "float" << 2.5);
+
+    std::string json = DynamicToJson(dict);
+    NKIT_TEST_ASSERT(json.find("\\u001F") != std::string::npos);
+    NKIT_TEST_ASSERT(json.find("\"i64_min\":-9223372036854775808")
+        != std::string::npos);
+    NKIT_TEST_ASSERT(json.find("\"float\":2.500000") != std::string::npos);
+
+    std::string error;
+    Dynamic result = DynamicFromJson(json, &error);
+    NKIT_TEST_ASSERT_WITH_TEXT(result, error);
+    NKIT_TEST_EQ(result["key \"quoted\"\n"], Dynamic(control));
+    NKIT_TEST_EQ(result["small"], dict["small"]);
+    NKIT_TEST_EQ(result["i64_min"], dict["i64_min"]);
+    NKIT_TEST_EQ(result["i64_max"], dict["i64_max"]);
+    NKIT_TEST_ASSERT(result["ui64"].GetUnsignedInteger() ==
+        std::numeric_limits<uint64_t>::max());
+
+    // sink gets output by blocks
+    Dynamic list = Dynamic::List();
+    for (size_t i = 0; i < 100; ++i)
+      list.PushBack(dict);
+    ChunksSink sink;
+    NKIT_TEST_ASSERT_WITH_TEXT(
+        DynamicToJsonSink(list, &sink, &error, DEFAULT_DYNAMIC_TO_JSON_OPTIONS_,
+            1024), error);
+    NKIT_TEST_ASSERT(sink.chunks_.size() > 1);
+    NKIT_TEST_ASSERT(sink.chunks_[0].size() <= 1024);
+    std::string whole;
+    for (size_t i = 0; i < sink.chunks_.size(); ++i)
+      whole += sink.chunks_[i];
+    NKIT_TEST_ASSERT(whole == DynamicToJson(list));
+  }
+
   NKIT_TEST_CASE(DynamicJsonWrongCases)
   {
     std::string json = "1,B,1,4,8F,61,84C,140,44,84DC,F0,C8,5440,F0,"
@@ -0,0 +1,100 @@
+#include "nkit/logger_brief.h"
+#include "nkit/test.h"
+#include "nkit/dynamic/dynamic_builder.h"
+#include "nkit/json2var.h"
+
+namespace nkit_test
+{
+  using namespace nkit;
+
+  //----------------------------------------------------------------------------
+  NKIT_TEST_CASE(json2var)
+  {
+    const std::string json(
+        "{\"persons\": ["
+        "  {\"name\": \"Jack\", \"age\": 33, \"phones\": [\"+1\", \"+2\"],"
+        "   \"married\": true, \"skip\": {\"a\": [[1, 2], {\"b\": null}]}},"
+        "  {\"name\": \"Boris\", \"age\": 34, \"phones\": [],"
+        "   \"married\": false, \"address\": {\"city\": \"Moscow\"}}"
+        "], \"total\": 2.5, \"empty\": null}");
+
+    Dynamic mappings = DDICT(
+         "persons" << DLIST("/persons" << DDICT(
+              "/name" << "string"
+           << "/age" << "integer"
+           << "/married" << "boolean"
+           << "/address/city -> city" << "string|none"))
+      << "phones" << DLIST("/persons/phones" << "string")
+      << "total" << DDICT("/total" << "number" << "/empty" << "string|x"));
+
+    Dynamic etalon = DDICT(
+         "persons" << DLIST(
+              DDICT("name" << "Jack" << "age" << 33 << "married" << true
+                  << "city" << "none")
+           << DDICT("name" << "Boris" << "age" << 34 << "married" << false
+                  << "city" << "Moscow"))
+      << "phones" << DLIST("+1" << "+2")
+      << "total" << DDICT("total" << 2.5 << "empty" << "x"));
+
+    // whole document and small chunks
+    for (size_t chunk_size = json.size(); chunk_size; chunk_size /= 64)
+    {
+      std::string error;
+      Json2VarBuilder<DynamicBuilder>::Ptr builder =
+          Json2VarBuilder<DynamicBuilder>::Create(Dynamic(), &error);
+      NKIT_TEST_ASSERT_WITH_TEXT(builder, error);
+      DDICT_FOREACH(pair, mappings)
+      {
+        NKIT_TEST_ASSERT_WITH_TEXT(
+            builder->AddMapping(pair->first, pair->second, &error), error);
+      }
+
+      for (size_t pos = 0; pos < json.size(); pos += chunk_size)
+      {
+        size_t len = std::min(chunk_size, json.size() - pos);
+        NKIT_TEST_ASSERT_WITH_TEXT(builder->Feed(json.data() + pos, len,
+            pos + len == json.size(), &error), error);
+      }
+
+      DDICT_FOREACH(pair, etalon)
+      {
+        NKIT_TEST_EQ(builder->var(pair->first), pair->second);
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  NKIT_TEST_CASE(json2var_top_level_list)
+  {
+    std::string error;
+    Json2VarBuilder<DynamicBuilder>::Ptr builder =
+        Json2VarBuilder<DynamicBuilder>::Create("{}",
+            "{\"ids\": [\"/item/id\", \"integer\"],"
+            " \"inner\": [\"/item/item\", \"string\"]}", &error);
+    NKIT_TEST_ASSERT_WITH_TEXT(builder, error);
+
+    std::string json("[{\"id\": 1}, [\"a\", \"b\"], {\"id\": 2}]");
+    NKIT_TEST_ASSERT_WITH_TEXT(
+        builder->Feed(json.data(), json.size(), true, &error), error);
+    NKIT_TEST_EQ(builder->var("ids"), DLIST(1 << 2));
+    NKIT_TEST_EQ(builder->var("inner"), DLIST("a" << "b"));
+  }
+
+  //----------------------------------------------------------------------------
+  NKIT_TEST_CASE(json2var_wrong_json)
+  {
+    std::string error;
+    Json2VarBuilder<DynamicBuilder>::Ptr builder =
+        Json2VarBuilder<DynamicBuilder>::Create("{}",
+            "{\"ids\": [\"/item/id\", \"integer\"]}", &error);
+    NKIT_TEST_ASSERT_WITH_TEXT(builder, error);
+
+    std::string json("[{\"id\": 1}, {\"id\" 2}]");
+    NKIT_TEST_ASSERT(!builder->Feed(json.data(), json.size(), true, &error));
+    NKIT_TEST_ASSERT(!error.empty());
+
+    NKIT_TEST_ASSERT(!Json2VarBuilder<DynamicBuilder>::Create("{}",
+        "{\"ids\": [\"/item/id\", \"no_such_type\"]}", &error));
+  }
+
+}  // namespace nkit_test
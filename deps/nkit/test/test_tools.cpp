@@ -234,4 +234,36 @@ namespace nkit_test
     NKIT_TEST_ASSERT(trim(str, " \n") != etalon);
   }
 
+  NKIT_TEST_CASE(tools_string_cast_numbers)
+  {
+    NKIT_TEST_EQ(string_cast(int64_t(0)), "0");
+    NKIT_TEST_EQ(string_cast(int64_t(-42)), "-42");
+    NKIT_TEST_EQ(string_cast(std::numeric_limits<int64_t>::min()),
+        "-9223372036854775808");
+    NKIT_TEST_EQ(string_cast(std::numeric_limits<uint64_t>::max()),
+        "18446744073709551615");
+
+    NKIT_TEST_EQ(string_cast(0.125, 2), "0.12");
+    NKIT_TEST_EQ(string_cast(1.005, 2), "1.00");
+    NKIT_TEST_EQ(string_cast(-0.001, 2), "-0.00");
+    NKIT_TEST_EQ(string_cast(-0.0, 1), "-0.0");
+    NKIT_TEST_EQ(string_cast(2.5, 0), "2");
+
+    // fast path must match printf
+    char buf[512];
+    uint64_t seed = 12345;
+    for (size_t i = 0; i < 100000; ++i)
+    {
+      seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+      double v = static_cast<double>(static_cast<int64_t>(seed >> 20)) /
+          static_cast<double>(1 << (seed & 31));
+      size_t precision = static_cast<size_t>(seed >> 8) % 16;
+      char format[8];
+      snprintf(format, sizeof(format), "%%.%uf",
+          static_cast<unsigned>(precision));
+      snprintf(buf, sizeof(buf), format, v);
+      NKIT_TEST_EQ(string_cast(v, precision), std::string(buf));
+    }
+  }
+
 } // namespace nkit_test
@@ -2,6 +2,7 @@
 #include "nkit/test.h"
 #include "nkit/dynamic/dynamic_builder.h"
 #include "nkit/dynamic_xml.h"
+#include "nkit/transcode.h"
 
 namespace nkit_test
 {
@@ -86,4 +87,252 @@ namespace nkit_test
     NKIT_TEST_EQ(out, etalon);
   }
 
+  //----------------------------------------------------------------------------
+  class TestSink: public Var2XmlSink
+  {
+  public:
+    TestSink() : writes_(0), fail_after_(0) {}
+
+    bool Write(const char * data, size_t size, std::string * error)
+    {
+      ++writes_;
+      if (fail_after_ && writes_ > fail_after_)
+      {
+        *error = "Sink error";
+        return false;
+      }
+      out_.append(data, size);
+      return true;
+    }
+
+    std::string out_;
+    size_t writes_;
+    size_t fail_after_;
+  };
+
+  NKIT_TEST_CASE(var2xml_sink)
+  {
+    Dynamic data = Dynamic::List();
+    for (size_t i = 0; i < 1000; ++i)
+      data.PushBack(DDICT("id" << i << "name" << "name & < >"));
+
+    Dynamic options = DDICT(
+         "rootname" << "ROOT"
+      << "xmldec" << DDICT("version" << "1.0")
+      << "pretty" << DDICT("indent" << "  " << "newline" << "\n")
+      << "buffer_size" << 1000
+    );
+
+    std::string etalon, error;
+    NKIT_TEST_ASSERT_WITH_TEXT(Dynamic2XmlConverter::Process(
+        options, data, &etalon, &error), error);
+
+    TestSink sink;
+    NKIT_TEST_ASSERT_WITH_TEXT(Dynamic2XmlConverter::Process(
+        options, data, &sink, &error), error);
+    NKIT_TEST_EQ(sink.out_, etalon);
+    NKIT_TEST_ASSERT(sink.writes_ > etalon.size() / 2000);
+
+    TestSink failing_sink;
+    failing_sink.fail_after_ = 2;
+    NKIT_TEST_ASSERT(!Dynamic2XmlConverter::Process(
+        options, data, &failing_sink, &error));
+    NKIT_TEST_EQ(error, "Sink error");
+    NKIT_TEST_EQ(failing_sink.writes_, 3);
+  }
+
+  NKIT_TEST_CASE(var2xml_incremental)
+  {
+    Dynamic data = Dynamic::List();
+    for (size_t i = 0; i < 300; ++i)
+      data.PushBack(DDICT("id" << i << "name" << "name & < >"
+          << "$" << DDICT("n" << i)));
+
+    Dynamic options = DDICT(
+         "rootname" << "ROOT"
+      << "itemname" << "record"
+      << "xmldec" << DDICT("version" << "1.0")
+      << "pretty" << DDICT("indent" << "  " << "newline" << "\n")
+      << "cdata" << DLIST("name")
+      << "buffer_size" << 1000
+    );
+
+    std::string etalon, error;
+    NKIT_TEST_ASSERT_WITH_TEXT(Dynamic2XmlConverter::Process(
+        options, data, &etalon, &error), error);
+
+    // to sink
+    TestSink sink;
+    Dynamic2XmlConverter::Ptr writer =
+        Dynamic2XmlConverter::Create(options, &sink, &error);
+    NKIT_TEST_ASSERT_WITH_TEXT(writer, error);
+    NKIT_TEST_ASSERT_WITH_TEXT(writer->Begin("", &error), error);
+    Dynamic::ListConstIterator it = data.begin_l(), end = data.end_l();
+    for (; it != end; ++it)
+      NKIT_TEST_ASSERT_WITH_TEXT(writer->Write(*it, &error), error);
+    NKIT_TEST_ASSERT_WITH_TEXT(writer->End(&error), error);
+    NKIT_TEST_EQ(sink.out_, etalon);
+    NKIT_TEST_ASSERT(sink.writes_ > 1);
+    NKIT_TEST_ASSERT(!writer->Write(data[size_t(0)], &error));
+
+    // fragments, named items
+    writer = Dynamic2XmlConverter::Create(DDICT("itemname" << "i"),
+        NULL, &error);
+    NKIT_TEST_ASSERT_WITH_TEXT(writer, error);
+    std::string fragment, result;
+    NKIT_TEST_ASSERT_WITH_TEXT(writer->Begin("R", &error), error);
+    writer->TakeOutput(&fragment);
+    NKIT_TEST_EQ(fragment, "<R>");
+    result += fragment;
+    NKIT_TEST_ASSERT_WITH_TEXT(writer->Write("x", DLIST(1 << 2), &error),
+        error);
+    NKIT_TEST_ASSERT_WITH_TEXT(writer->Write(DDICT("a" << "b"), &error),
+        error);
+    writer->TakeOutput(&fragment);
+    NKIT_TEST_EQ(fragment, "<x>1</x><x>2</x><i><a>b</a></i>");
+    result += fragment;
+    NKIT_TEST_ASSERT_WITH_TEXT(writer->End(&error), error);
+    writer->TakeOutput(&fragment);
+    result += fragment;
+    NKIT_TEST_EQ(result, "<R><x>1</x><x>2</x><i><a>b</a></i></R>");
+  }
+
+  NKIT_TEST_CASE(var2xml_escape)
+  {
+    Dynamic data = DDICT(
+         "a" << "plain text longer than sixteen bytes without specials"
+      << "b" << "<tag attr=\"v\" other='w'> & more text after them &&"
+      << "c" << "0123456789abcde<"
+      << "d" << "\"" << "e" << "");
+
+    std::string out, error;
+    NKIT_TEST_ASSERT_WITH_TEXT(Dynamic2XmlConverter::Process(
+        DDICT("rootname" << "R"), data, &out, &error), error);
+    NKIT_TEST_EQ(out, "<R>"
+        "<a>plain text longer than sixteen bytes without specials</a>"
+        "<b>&lt;tag attr=&quot;v&quot; other=&apos;w&apos;&gt; &amp; more text"
+        " after them &amp;&amp;</b>"
+        "<c>0123456789abcde&lt;</c>"
+        "<d>&quot;</d>"
+        "<e></e>"
+        "</R>");
+  }
+
+  NKIT_TEST_CASE(var2xml_transcode)
+  {
+    // "Привет, мир" repeated to get runs longer than 16 bytes
+    const std::string text("\xd0\x9f\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82,"
+        " \xd0\xbc\xd0\xb8\xd1\x80 & plain ascii text <");
+    const std::string cp1251("\xcf\xf0\xe8\xe2\xe5\xf2, \xec\xe8\xf0"
+        " &amp; plain ascii text &lt;");
+    const std::string koi8r("\xf0\xd2\xc9\xd7\xc5\xd4, \xcd\xc9\xd2"
+        " &amp; plain ascii text &lt;");
+
+    Dynamic data = DDICT("a" << text << "c" << text);
+    std::string out, error;
+    NKIT_TEST_ASSERT_WITH_TEXT(Dynamic2XmlConverter::Process(
+        DDICT("rootname" << "R" << "encoding" << "windows-1251"),
+        data, &out, &error), error);
+    NKIT_TEST_EQ(out, "<R><a>" + cp1251 + "</a><c>" + cp1251 + "</c></R>");
+
+    out.clear();
+    NKIT_TEST_ASSERT_WITH_TEXT(Dynamic2XmlConverter::Process(
+        DDICT("rootname" << "R" << "encoding" << "koi8-r"
+            << "cdata" << DLIST("c")),
+        data, &out, &error), error);
+    NKIT_TEST_EQ(out, "<R><a>" + koi8r + "</a><c><![CDATA["
+        "\xf0\xd2\xc9\xd7\xc5\xd4, \xcd\xc9\xd2 & plain ascii text <"
+        "]]></c></R>");
+
+    const Transcoder * transcoder = Transcoder::Find("windows-1251");
+    NKIT_TEST_ASSERT(transcoder != NULL);
+    std::string converted;
+    NKIT_TEST_ASSERT(transcoder->FromUtf8(text, &converted));
+    std::string back;
+    NKIT_TEST_ASSERT(transcoder->ToUtf8(converted, &back));
+    NKIT_TEST_EQ(back, text);
+
+    // euro sign is absent in koi8-r
+    converted.clear();
+    NKIT_TEST_ASSERT(!Transcoder::Find("koi8-r")->FromUtf8(
+        "abc\xe2\x82\xac", &converted));
+    // truncated UTF-8 sequence
+    NKIT_TEST_ASSERT(!transcoder->FromUtf8("abc\xd0", &converted));
+  }
+
+  NKIT_TEST_CASE(transcoder_find)
+  {
+    const Transcoder * cp1251 = Transcoder::Find("windows-1251");
+    NKIT_TEST_ASSERT(cp1251 != NULL);
+    NKIT_TEST_ASSERT(Transcoder::Find("Windows-1251") == cp1251);
+    NKIT_TEST_ASSERT(Transcoder::Find("CP1251") == cp1251);
+    NKIT_TEST_ASSERT(Transcoder::Find("koi8-r") != NULL);
+    NKIT_TEST_ASSERT(Transcoder::Find("koi8-r") != cp1251);
+    NKIT_TEST_ASSERT(Transcoder::Find("windows-125") == NULL);
+    NKIT_TEST_ASSERT(Transcoder::Find("") == NULL);
+    NKIT_TEST_ASSERT(Transcoder::Find(std::string(100, 'a')) == NULL);
+  }
+
+  NKIT_TEST_CASE(string_hash_map)
+  {
+    detail::StringHashMap<size_t> map;
+    NKIT_TEST_ASSERT(map.empty());
+    NKIT_TEST_ASSERT(map.Find("a") == NULL);
+
+    for (size_t i = 0; i < 100; ++i)
+      map.Insert("key" + string_cast(i), i);
+    map.Insert("key7", 1007);
+    NKIT_TEST_EQ(map.size(), 100);
+
+    for (size_t i = 0; i < 100; ++i)
+    {
+      const size_t * value = map.Find("key" + string_cast(i));
+      NKIT_TEST_ASSERT(value != NULL);
+      NKIT_TEST_EQ(*value, i == 7 ? 1007 : i);
+    }
+    NKIT_TEST_ASSERT(map.Find("key100") == NULL);
+    NKIT_TEST_ASSERT(map.Find("") == NULL);
+  }
+
+  NKIT_TEST_CASE(var2xml_pretty)
+  {
+    Dynamic options = DDICT(
+         "rootname" << "R"
+      << "pretty" << DDICT("indent" << "  " << "newline" << "\n"));
+
+    Dynamic data = DDICT(
+         "a" << DDICT("b" << DDICT("c" << 1) << "_" << "t")
+      << "l" << DLIST(1 << DLIST(2)));
+
+    std::string out, error;
+    NKIT_TEST_ASSERT_WITH_TEXT(Dynamic2XmlConverter::Process(
+        options, data, &out, &error), error);
+    NKIT_TEST_EQ(out,
+        "<R>\n"
+        "  <a>\n"
+        "    <b>\n"
+        "      <c>1</c>\n"
+        "    </b>\n"
+        "    t\n"
+        "  </a>\n"
+        "  <l>1</l>\n"
+        "  <l>\n"
+        "    <item>2</item>\n"
+        "  </l>\n"
+        "</R>");
+
+    // string output is reserved by size of the first item of big list,
+    // sink output is not
+    data = Dynamic::List();
+    for (size_t i = 0; i < 1000; ++i)
+      data.PushBack(DDICT("id" << i << "sub" << DLIST(i << i)));
+    out.clear();
+    NKIT_TEST_ASSERT_WITH_TEXT(Dynamic2XmlConverter::Process(
+        options, data, &out, &error), error);
+    TestSink sink;
+    NKIT_TEST_ASSERT_WITH_TEXT(Dynamic2XmlConverter::Process(
+        options, data, &sink, &error), error);
+    NKIT_TEST_EQ(out, sink.out_);
+  }
+
 }  // namespace nkit_test
@@ -3,6 +3,11 @@
 #include "nkit/dynamic/dynamic_builder.h"
 #include "nkit/dynamic_xml.h"
 #include "nkit/transcode.h"
+#include "nkit/detail/str2id.h"
+#include "nkit/xml2var.h"
+#include "nkit/detail/fast_xml.h"
+
+#include <cstdio>
 
 namespace nkit_test
 {
@@ -57,6 +62,30 @@ namespace nkit_test
     NKIT_TEST_ASSERT(!var && !error.empty());
   }
 
+  //---------------------------------------------------------------------------
+  NKIT_TEST_CASE(str2id_reused_buffer)
+  {
+    String2IdMap str2id;
+    char buf[16];
+
+    strcpy(buf, "person");
+    size_t person_id = str2id.GetId(buf);
+    NKIT_TEST_EQ(person_id, str2id.GetId(buf));
+
+    strcpy(buf, "city");
+    size_t city_id = str2id.GetId(buf);
+    NKIT_TEST_ASSERT(city_id != person_id);
+    NKIT_TEST_EQ(city_id, str2id.GetId("city"));
+
+    strcpy(buf, "person");
+    NKIT_TEST_EQ(person_id, str2id.GetId(buf));
+    NKIT_TEST_ASSERT(str2id.GetId("*") == String2IdMap::STAR_ID);
+
+    String2IdMap copy(str2id);
+    NKIT_TEST_EQ(person_id, copy.GetId(buf));
+    NKIT_TEST_EQ(city_id, copy.GetId("city"));
+  }
+
   //---------------------------------------------------------------------------
   _NKIT_TEST_CASE(xml2var_star_pref_test)
   {
@@ -116,6 +145,480 @@ namespace nkit_test
     NKIT_TEST_EQ(var, etalon);
   }
 
+  //---------------------------------------------------------------------------
+  NKIT_TEST_CASE(xml2var_parse_buffer)
+  {
+    std::string error;
+    std::string xml_path("./data/sample.xml");
+    std::string xml;
+    NKIT_TEST_ASSERT_WITH_TEXT(
+        text_file_to_string(xml_path, &xml, &error), error);
+
+    std::string mapping("[\"/person\", [\"/phone\", \"string\"]]");
+    Dynamic etalon = DynamicFromXml(xml, mapping, &error);
+    NKIT_TEST_ASSERT_WITH_TEXT(etalon, error);
+
+    StructXml2VarBuilder<DynamicBuilder>::Ptr builder =
+        StructXml2VarBuilder<DynamicBuilder>::Create("{}", &error);
+    NKIT_TEST_ASSERT_WITH_TEXT(builder, error);
+    NKIT_TEST_ASSERT_WITH_TEXT(
+        builder->AddMapping(S_EMPTY_, mapping, &error), error);
+
+    const size_t chunk_size = 7;
+    for (size_t pos = 0; pos < xml.size(); pos += chunk_size)
+    {
+      size_t len = std::min(chunk_size, xml.size() - pos);
+      void * buf = builder->GetBuffer(chunk_size);
+      NKIT_TEST_ASSERT(buf);
+      memcpy(buf, xml.data() + pos, len);
+      NKIT_TEST_ASSERT_WITH_TEXT(builder->ParseBuffer(len,
+          pos + len == xml.size(), &error), error);
+    }
+    NKIT_TEST_EQ(builder->var(S_EMPTY_), etalon);
+
+    Dynamic var = DynamicFromXmlFile(xml_path, "{}", mapping, &error);
+    NKIT_TEST_ASSERT_WITH_TEXT(var, error);
+    NKIT_TEST_EQ(var, etalon);
+
+    var = DynamicFromXmlFile("./data/no_such_file.xml", "{}", mapping, &error);
+    NKIT_TEST_ASSERT(!var && !error.empty());
+  }
+
+  //---------------------------------------------------------------------------
+  NKIT_TEST_CASE(xml2var_legacy_encoding)
+  {
+    // "日本語のテキスト、漢字"
+    const std::string utf8_text("\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e"
+        "\xe3\x81\xae\xe3\x83\x86\xe3\x82\xad\xe3\x82\xb9\xe3\x83\x88"
+        "\xe3\x80\x81\xe6\xbc\xa2\xe5\xad\x97");
+    const std::string sjis_text("\x93\xfa\x96\x7b\x8c\xea\x82\xcc\x83\x65"
+        "\x83\x4c\x83\x58\x83\x67\x81\x41\x8a\xbf\x8e\x9a");
+    const std::string xml("<?xml version=\"1.0\" encoding=\"Shift_JIS\"?>"
+        "<a><b x=\"" + sjis_text + "\">" + sjis_text + "</b><b>" + sjis_text +
+        sjis_text + "</b></a>");
+    Dynamic options = DDICT("trim" << true);
+
+    std::string error, root_name;
+    Dynamic etalon = DynamicFromAnyXml("<a><b x=\"" + utf8_text + "\">" +
+        utf8_text + "</b><b>" + utf8_text + utf8_text + "</b></a>",
+        options, &root_name, &error);
+    NKIT_TEST_ASSERT_WITH_TEXT(etalon, error);
+
+    Dynamic var = DynamicFromAnyXml(xml, options, &root_name, &error);
+    NKIT_TEST_ASSERT_WITH_TEXT(var, error);
+    NKIT_TEST_EQ(var, etalon);
+
+    // characters are split between chunks
+    for (size_t chunk_size = 1; chunk_size < 5; ++chunk_size)
+    {
+      AnyXml2VarBuilder<DynamicBuilder>::Ptr builder =
+          AnyXml2VarBuilder<DynamicBuilder>::Create(options, &error);
+      NKIT_TEST_ASSERT_WITH_TEXT(builder, error);
+      for (size_t pos = 0; pos < xml.size(); pos += chunk_size)
+      {
+        size_t len = std::min(chunk_size, xml.size() - pos);
+        NKIT_TEST_ASSERT_WITH_TEXT(builder->Feed(xml.data() + pos, len,
+            pos + len == xml.size(), &error), error);
+      }
+      NKIT_TEST_EQ(builder->var(), etalon);
+
+      builder = AnyXml2VarBuilder<DynamicBuilder>::Create(options, &error);
+      NKIT_TEST_ASSERT_WITH_TEXT(builder, error);
+      for (size_t pos = 0; pos < xml.size(); pos += chunk_size)
+      {
+        size_t len = std::min(chunk_size, xml.size() - pos);
+        void * buf = builder->GetBuffer(chunk_size);
+        NKIT_TEST_ASSERT(buf);
+        memcpy(buf, xml.data() + pos, len);
+        NKIT_TEST_ASSERT_WITH_TEXT(builder->ParseBuffer(len,
+            pos + len == xml.size(), &error), error);
+      }
+      NKIT_TEST_EQ(builder->var(), etalon);
+    }
+
+    // truncated character
+    NKIT_TEST_ASSERT(!DynamicFromAnyXml(xml.substr(0, xml.find("</b>") - 1),
+        options, &root_name, &error));
+    NKIT_TEST_ASSERT(!error.empty());
+    // wrong byte sequence
+    NKIT_TEST_ASSERT(!DynamicFromAnyXml(
+        "<?xml version=\"1.0\" encoding=\"Shift_JIS\"?><a>\x93\xff</a>",
+        options, &root_name, &error));
+    NKIT_TEST_ASSERT(!error.empty());
+    // unknown encoding is still rejected
+    NKIT_TEST_ASSERT(!DynamicFromAnyXml(
+        "<?xml version=\"1.0\" encoding=\"no-such-encoding\"?><a/>",
+        options, &root_name, &error));
+  }
+
+  //---------------------------------------------------------------------------
+  NKIT_TEST_CASE(xml2var_parallel)
+  {
+    std::string xml(
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<!DOCTYPE persons [<!ELEMENT persons ANY>]>\n"
+        "<!-- <persons> -->\n"
+        "<persons type=\"a>b\">\n");
+    for (size_t i = 0; i < 1000; ++i)
+    {
+      std::string n(string_cast(static_cast<uint64_t>(i)));
+      xml += "  <person id='" + n + "'><name>N" + n + "</name>";
+      if (i % 3 == 0)
+        xml += "<!-- </person> --><phone><![CDATA[</x>]]></phone>";
+      if (i % 5 == 0)
+        xml += "<empty/>";
+      xml += "<phone>" + n + "</phone></person>\n";
+      if (i % 7 == 0)
+        xml += "  <other/>\n";
+    }
+    xml += "</persons>\n<!-- trailing -->\n";
+
+    Dynamic mapping = DLIST("/person" << DDICT(
+        "/@id -> id" << "integer" <<
+        "/name" << "string" <<
+        "/phone -> phones" << DLIST("/" << "string")));
+
+    std::string error;
+    Dynamic etalon = DynamicFromXml(xml, mapping, &error);
+    NKIT_TEST_ASSERT_WITH_TEXT(etalon, error);
+    NKIT_TEST_EQ(etalon.size(), 1000);
+
+    for (size_t threads = 1; threads < 9; ++threads)
+    {
+      Dynamic var = DynamicFromXmlParallel(xml, Dynamic(), mapping, threads,
+          &error);
+      NKIT_TEST_ASSERT_WITH_TEXT(var, error);
+      NKIT_TEST_EQ(var, etalon);
+    }
+
+    Dynamic var = DynamicFromXmlParallel(xml, Dynamic(),
+        DDICT("/person" << "string"), 4, &error);
+    NKIT_TEST_ASSERT(!var && !error.empty());
+
+    // file is read in chunks and split while reading
+    std::string path("./xml2var_parallel.xml");
+    NKIT_TEST_ASSERT_WITH_TEXT(string_to_text_file(path, xml, &error),
+        error);
+    for (size_t threads = 1; threads < 5; ++threads)
+    {
+      for (size_t shard_size = 1; shard_size < 100000; shard_size *= 7)
+      {
+        var = DynamicFromXmlFileParallel(path, Dynamic(), mapping, threads,
+            shard_size, &error);
+        NKIT_TEST_ASSERT_WITH_TEXT(var, error);
+        NKIT_TEST_EQ(var, etalon);
+      }
+    }
+
+    // '<root/>' can not be split
+    const char * small[] = { "<persons><person id='1'/></persons>",
+        "<persons/>", "<?xml version='1.0'?><persons><person id='1'/>" };
+    for (size_t i = 0; i < sizeof(small) / sizeof(small[0]); ++i)
+    {
+      NKIT_TEST_ASSERT_WITH_TEXT(string_to_text_file(path, small[i], &error),
+          error);
+      std::string file_error;
+      error.clear();
+      var = DynamicFromXmlFileParallel(path, Dynamic(), mapping, 4, 1,
+          &file_error);
+      etalon = DynamicFromXml(small[i], mapping, &error);
+      NKIT_TEST_ASSERT_WITH_TEXT(var == etalon, small[i]);
+      NKIT_TEST_ASSERT_WITH_TEXT(file_error.empty() == error.empty(),
+          small[i]);
+    }
+
+    xml.insert(xml.find("<name>N500</name>"), "<a></b>");
+    var = DynamicFromXmlParallel(xml, Dynamic(), mapping, 4, &error);
+    NKIT_TEST_ASSERT(!var && !error.empty());
+
+    NKIT_TEST_ASSERT_WITH_TEXT(string_to_text_file(path, xml, &error),
+        error);
+    var = DynamicFromXmlFileParallel(path, Dynamic(), mapping, 4, 1000,
+        &error);
+    NKIT_TEST_ASSERT(!var && !error.empty());
+    std::remove(path.c_str());
+  }
+
+  //---------------------------------------------------------------------------
+  NKIT_TEST_CASE(xml2var_expat_options)
+  {
+    std::string error, root_name;
+    std::string laughs(
+        "<?xml version=\"1.0\"?>"
+        "<!DOCTYPE lolz [<!ENTITY lol \"lol\">"
+        "<!ENTITY lol1 \"&lol;&lol;&lol;&lol;&lol;&lol;&lol;&lol;\">]>"
+        "<lolz>&lol1;</lolz>");
+
+    Dynamic var = DynamicFromAnyXml(laughs, DDICT("hash_salt" << 12345),
+        &root_name, &error);
+    NKIT_TEST_ASSERT_WITH_TEXT(var, error);
+
+    var = DynamicFromAnyXml(laughs, DDICT("entities" << false),
+        &root_name, &error);
+    NKIT_TEST_ASSERT(!var);
+    NKIT_TEST_EQ(error, "Entity declarations are not allowed");
+
+    var = DynamicFromAnyXml(laughs, DDICT("dtd" << false),
+        &root_name, &error);
+    NKIT_TEST_ASSERT(!var);
+    NKIT_TEST_EQ(error, "DTD is not allowed");
+
+    std::string ns_xml("<a:root xmlns:a=\"urn:a\"><a:item>1</a:item>"
+        "</a:root>");
+    var = DynamicFromAnyXml(ns_xml, DDICT("ns_separator" << "|"),
+        &root_name, &error);
+    NKIT_TEST_ASSERT_WITH_TEXT(var, error);
+    NKIT_TEST_EQ(root_name, "urn:a|root");
+    const Dynamic * item;
+    NKIT_TEST_ASSERT(var.Get("urn:a|item", &item));
+
+    var = DynamicFromAnyXml(ns_xml, DDICT("ns_separator" << "||"),
+        &root_name, &error);
+    NKIT_TEST_ASSERT(!var && !error.empty());
+  }
+
+  //---------------------------------------------------------------------------
+  struct FastLaneTestHandler
+  {
+    bool FastStartElement(const char * el, const char ** attrs)
+    {
+      out_ += "<" + std::string(el);
+      for (; *attrs; attrs += 2)
+        out_ += " " + std::string(attrs[0]) + "=" + std::string(attrs[1]);
+      out_ += ">";
+      return true;
+    }
+
+    bool FastEndElement(const char * el)
+    {
+      out_ += "</" + std::string(el) + ">";
+      return true;
+    }
+
+    bool FastText(const char * text, int len)
+    {
+      out_.append(text, len);
+      return true;
+    }
+
+    std::string out_;
+  };
+
+  NKIT_TEST_CASE(xml2var_fast_lane_tokenizer)
+  {
+    detail::FastXmlTokenizer tokenizer;
+    FastLaneTestHandler handler;
+    std::string xml("<?xml version='1.0' encoding='utf-8'?>\n"
+        "<a x=\"1&amp;&#x41;\tb\" y='&quot;'>t&lt;&#1055;!<b/>"
+        "<c >?</c ></a>\n");
+    NKIT_TEST_EQ(tokenizer.ParseDocument(&handler, xml.data(), xml.size()),
+        detail::FastXmlTokenizer::FAST_OK);
+    NKIT_TEST_EQ(handler.out_,
+        "<a x=1&A b y=\">t<\xD0\x9F!<b></b><c>?</c></a>");
+
+    // left to Expat: not supported or not validated by tokenizer
+    const char * unsupported[] = {
+        "<a><!-- c --></a>",
+        "<a><![CDATA[x]]></a>",
+        "<!DOCTYPE a><a/>",
+        "<a><?pi?></a>",
+        "<a>\r\n</a>",
+        "<?xml version='1.0' encoding='windows-1251'?><a/>",
+        "<a x=1/>",
+        "<a>\xFF</a>",
+        "<a>\xC3</a>",
+        "<a x='\xED\xA0\x80'/>",
+        "<a>\x01</a>",
+        "<a>]]></a>",
+        "<\xD0\x9F/>",
+        "<a><1b/></a>",
+        NULL
+    };
+    for (const char ** doc = unsupported; *doc; ++doc)
+      NKIT_TEST_EQ(tokenizer.ParseDocument(&handler, *doc, strlen(*doc)),
+          detail::FastXmlTokenizer::FAST_UNSUPPORTED);
+
+    const char * wrong[] = {
+        "<a></b>",
+        "<a>",
+        "<a/><b/>",
+        "<a>&unknown;</a>",
+        "<a x='1' x='2'/>",
+        "",
+        NULL
+    };
+    for (const char ** doc = wrong; *doc; ++doc)
+      NKIT_TEST_EQ(tokenizer.ParseDocument(&handler, *doc, strlen(*doc)),
+          detail::FastXmlTokenizer::FAST_ERROR);
+
+    // complete top level elements can be parsed as soon as they arrive
+    tokenizer.Reset();
+    handler.out_.clear();
+    std::string stream("<r><i a='1'>x</i><i>y\xD0");
+    size_t parsable;
+    NKIT_TEST_EQ(tokenizer.Scan(stream.data(), stream.size(), false,
+        &parsable), detail::FastXmlTokenizer::FAST_OK);
+    NKIT_TEST_EQ(parsable, stream.find("<i>y"));
+    NKIT_TEST_EQ(tokenizer.Parse(&handler, stream.data(), parsable, false),
+        detail::FastXmlTokenizer::FAST_OK);
+    NKIT_TEST_EQ(handler.out_, "<r><i a=1>x</i>");
+    NKIT_TEST_EQ(tokenizer.ExpatPrefix(), "<r>");
+    tokenizer.Consume(parsable);
+    stream.erase(0, parsable);
+
+    stream += "\x9F</i></r>";
+    NKIT_TEST_EQ(tokenizer.Scan(stream.data(), stream.size(), true,
+        &parsable), detail::FastXmlTokenizer::FAST_OK);
+    NKIT_TEST_EQ(parsable, stream.size());
+    NKIT_TEST_EQ(tokenizer.Parse(&handler, stream.data(), parsable, true),
+        detail::FastXmlTokenizer::FAST_OK);
+    NKIT_TEST_EQ(handler.out_, "<r><i a=1>x</i><i>y\xD0\x9F</i></r>");
+  }
+
+  static bool any_xml_by_chunks(const std::string & xml, size_t chunk_size,
+      const Dynamic & options, Dynamic * var, std::string * error)
+  {
+    AnyXml2VarBuilder<DynamicBuilder>::Ptr builder =
+        AnyXml2VarBuilder<DynamicBuilder>::Create(options, error);
+    if (!builder)
+      return false;
+    size_t pos = 0;
+    do
+    {
+      size_t len = std::min(chunk_size, xml.size() - pos);
+      if (!builder->Feed(xml.data() + pos, len, pos + len == xml.size(),
+          error))
+        return false;
+      pos += len;
+    } while (pos < xml.size());
+    *var = builder->var();
+    return true;
+  }
+
+  NKIT_TEST_CASE(xml2var_fast_lane)
+  {
+    std::string error;
+    std::string xml_path("./data/sample.xml");
+    std::string xml;
+    NKIT_TEST_ASSERT_WITH_TEXT(
+        text_file_to_string(xml_path, &xml, &error), error);
+
+    std::string mapping_path("./data/multi_mapping.json");
+    std::string mapping_str;
+    NKIT_TEST_ASSERT_WITH_TEXT(
+        text_file_to_string(mapping_path, &mapping_str, &error), error);
+    Dynamic mappings = DynamicFromJson(mapping_str, &error);
+    NKIT_TEST_ASSERT_WITH_TEXT(mappings, error);
+
+    Dynamic options = DDICT("trim" << true << "attrkey" << "$");
+    Dynamic fast_options = DDICT("trim" << true << "attrkey" << "$" <<
+        "fast_lane" << true);
+
+    DDICT_FOREACH(pair, mappings)
+    {
+      Dynamic etalon = DynamicFromXml(xml, options, pair->second, &error);
+      NKIT_TEST_ASSERT_WITH_TEXT(etalon, error);
+      Dynamic var = DynamicFromXml(xml, fast_options, pair->second, &error);
+      NKIT_TEST_ASSERT_WITH_TEXT(var, error);
+      NKIT_TEST_EQ(var, etalon);
+    }
+
+    std::string root_name;
+    Dynamic etalon = DynamicFromAnyXml(xml, options, &root_name, &error);
+    NKIT_TEST_ASSERT_WITH_TEXT(etalon, error);
+    Dynamic var = DynamicFromAnyXml(xml, fast_options, &root_name, &error);
+    NKIT_TEST_ASSERT_WITH_TEXT(var, error);
+    NKIT_TEST_EQ(var, etalon);
+
+    const size_t chunk_sizes[] = { 1, 7, 64, 4096 };
+    for (size_t i = 0; i < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); ++i)
+    {
+      NKIT_TEST_ASSERT_WITH_TEXT(any_xml_by_chunks(xml, chunk_sizes[i],
+          fast_options, &var, &error), error);
+      NKIT_TEST_EQ(var, etalon);
+    }
+
+    std::string expat_error;
+    xml.insert(xml.find("<name>Jack"), "<a></b>");
+    NKIT_TEST_ASSERT(!DynamicFromAnyXml(xml, options, &root_name,
+        &expat_error));
+    NKIT_TEST_ASSERT(!DynamicFromAnyXml(xml, fast_options, &root_name,
+        &error));
+    NKIT_TEST_EQ(error, expat_error);
+
+    // error is reported by the chunk which completes wrong element
+    NKIT_TEST_ASSERT(!DynamicFromAnyXml("<a><b/><c></b></a>", options,
+        &root_name, &expat_error));
+    AnyXml2VarBuilder<DynamicBuilder>::Ptr builder =
+        AnyXml2VarBuilder<DynamicBuilder>::Create(fast_options, &error);
+    NKIT_TEST_ASSERT_WITH_TEXT(builder, error);
+    NKIT_TEST_ASSERT_WITH_TEXT(builder->Feed("<a><b/>", 7, false, &error),
+        error);
+    void * buf = builder->GetBuffer(7);
+    NKIT_TEST_ASSERT(buf);
+    memcpy(buf, "<c></b>", 7);
+    NKIT_TEST_ASSERT(!builder->ParseBuffer(7, false, &error));
+    NKIT_TEST_EQ(error, expat_error);
+
+    // result does not depend on chunks and on which lane parses what
+    const char * docs[] = {
+        "<r><i>1</i><i>\xD0\x9F</i></r>",
+        "<?xml version='1.0'?>\n<r>\n <i a='&#x41;'>1</i>\n</r>\n",
+        "\xEF\xBB\xBF<r><i>1</i>\n <i>\xE2\x82\xAC</i><j></r>",
+        "<r><i>1</i><i>\xFF</i></r>",
+        "<r><i>1</i>\n<i>\xED\xA0\x80</i></r>",
+        "<r><i>1</i><\xD0\x9F>2</\xD0\x9F><i>3</i></r>",
+        "<r><i>1</i><i x='1' x='2'/></r>",
+        "<r><i>1</i>\n<!-- c --><i>2</i></r>",
+        "<r><i>1</i><i>]]></i></r>",
+        "<r><i>1</i><i>\x01</i></r>",
+        "<r><i>1</i></r><r/>",
+        "<r><i>1</i><i>2</i>",
+        "<r><i>1</i><i>2</b></r>",
+        "<r><i>1</i><1/></r>",
+        "<r><i>1</i><i>&bad;</i></r>",
+        "<i a\"\"b='2'/>",
+        "<r><i>1</i><i a\"\"b='2'/></r>",
+        "<r><i>1</i><i a='1'\"/></r>",
+        "<r><i>1</i><i a = \"1\" b\n=\n'2'/></r>",
+        "<?xml version='1.0' encoding='utf-8' standalone='no'?><r/>",
+        "<?xml ersion='1.0'?><r/>",
+        "<?xml version='1.0' foo='x'?><r/>",
+        "<?xml version='1.1'?><r/>",
+        "<?xml version='1.0' standalone='yes' encoding='UTF-8'?><r/>",
+        "\xEF\xBB\xBF<r><i>1</i><j></r>",
+        "<r><i>\xD0\x9F</i><j></r>",
+        NULL
+    };
+    for (const char ** doc = docs; *doc; ++doc)
+    {
+      expat_error.clear();
+      etalon = DynamicFromAnyXml(*doc, options, &root_name, &expat_error);
+      for (size_t chunk_size = 1; chunk_size < 4; ++chunk_size)
+      {
+        bool ok = any_xml_by_chunks(*doc, chunk_size, fast_options, &var,
+            &error);
+        NKIT_TEST_ASSERT_WITH_TEXT(ok == expat_error.empty(), *doc);
+        if (ok)
+        {
+          NKIT_TEST_EQ(var, etalon);
+        }
+        else
+        {
+          NKIT_TEST_EQ(error, expat_error);
+        }
+      }
+    }
+
+    // too long element is left to Expat with the rest of document
+    xml = "<r><i>1</i><i>" + std::string(1500000, 'x') + "</i><i>2</i></r>";
+    etalon = DynamicFromAnyXml(xml, options, &root_name, &error);
+    NKIT_TEST_ASSERT_WITH_TEXT(etalon, error);
+    NKIT_TEST_ASSERT_WITH_TEXT(any_xml_by_chunks(xml, 65536, fast_options,
+        &var, &error), error);
+    NKIT_TEST_EQ(var, etalon);
+  }
+
   //---------------------------------------------------------------------------
   NKIT_TEST_CASE(xml2var_list)
   {
@@ -45,6 +45,8 @@ if os_name.startswith('win'):
     cflags = ["/EHsc", "/MD"]
 elif os_name.find('linux') >= 0:
     libraries.append('rt')
+elif os_name == 'darwin':
+    libraries.append('iconv')
     
 cpp_module = extension.Extension(
     'nkit4py',
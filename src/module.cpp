@@ -14,14 +14,24 @@
    limitations under the License.
 */
 
+#define PY_SSIZE_T_CLEAN
 #include <py3c.h>
 #include "datetime.h"
 #include "nkit/types.h"
 #include "nkit/tools.h"
 #include "nkit/logger_brief.h"
 #include "nkit/xml2var.h"
+#include "nkit/json2var.h"
 #include "nkit/var2xml.h"
+#include "nkit/dynamic/dynamic_builder.h"
 #include <string>
+#include <errno.h>
+
+#if defined(NKIT_WINNT)
+#  include <io.h>
+#else
+#  include <unistd.h>
+#endif
 
 #if ((PY_MAJOR_VERSION == 2) && (PY_MINOR_VERSION <= 5))
 #define NKIT_PYTHON_OLDER_THEN_2_6
@@ -55,21 +65,60 @@ namespace nkit
   static PyObject * string_dict_;
   static PyObject * datetime_json_encoder_;
 
+  //----------------------------------------------------------------------------
+  bool py_to_string(PyObject * unicode, std::string * out,
+      std::string * error);
+
+  static bool py_str_to_string(PyObject * obj, std::string * out,
+      std::string * error)
+  {
+    PyObject * tmp = PyObject_Str(obj);
+    if (!tmp)
+    {
+      *error = "Could not represent variable to string";
+      return false;
+    }
+
+    bool ret = py_to_string(tmp, out, error);
+    Py_DECREF(tmp);
+    return ret;
+  }
+
   //----------------------------------------------------------------------------
   bool py_to_string(PyObject * unicode, std::string * out,
       std::string * error)
   {
     if (PyStr_Check(unicode))
     {
-      PyObject * tmp = PyStr_AsUTF8String(unicode);
-      const char * str = PyBytes_AS_STRING(tmp);
-      out->assign(str);
-      Py_DECREF(tmp);
+      // UTF-8 representation is cached inside of unicode object
+      Py_ssize_t size = 0;
+      const char * str = PyStr_AsUTF8AndSize(unicode, &size);
+      if (unlikely(!str))
+      {
+        PyErr_Clear();
+        *error = "Could not represent variable to string";
+        return false;
+      }
+      out->assign(str, size);
     }
     else if (PyBytes_Check(unicode))
     {
       out->assign(PyBytes_AsString(unicode));
     }
+#if PY_VERSION_HEX >= 0x02070000
+    else if (PyLong_Check(unicode) || PyInt_Check(unicode))
+    {
+      // digits straight from machine integer; big ones are left to str()
+      int overflow = 0;
+      PY_LONG_LONG v = PyLong_AsLongLongAndOverflow(unicode, &overflow);
+      if (unlikely(overflow || (v == -1 && PyErr_Occurred())))
+      {
+        PyErr_Clear();
+        return py_str_to_string(unicode, out, error);
+      }
+      out->assign(string_cast(static_cast<int64_t>(v)));
+    }
+#endif
     else if (PyFloat_Check(unicode))
     {
       out->assign(string_cast(PyFloat_AsDouble(unicode)));
@@ -81,16 +130,7 @@ namespace nkit
     }
     else
     {
-      PyObject * tmp = PyObject_Str(unicode);
-      if (!tmp)
-      {
-        *error = "Could not represent variable to string";
-        return false;
-      }
-
-      bool ret = py_to_string(tmp, out,error);
-      Py_DECREF(tmp);
-      return ret;
+      return py_str_to_string(unicode, out, error);
     }
 
     return true;
@@ -115,6 +155,25 @@ namespace nkit
     return ret;
   }
 
+  //----------------------------------------------------------------------------
+  // Datetime values are formatted from PyDateTime_GET_* without Python calls
+  // when compiled format allows it, otherwise by datetime.strftime()
+  std::string py_format_datetime(const PyObject * data,
+      const detail::DateTimeFormat & format)
+  {
+    PyObject * dt = const_cast<PyObject *>(data);
+    bool has_time = PyDateTime_Check(dt);
+    std::string ret;
+    if (format.Format(PyDateTime_GET_YEAR(dt), PyDateTime_GET_MONTH(dt),
+        PyDateTime_GET_DAY(dt),
+        has_time ? PyDateTime_DATE_GET_HOUR(dt) : 0,
+        has_time ? PyDateTime_DATE_GET_MINUTE(dt) : 0,
+        has_time ? PyDateTime_DATE_GET_SECOND(dt) : 0,
+        has_time ? PyDateTime_DATE_GET_MICROSECOND(dt) : 0, &ret))
+      return ret;
+    return py_strftime(data, format.format());
+  }
+
   //----------------------------------------------------------------------------
   bool pyobj_to_json(PyObject * obj, std::string * out, std::string * error)
   {
@@ -143,6 +202,159 @@ namespace nkit
     return ret;
   }
 
+  //----------------------------------------------------------------------------
+  // Walks Python data and builds Dynamic directly, without JSON text.
+  // Values are converted as json.dumps() with DatetimeJSONEncoder does it.
+  static const size_t MAX_PY_TO_DYNAMIC_DEPTH = 512;
+  static const detail::DateTimeFormat DATETIME_JSON_FORMAT(
+      "%Y-%m-%d %H:%M:%S");
+  static const detail::DateTimeFormat DATE_JSON_FORMAT("%Y-%m-%d");
+
+  static bool py_key_to_string(PyObject * key, std::string * out,
+      std::string * error)
+  {
+    if (key == Py_None)
+      out->assign("null");
+    else if (PyBool_Check(key))
+      out->assign(key == Py_True ? "true" : "false");
+    else if (PyFloat_Check(key))
+    {
+      // float.__repr__(), as json.dumps() makes it
+      double v = PyFloat_AsDouble(key);
+      if (Py_IS_NAN(v))
+        out->assign("NaN");
+      else if (Py_IS_INFINITY(v))
+        out->assign(v > 0 ? "Infinity" : "-Infinity");
+      else
+      {
+        char * repr = PyOS_double_to_string(v, 'r', 0, Py_DTSF_ADD_DOT_0,
+            NULL);
+        if (!repr)
+        {
+          PyErr_Clear();
+          *error = "Low memory";
+          return false;
+        }
+        out->assign(repr);
+        PyMem_Free(repr);
+      }
+    }
+    else
+      return py_to_string(key, out, error);
+    return true;
+  }
+
+  static bool py_to_dynamic(PyObject * obj, Dynamic * out, std::string * error,
+      size_t depth)
+  {
+    if (unlikely(depth > MAX_PY_TO_DYNAMIC_DEPTH))
+    {
+      *error = "Data is nested too deeply or has circular reference";
+      return false;
+    }
+
+    if (obj == Py_None)
+    {
+      *out = Dynamic();
+    }
+    else if (PyBool_Check(obj))
+    {
+      *out = Dynamic(obj == Py_True);
+    }
+    else if (PyStr_Check(obj) || PyBytes_Check(obj))
+    {
+      std::string str;
+      if (!py_to_string(obj, &str, error))
+        return false;
+      *out = Dynamic(str);
+    }
+    else if (PyLong_Check(obj) || PyInt_Check(obj))
+    {
+      int overflow = 0;
+      PY_LONG_LONG v = PyLong_AsLongLongAndOverflow(obj, &overflow);
+      if (likely(!overflow && !(v == -1 && PyErr_Occurred())))
+      {
+        *out = Dynamic(static_cast<int64_t>(v));
+        return true;
+      }
+      PyErr_Clear();
+
+      unsigned PY_LONG_LONG uv = PyLong_AsUnsignedLongLong(obj);
+      if (!(uv == static_cast<unsigned PY_LONG_LONG>(-1) && PyErr_Occurred()))
+      {
+        *out = Dynamic::UInt64(static_cast<uint64_t>(uv));
+        return true;
+      }
+      PyErr_Clear();
+
+      double d = PyLong_AsDouble(obj);
+      if (d == -1.0 && PyErr_Occurred())
+      {
+        PyErr_Clear();
+        *error = "Integer is too big";
+        return false;
+      }
+      *out = Dynamic(d);
+    }
+    else if (PyFloat_Check(obj))
+    {
+      *out = Dynamic(PyFloat_AS_DOUBLE(obj));
+    }
+    else if (PyDict_Check(obj))
+    {
+      *out = Dynamic::Dict();
+      PyObject * key, * value;
+      Py_ssize_t pos = 0;
+      std::string key_str;
+      while (PyDict_Next(obj, &pos, &key, &value))
+      {
+        if (!py_key_to_string(key, &key_str, error) ||
+            !py_to_dynamic(value, &(*out)[key_str], error, depth + 1))
+          return false;
+      }
+    }
+    else if (PyList_Check(obj) || PyTuple_Check(obj))
+    {
+      PyObject * seq = obj;
+      Py_ssize_t size = PySequence_Fast_GET_SIZE(seq);
+      *out = Dynamic::List();
+      out->Reserve(static_cast<size_t>(size));
+      for (Py_ssize_t i = 0; i < size; ++i)
+      {
+        Dynamic item;
+        if (!py_to_dynamic(PySequence_Fast_GET_ITEM(seq, i), &item, error,
+            depth + 1))
+          return false;
+        out->PushBack(item);
+      }
+    }
+    else if (PyDateTime_Check(obj))
+    {
+      *out = Dynamic(py_format_datetime(obj, DATETIME_JSON_FORMAT));
+    }
+    else if (PyDate_Check(obj))
+    {
+      *out = Dynamic(py_format_datetime(obj, DATE_JSON_FORMAT));
+    }
+    else if (PyTime_Check(obj))
+    {
+      *out = Dynamic(py_strftime(obj, "%H:%M:%S"));
+    }
+    else
+    {
+      *error = std::string("Object of type '") + Py_TYPE(obj)->tp_name +
+          "' can not be converted";
+      return false;
+    }
+
+    return true;
+  }
+
+  bool py_to_dynamic(PyObject * obj, Dynamic * out, std::string * error)
+  {
+    return py_to_dynamic(obj, out, error, 0);
+  }
+
   //----------------------------------------------------------------------------
   class PythonBuilderPolicy: Uncopyable
   {
@@ -328,6 +540,7 @@ namespace nkit
   typedef VarBuilder<PythonBuilderPolicy> PythonVarBuilder;
   typedef StructXml2VarBuilder<PythonVarBuilder> MapXml2PythonBuilder;
   typedef AnyXml2VarBuilder<PythonVarBuilder> AnyXml2PythonBuilder;
+  typedef Json2VarBuilder<PythonVarBuilder> Json2PythonBuilder;
 
   ////--------------------------------------------------------------------------
   struct PythonReaderPolicy
@@ -361,6 +574,8 @@ namespace nkit
 
         Py_XDECREF(key_);
         key_ = NULL;
+        Py_XDECREF(value_);
+        value_ = NULL;
 
         if (!iter_)
         {
@@ -379,11 +594,22 @@ namespace nkit
           return;
         }
 
+        // value is referenced because Python code running during its
+        // serialization may remove it from dict
         value_ = PyDict_GetItem(data_, key_);
+        Py_XINCREF(value_);
+
+        // key_str_ keeps its capacity, so there are no allocations for
+        // keys of usual length
+        std::string err;
+        if (unlikely(!nkit::py_to_string(key_, &key_str_, &err)))
+          key_str_.clear();
       }
 
       ~DictConstIterator()
       {
+        Py_XDECREF(value_);
+        value_ = NULL;
         Py_XDECREF(key_);
         key_ = NULL;
         Py_XDECREF(iter_);
@@ -401,15 +627,11 @@ namespace nkit
         return *this;
       }
 
-      std::string first() const
+      const std::string & first() const
       {
         if (!key_)
           return S_EMPTY_;
-
-        std::string ret, err;
-        if (unlikely(!nkit::py_to_string(key_, &ret, &err)))
-          return S_EMPTY_;
-        return ret;
+        return key_str_;
       }
 
       PyObject * second() const
@@ -424,6 +646,7 @@ namespace nkit
       Py_ssize_t pos_;
       PyObject * key_;
       PyObject * value_;
+      std::string key_str_;
     };
 
     //--------------------------------------------------------------------------
@@ -431,35 +654,49 @@ namespace nkit
     {
       ListConstIterator()
         : list_(NULL)
-        , size_(0)
+        , item_(NULL)
         , pos_(-1)
       {}
 
+      // Lists and tuples are read in place, other sequences (sets) through
+      // PySequence_Fast(). Python code (write callback, __str__, strftime)
+      // may run during traversal and resize the list, so list size is
+      // checked on every step and current item is referenced.
       ListConstIterator(PyObject * list)
-        : list_(PySequence_Fast(list, "Not a sequence"))
-        , size_(list_ != NULL ? PySequence_Size(list_) : 0)
-        , pos_(size_ > 0 ? 0: -1)
-      {}
+        : list_(PyList_Check(list) || PyTuple_Check(list) ?
+            list : PySequence_Fast(list, "Not a sequence"))
+        , item_(NULL)
+        , pos_(0)
+      {
+        if (list_ == list)
+          Py_INCREF(list_);
+        Fetch();
+      }
 
       ListConstIterator(const ListConstIterator & copy)
         : list_(copy.list_)
-        , size_(copy.size_)
+        , item_(copy.item_)
         , pos_(copy.pos_)
       {
         Py_XINCREF(list_);
+        Py_XINCREF(item_);
       }
 
       ListConstIterator & operator = (const ListConstIterator & copy)
       {
+        Py_XINCREF(copy.list_);
+        Py_XINCREF(copy.item_);
+        Py_XDECREF(list_);
+        Py_XDECREF(item_);
         list_ = copy.list_;
-        size_ = copy.size_;
+        item_ = copy.item_;
         pos_ = copy.pos_;
-        Py_XINCREF(list_);
         return *this;
       }
 
       ~ListConstIterator()
       {
+        Py_XDECREF(item_);
         Py_XDECREF(list_);
       }
 
@@ -470,20 +707,47 @@ namespace nkit
 
       ListConstIterator & operator++()
       {
-        if (++pos_ >= size_)
-          pos_ = -1;
+        if (pos_ >= 0)
+        {
+          ++pos_;
+          Fetch();
+        }
         return *this;
       }
 
       PyObject * value() const
       {
-        if (unlikely(pos_ >= size_ || pos_ < 0))
+        if (unlikely(!item_))
           return Py_None;
-        return PySequence_Fast_GET_ITEM(list_, pos_);
+        return item_;
+      }
+
+    private:
+      void Fetch()
+      {
+        Py_CLEAR(item_);
+        if (!list_)
+        {
+          pos_ = -1;
+          return;
+        }
+
+        if (PyList_Check(list_))
+        {
+          if (pos_ < PyList_GET_SIZE(list_))
+            item_ = PyList_GET_ITEM(list_, pos_);
+        }
+        else if (pos_ < PyTuple_GET_SIZE(list_))
+          item_ = PyTuple_GET_ITEM(list_, pos_);
+
+        if (item_)
+          Py_INCREF(item_);
+        else
+          pos_ = -1;
       }
 
       PyObject * list_;
-      Py_ssize_t size_;
+      PyObject * item_;
       Py_ssize_t pos_;
     };
 
@@ -508,7 +772,7 @@ namespace nkit
       return ListConstIterator();
     }
 
-    static std::string First(const DictConstIterator & it)
+    static const std::string & First(const DictConstIterator & it)
     {
       return it.first();
     }
@@ -523,6 +787,35 @@ namespace nkit
       return it.value();
     }
 
+    static Var2XmlValueKind Kind(const PyObject * data)
+    {
+      // exact types of usual values first, then subtypes
+      PyObject * obj = const_cast<PyObject *>(data);
+      PyTypeObject * type = Py_TYPE(obj);
+      if (type == &PyDict_Type)
+        return V2X_DICT;
+      else if (type == &PyList_Type || type == &PyTuple_Type)
+        return V2X_LIST;
+      else if (type == &PyStr_Type || type == &PyLong_Type ||
+          type == &PyBytes_Type)
+        return V2X_SCALAR;
+      else if (type == &PyFloat_Type)
+        return V2X_FLOAT;
+      else if (type == &PyBool_Type)
+        return V2X_BOOL;
+      else if (PyDateTime_CheckExact(obj))
+        return V2X_DATETIME;
+      else if (IsDict(data))
+        return V2X_DICT;
+      else if (IsList(data))
+        return V2X_LIST;
+      else if (IsDateTime(data))
+        return V2X_DATETIME;
+      else if (IsFloat(data))
+        return V2X_FLOAT;
+      return V2X_SCALAR;
+    }
+
     static bool IsList(const PyObject * data)
     {
       bool ret = PyList_Check(const_cast<PyObject *>(data)) ||
@@ -568,9 +861,9 @@ namespace nkit
     }
 
     static std::string GetStringAsDateTime(const PyObject * data,
-            const std::string & format)
+            const detail::DateTimeFormat & format)
     {
-      return py_strftime(data, format);
+      return py_format_datetime(data, format);
     }
 
     static std::string GetStringAsFloat(const PyObject * data,
@@ -586,6 +879,17 @@ namespace nkit
       return data == Py_True ? true_format: false_format;
     }
 
+    static size_t ListSize(const PyObject * data)
+    {
+      Py_ssize_t size = PyObject_Length(const_cast<PyObject *>(data));
+      if (size < 0)
+      {
+        PyErr_Clear();
+        return 0;
+      }
+      return static_cast<size_t>(size);
+    }
+
     static PyObject * GetByKey(const PyObject * data, const std::string & key,
             bool * found)
     {
@@ -601,259 +905,2100 @@ namespace nkit
 
   typedef Var2XmlConverter<PythonReaderPolicy> Python2XmlConverter;
 
-} // namespace nkit
+  ////--------------------------------------------------------------------------
+  /// Copy of Python data, made under GIL, for converting it to XML in
+  /// several threads without GIL. Dynamic is not used here, because it does
+  /// not keep order of dict keys and its reference counter is not atomic.
+  /// Strings are copied as UTF-8, ints and floats are kept as numbers,
+  /// datetimes are formatted right away.
+  class PySnapshot
+  {
+  public:
+    struct Node
+    {
+      Node()
+        : kind_(V2X_SCALAR)
+        , is_int_(false)
+        , bool_(false)
+        , int_(0)
+        , float_(0.0)
+        , first_child_(0)
+        , child_count_(0)
+        , key_index_(NO_KEY_INDEX)
+      {}
 
-////----------------------------------------------------------------------------
-/// exception
-static PyObject * Nkit4PyError;
+      Var2XmlValueKind kind_;
+      bool is_int_;
+      bool bool_;
+      int64_t int_;
+      double float_;
+      std::string key_;
+      std::string text_;
+      size_t first_child_;
+      size_t child_count_;
+      // for big dicts: index in PySnapshot::key_indexes_
+      size_t key_index_;
+    };
 
-////----------------------------------------------------------------------------
-bool parse_dict(PyObject * dict, std::string * out, std::string * error)
-{
-  if (PyDict_Check(dict))
-  {
-    return nkit::pyobj_to_json(dict, out, error);
-  }
-  else
-  {
-    return nkit::py_to_string(dict, out, error);
-  }
-}
+    static const size_t NO_KEY_INDEX = static_cast<size_t>(-1);
 
-////----------------------------------------------------------------------------
-template<typename T>
-struct SharedPtrHolder
-{
-  SharedPtrHolder(NKIT_SHARED_PTR(T) & ptr) : ptr_(ptr) {}
-  NKIT_SHARED_PTR(T) ptr_;
-};
+    explicit PySnapshot(const detail::DateTimeFormat & date_time_format)
+      : date_time_format_(date_time_format)
+    {}
 
-////----------------------------------------------------------------------------
-struct MapXml2PythonBuilderData
-{
-  PyObject_HEAD;
-  SharedPtrHolder<nkit::MapXml2PythonBuilder> * holder_;
-};
+    // Makes snapshot of 'obj' with all its children, returns index of its
+    // node
+    bool Add(PyObject * obj, size_t * index, std::string * error)
+    {
+      *index = Allocate(1);
+      return Fill(*index, obj, error);
+    }
 
-////----------------------------------------------------------------------------
-struct AnyXml2PythonBuilderData
-{
-  PyObject_HEAD;
-  SharedPtrHolder<nkit::AnyXml2PythonBuilder> * holder_;
-};
+    const Node & node(size_t index) const { return nodes_[index]; }
 
-////----------------------------------------------------------------------------
-static PyObject* CreateMapXml2VarBuilder(
-    PyTypeObject * type, PyObject * args, PyObject *)
-{
-  PyObject * dict1 = NULL;
-  PyObject * dict2 = NULL;
-  int result = PyArg_ParseTuple(args, "O|O", &dict1, &dict2);
-  if(!result)
-  {
-    PyErr_SetString(Nkit4PyError,
-        "Expected one or two arguments:"
-        " 1) mappings or 2) options and mappings");
-    return NULL;
-  }
+    // Returns index of child node of dict 'node' by key, or NO_KEY_INDEX
+    size_t FindChild(const Node & node, const std::string & key) const
+    {
+      if (node.key_index_ != NO_KEY_INDEX)
+      {
+        const size_t * child = key_indexes_[node.key_index_].Find(key);
+        return child ? *child : NO_KEY_INDEX;
+      }
 
-  PyObject * options_dict = dict2 ? dict1 : NULL;
-  PyObject * mapping_dict = dict2 ? dict2 : dict1;
+      size_t end = node.first_child_ + node.child_count_;
+      for (size_t i = node.first_child_; i < end; ++i)
+        if (nodes_[i].key_ == key)
+          return i;
+      return NO_KEY_INDEX;
+    }
 
-  std::string options, error;
-  if (!options_dict)
-    options = "{}";
-  else if (!parse_dict(options_dict, &options, &error))
-  {
-    PyErr_SetString( Nkit4PyError,
-        ("Options parameter must be JSON-string or dictionary: " +
-        error).c_str());
-    return NULL;
-  }
+  private:
+    size_t Allocate(size_t count)
+    {
+      size_t first = nodes_.size();
+      nodes_.resize(first + count);
+      return first;
+    }
 
-  if (options.empty())
-  {
-    PyErr_SetString(
-        Nkit4PyError,
-        "Options parameter must be dict or JSON object" );
-    return NULL;
-  }
+    bool Fill(size_t index, PyObject * obj, std::string * error)
+    {
+      Var2XmlValueKind kind = PythonReaderPolicy::Kind(obj);
+      nodes_[index].kind_ = kind;
+      switch (kind)
+      {
+      case V2X_DICT:
+      {
+        // children are allocated as one block, so they are collected first;
+        // values are referenced, because __str__ of some child may change
+        // the dict
+        std::vector<PyObject *> values;
+        std::vector<std::string> keys;
+        PythonReaderPolicy::DictConstIterator
+            it = PythonReaderPolicy::begin_d(obj),
+            end = PythonReaderPolicy::end_d(obj);
+        for (; it != end; ++it)
+        {
+          keys.push_back(PythonReaderPolicy::First(it));
+          values.push_back(PythonReaderPolicy::Second(it));
+          Py_INCREF(values.back());
+        }
 
-  std::string mappings;
-  if (!parse_dict(mapping_dict, &mappings, &error))
-  {
-    PyErr_SetString( Nkit4PyError,
-        ("Mappings parameter must be JSON-string or dictionary: " +
-        error).c_str());
-    return NULL;
-  }
+        size_t first = Allocate(values.size());
+        nodes_[index].first_child_ = first;
+        nodes_[index].child_count_ = values.size();
+        bool ok = true;
+        for (size_t i = 0; i < values.size(); ++i)
+        {
+          nodes_[first + i].key_.swap(keys[i]);
+          ok = ok && Fill(first + i, values[i], error);
+          Py_DECREF(values[i]);
+        }
+        if (!ok)
+          return false;
 
-  if(mappings.empty())
-  {
-    PyErr_SetString(
-        Nkit4PyError,
-        "Mappings parameter must be dict or JSON object" );
-    return NULL;
-  }
+        // lookups of 'attrkey', 'textkey' and 'priority' keys
+        if (values.size() >= MIN_INDEXED_DICT_SIZE)
+        {
+          nodes_[index].key_index_ = key_indexes_.size();
+          key_indexes_.push_back(detail::StringHashMap<size_t>());
+          detail::StringHashMap<size_t> & key_index = key_indexes_.back();
+          for (size_t i = first; i < first + values.size(); ++i)
+            if (!key_index.Find(nodes_[i].key_))
+              key_index.Insert(nodes_[i].key_, i);
+        }
+        break;
+      }
+      case V2X_LIST:
+      {
+        size_t count = PythonReaderPolicy::ListSize(obj);
+        size_t first = Allocate(count);
+        nodes_[index].first_child_ = first;
+        nodes_[index].child_count_ = count;
+        PythonReaderPolicy::ListConstIterator
+            it = PythonReaderPolicy::begin_l(obj),
+            end = PythonReaderPolicy::end_l(obj);
+        for (size_t i = 0; it != end && i < count; ++it, ++i)
+          if (!Fill(first + i, PythonReaderPolicy::Value(it), error))
+            return false;
+        break;
+      }
+      case V2X_DATETIME:
+        nodes_[index].text_ = PythonReaderPolicy::GetStringAsDateTime(obj,
+            date_time_format_);
+        break;
+      case V2X_FLOAT:
+        nodes_[index].float_ = PyFloat_AsDouble(obj);
+        break;
+      case V2X_BOOL:
+        nodes_[index].bool_ = obj == Py_True;
+        break;
+      default:
+      {
+#if PY_VERSION_HEX >= 0x02070000
+        if (PyLong_Check(obj) || PyInt_Check(obj))
+        {
+          int overflow = 0;
+          PY_LONG_LONG v = PyLong_AsLongLongAndOverflow(obj, &overflow);
+          if (!overflow && !(v == -1 && PyErr_Occurred()))
+          {
+            nodes_[index].is_int_ = true;
+            nodes_[index].int_ = static_cast<int64_t>(v);
+            break;
+          }
+          PyErr_Clear();
+        }
+#endif
+        if (!py_to_string(obj, &nodes_[index].text_, error))
+          return false;
+        break;
+      }
+      }
+      return true;
+    }
 
-  MapXml2PythonBuilderData * self =
-      (MapXml2PythonBuilderData *)type->tp_alloc( type, 0 );
-  if (!self)
-  {
-    PyErr_SetString(Nkit4PyError, "Low memory");
-    return NULL;
-  }
+  private:
+    static const size_t MIN_INDEXED_DICT_SIZE = 8;
 
-  nkit::MapXml2PythonBuilder::Ptr builder =
-      nkit::MapXml2PythonBuilder::Create(options, mappings, &error);
-  if(!builder)
+    std::vector<Node> nodes_;
+    std::vector<detail::StringHashMap<size_t> > key_indexes_;
+    const detail::DateTimeFormat & date_time_format_;
+  };
+
+  ////--------------------------------------------------------------------------
+  struct PySnapshotReaderPolicy
   {
-    PyErr_SetString( Nkit4PyError, error.c_str() );
-    return NULL;
-  }
+    struct type
+    {
+      const PySnapshot::Node & node() const
+      {
+        return snapshot_->node(index_);
+      }
+
+      const PySnapshot * snapshot_;
+      size_t index_;
+    };
+
+    //--------------------------------------------------------------------------
+    struct DictConstIterator
+    {
+      bool operator != (const DictConstIterator & another) const
+      {
+        return pos_ != another.pos_;
+      }
+
+      DictConstIterator & operator++()
+      {
+        ++pos_;
+        return *this;
+      }
+
+      const PySnapshot * snapshot_;
+      size_t pos_;
+    };
+
+    typedef DictConstIterator ListConstIterator;
+
+    //--------------------------------------------------------------------------
+    static DictConstIterator begin_d(const type & data)
+    {
+      DictConstIterator it = { data.snapshot_, data.node().first_child_ };
+      return it;
+    }
+
+    static DictConstIterator end_d(const type & data)
+    {
+      const PySnapshot::Node & node = data.node();
+      DictConstIterator it = { data.snapshot_,
+          node.first_child_ + node.child_count_ };
+      return it;
+    }
+
+    static ListConstIterator begin_l(const type & data)
+    {
+      return begin_d(data);
+    }
+
+    static ListConstIterator end_l(const type & data)
+    {
+      return end_d(data);
+    }
+
+    static const std::string & First(const DictConstIterator & it)
+    {
+      return it.snapshot_->node(it.pos_).key_;
+    }
+
+    static type Second(const DictConstIterator & it)
+    {
+      type ret = { it.snapshot_, it.pos_ };
+      return ret;
+    }
+
+    static type Value(const ListConstIterator & it)
+    {
+      return Second(it);
+    }
+
+    static Var2XmlValueKind Kind(const type & data)
+    {
+      return data.node().kind_;
+    }
+
+    static size_t ListSize(const type & data)
+    {
+      return data.node().child_count_;
+    }
+
+    static std::string GetString(const type & data)
+    {
+      const PySnapshot::Node & node = data.node();
+      return node.is_int_ ? string_cast(node.int_) : node.text_;
+    }
+
+    static const std::string & GetStringAsDateTime(const type & data,
+            const detail::DateTimeFormat & /*format*/)
+    {
+      return data.node().text_;
+    }
+
+    static std::string GetStringAsFloat(const type & data, size_t precision)
+    {
+      return string_cast(data.node().float_, precision);
+    }
+
+    static const std::string & GetStringAsBool(const type & data,
+        const std::string & true_format, const std::string & false_format)
+    {
+      return data.node().bool_ ? true_format: false_format;
+    }
+
+    static type GetByKey(const type & data, const std::string & key,
+            bool * found)
+    {
+      size_t child = data.snapshot_->FindChild(data.node(), key);
+      *found = child != PySnapshot::NO_KEY_INDEX;
+      if (!*found)
+        return data;
+      type ret = { data.snapshot_, child };
+      return ret;
+    }
+  };
+
+  typedef Var2XmlConverter<PySnapshotReaderPolicy> PySnapshot2XmlConverter;
+
+} // namespace nkit
+
+////----------------------------------------------------------------------------
+/// exception
+static PyObject * Nkit4PyError;
+
+////----------------------------------------------------------------------------
+/// Options and mappings are given by dict or JSON string
+bool parse_dict(PyObject * dict, nkit::Dynamic * out, std::string * error)
+{
+  if (PyDict_Check(dict))
+    return nkit::py_to_dynamic(dict, out, error);
+
+  std::string json;
+  if (!nkit::py_to_string(dict, &json, error))
+    return false;
+  if (json.empty())
+  {
+    *out = nkit::Dynamic();
+    return true;
+  }
+
+  error->clear();
+  *out = nkit::DynamicFromJson(json, error);
+  return error->empty();
+}
+
+////----------------------------------------------------------------------------
+template<typename T>
+struct SharedPtrHolder
+{
+  SharedPtrHolder(NKIT_SHARED_PTR(T) & ptr) : ptr_(ptr) {}
+  NKIT_SHARED_PTR(T) ptr_;
+};
+
+////----------------------------------------------------------------------------
+struct XmlBufferData;
+
+////----------------------------------------------------------------------------
+struct MapXml2PythonBuilderData
+{
+  PyObject_HEAD;
+  SharedPtrHolder<nkit::MapXml2PythonBuilder> * holder_;
+  XmlBufferData * buffer_; // borrowed
+};
+
+////----------------------------------------------------------------------------
+struct AnyXml2PythonBuilderData
+{
+  PyObject_HEAD;
+  SharedPtrHolder<nkit::AnyXml2PythonBuilder> * holder_;
+  XmlBufferData * buffer_; // borrowed
+};
+
+////----------------------------------------------------------------------------
+/// builder.get_buffer(size) returns object with buffer interface over
+/// parser's own memory (Expat's buffer), builder.parse_buffer(len[, last])
+/// parses first 'len' bytes of it in place.
+/// Buffer holds reference to builder while attached to it; builder holds
+/// borrowed pointer to buffer. parse_buffer(), next get_buffer(), feed() and
+/// end() detach it, so memory can't be used after parser has moved on. They
+/// fail while a view of the memory is exported (e.g. by memoryview).
+struct XmlBufferData
+{
+  PyObject_HEAD;
+  PyObject * owner_;
+  XmlBufferData ** slot_; // owner's pointer to this buffer
+  char * data_;
+  Py_ssize_t size_;
+  Py_ssize_t exports_;
+};
+
+static int xml_buffer_get(PyObject * self, Py_buffer * view, int flags)
+{
+  XmlBufferData * buffer = (XmlBufferData *)self;
+  if (!buffer->data_)
+  {
+    PyErr_SetString( Nkit4PyError,
+        "Buffer is not valid after parse_buffer(), get_buffer(), feed()"
+        " or end()" );
+    view->obj = NULL;
+    return -1;
+  }
+  if (PyBuffer_FillInfo(view, self, buffer->data_, buffer->size_, 0,
+      flags) != 0)
+    return -1;
+  ++buffer->exports_;
+  return 0;
+}
+
+static void xml_buffer_release(PyObject * self, Py_buffer * /*view*/)
+{
+  --((XmlBufferData *)self)->exports_;
+}
+
+static void xml_buffer_detach(XmlBufferData * buffer)
+{
+  *buffer->slot_ = NULL;
+  buffer->slot_ = NULL;
+  buffer->data_ = NULL;
+  buffer->size_ = 0;
+  Py_CLEAR(buffer->owner_);
+}
+
+static void DeleteXmlBuffer(PyObject * self)
+{
+  XmlBufferData * buffer = (XmlBufferData *)self;
+  if (buffer->slot_)
+    xml_buffer_detach(buffer);
+  PyObject_Del(self);
+}
+
+static PyBufferProcs xml_buffer_procs =
+{
+#if PY_MAJOR_VERSION < 3
+  0, /*bf_getreadbuffer*/
+  0, /*bf_getwritebuffer*/
+  0, /*bf_getsegcount*/
+  0, /*bf_getcharbuffer*/
+#endif
+  xml_buffer_get, /*bf_getbuffer*/
+  xml_buffer_release, /*bf_releasebuffer*/
+};
+
+#if PY_MAJOR_VERSION < 3
+#  define NKIT_TPFLAGS_BUFFER Py_TPFLAGS_HAVE_NEWBUFFER
+#else
+#  define NKIT_TPFLAGS_BUFFER 0
+#endif
+
+static PyTypeObject XmlBufferType =
+{
+  PyVarObject_HEAD_INIT(NULL, 0)
+  "nkit4py.XmlBuffer", /*tp_name*/
+  sizeof(XmlBufferData), /*tp_basicsize*/
+  0, /*tp_itemsize*/
+  DeleteXmlBuffer, /*tp_dealloc*/
+  0, /*tp_print*/
+  0, /*tp_getattr*/
+  0, /*tp_setattr*/
+  0, /*tp_compare*/
+  0, /*tp_repr*/
+  0, /*tp_as_number*/
+  0, /*tp_as_sequence*/
+  0, /*tp_as_mapping*/
+  0, /*tp_hash */
+  0, /*tp_call*/
+  0, /*tp_str*/
+  0, /*tp_getattro*/
+  0, /*tp_setattro*/
+  &xml_buffer_procs, /*tp_as_buffer*/
+  Py_TPFLAGS_DEFAULT | NKIT_TPFLAGS_BUFFER, /*tp_flags*/
+  "Parser's input buffer returned by get_buffer()", /* tp_doc */
+};
+
+/// Detaches buffer from builder; fails if buffer is in use
+template<typename Data>
+static bool builder_detach_buffer(Data * data)
+{
+  if (!data->buffer_)
+    return true;
+  if (data->buffer_->exports_)
+  {
+    PyErr_SetString( Nkit4PyError,
+        "Buffer from get_buffer() is still in use" );
+    return false;
+  }
+  xml_buffer_detach(data->buffer_);
+  return true;
+}
+
+template<typename Data>
+static PyObject * builder_get_buffer(PyObject * self, PyObject * args)
+{
+  Py_ssize_t size = 0;
+  if(!PyArg_ParseTuple( args, "n", &size ))
+  {
+    PyErr_SetString( Nkit4PyError, "Expected integer argument" );
+    return NULL;
+  }
+  if (size <= 0 || size > INT_MAX)
+  {
+    PyErr_SetString( Nkit4PyError, "Buffer size is out of range" );
+    return NULL;
+  }
+
+  Data * data = (Data *)self;
+  if (!builder_detach_buffer(data))
+    return NULL;
+
+  XmlBufferData * buffer = PyObject_New(XmlBufferData, &XmlBufferType);
+  if (!buffer)
+    return NULL;
+  buffer->owner_ = NULL;
+  buffer->slot_ = NULL;
+  buffer->size_ = 0;
+  buffer->exports_ = 0;
+  buffer->data_ = static_cast<char *>(
+      data->holder_->ptr_->GetBuffer(static_cast<size_t>(size)));
+  if (!buffer->data_)
+  {
+    Py_DECREF(buffer);
+    PyErr_SetString( Nkit4PyError, "Parser can not provide buffer" );
+    return NULL;
+  }
+
+  buffer->size_ = size;
+  Py_INCREF(self);
+  buffer->owner_ = self;
+  buffer->slot_ = &data->buffer_;
+  data->buffer_ = buffer;
+  return (PyObject *)buffer;
+}
+
+template<typename Data>
+static PyObject * builder_parse_buffer(PyObject * self, PyObject * args)
+{
+  Py_ssize_t len = 0;
+  int last = 0;
+  if(!PyArg_ParseTuple( args, "n|i", &len, &last ))
+  {
+    PyErr_SetString( Nkit4PyError,
+        "Expected integer length and optional 'last' flag" );
+    return NULL;
+  }
+
+  Data * data = (Data *)self;
+  if (!data->buffer_ || len < 0 || len > data->buffer_->size_)
+  {
+    PyErr_SetString( Nkit4PyError,
+        "Length exceeds size requested by get_buffer()" );
+    return NULL;
+  }
+  if (!builder_detach_buffer(data))
+    return NULL;
+
+  std::string error("");
+  if(!data->holder_->ptr_->ParseBuffer( static_cast<size_t>(len),
+      last != 0, &error ))
+  {
+    PyErr_SetString( Nkit4PyError, error.c_str() );
+    return NULL;
+  }
+
+  Py_RETURN_NONE;
+}
+
+////----------------------------------------------------------------------------
+/// Parses (mappings) or (options, mappings) arguments of builders with
+/// mappings
+static bool parse_options_and_mappings(PyObject * dict1, PyObject * dict2,
+    nkit::Dynamic * options, nkit::Dynamic * mappings)
+{
+  PyObject * options_dict = dict2 ? dict1 : NULL;
+  PyObject * mapping_dict = dict2 ? dict2 : dict1;
+
+  std::string error;
+  if (!options_dict)
+    *options = nkit::Dynamic::Dict();
+  else if (!parse_dict(options_dict, options, &error))
+  {
+    PyErr_SetString( Nkit4PyError,
+        ("Options parameter must be JSON-string or dictionary: " +
+        error).c_str());
+    return false;
+  }
+
+  if (!options->IsDict())
+  {
+    PyErr_SetString(
+        Nkit4PyError,
+        "Options parameter must be dict or JSON object" );
+    return false;
+  }
+
+  if (!parse_dict(mapping_dict, mappings, &error))
+  {
+    PyErr_SetString( Nkit4PyError,
+        ("Mappings parameter must be JSON-string or dictionary: " +
+        error).c_str());
+    return false;
+  }
+
+  if(!mappings->IsDict())
+  {
+    PyErr_SetString(
+        Nkit4PyError,
+        "Mappings parameter must be dict or JSON object" );
+    return false;
+  }
+
+  return true;
+}
+
+static bool parse_options_and_mappings(PyObject * args,
+    nkit::Dynamic * options, nkit::Dynamic * mappings)
+{
+  PyObject * dict1 = NULL;
+  PyObject * dict2 = NULL;
+  int result = PyArg_ParseTuple(args, "O|O", &dict1, &dict2);
+  if(!result)
+  {
+    PyErr_SetString(Nkit4PyError,
+        "Expected one or two arguments:"
+        " 1) mappings or 2) options and mappings");
+    return false;
+  }
+  return parse_options_and_mappings(dict1, dict2, options, mappings);
+}
+
+////----------------------------------------------------------------------------
+static PyObject* CreateMapXml2VarBuilder(
+    PyTypeObject * type, PyObject * args, PyObject *)
+{
+  nkit::Dynamic options, mappings;
+  std::string error;
+  if (!parse_options_and_mappings(args, &options, &mappings))
+    return NULL;
+
+  MapXml2PythonBuilderData * self =
+      (MapXml2PythonBuilderData *)type->tp_alloc( type, 0 );
+  if (!self)
+  {
+    PyErr_SetString(Nkit4PyError, "Low memory");
+    return NULL;
+  }
+
+  nkit::MapXml2PythonBuilder::Ptr builder =
+      nkit::MapXml2PythonBuilder::Create(options, mappings, &error);
+  if(!builder)
+  {
+    PyErr_SetString( Nkit4PyError, error.c_str() );
+    return NULL;
+  }
+  self->holder_ =
+      new SharedPtrHolder< nkit::MapXml2PythonBuilder >(builder);
+  self->buffer_ = NULL;
+
+  return (PyObject *)self;
+}
+
+////----------------------------------------------------------------------------
+static void DeleteMapXml2VarBuilder(PyObject * self)
+{
+  SharedPtrHolder< nkit::MapXml2PythonBuilder > * ptr =
+        ((MapXml2PythonBuilderData *)self)->holder_;
+  if (ptr)
+    delete ptr;
+  self->ob_type->tp_free(self);
+}
+
+////----------------------------------------------------------------------------
+static PyObject * map_feed_method( PyObject * self, PyObject * args )
+{
+  const char* request = NULL;
+  Py_ssize_t size = 0;
+  int result = PyArg_ParseTuple( args, "s#", &request, &size );
+  if(!result)
+  {
+    PyErr_SetString( Nkit4PyError, "Expected string arguments" );
+    return NULL;
+  }
+  if( !request || !*request || !size )
+  {
+    PyErr_SetString(
+        Nkit4PyError, "Parameter must not be empty string" );
+    return NULL;
+  }
+
+  nkit::MapXml2PythonBuilder::Ptr builder =
+      ((MapXml2PythonBuilderData *)self)->holder_->ptr_;
+  if (!builder_detach_buffer((MapXml2PythonBuilderData *)self))
+    return NULL;
+
+  std::string error("");
+  if(!builder->Feed( request, size, false, &error ))
+  {
+    PyErr_SetString( Nkit4PyError, error.c_str() );
+    return NULL;
+  }
+
+  Py_RETURN_NONE;
+}
+
+////----------------------------------------------------------------------------
+static PyObject * map_get_method( PyObject * self, PyObject * args )
+{
+  const char* mapping_name = NULL;
+  int result = PyArg_ParseTuple( args, "s", &mapping_name );
+  if(!result)
+  {
+    PyErr_SetString( Nkit4PyError, "Expected string argument" );
+    return NULL;
+  }
+  if( !mapping_name || !*mapping_name )
+  {
+    PyErr_SetString(
+        Nkit4PyError, "Mapping name must not be empty" );
+    return NULL;
+  }
+
+  nkit::MapXml2PythonBuilder::Ptr builder =
+      ((MapXml2PythonBuilderData *)self)->holder_->ptr_;
+
+  PyObject * item = builder->var(mapping_name);
+  Py_INCREF(item);
+  return item;
+}
+
+////------------------------------------------------------------------------------
+static PyObject * map_end_method( PyObject * self, PyObject * /*args*/ )
+{
+  nkit::MapXml2PythonBuilder::Ptr builder =
+          ((MapXml2PythonBuilderData *)self)->holder_->ptr_;
+  if (!builder_detach_buffer((MapXml2PythonBuilderData *)self))
+    return NULL;
+
+  std::string empty("");
+  std::string error("");
+  if(!builder->Feed( empty.c_str(), empty.size(), true, &error ))
+  {
+    PyErr_SetString( Nkit4PyError, error.c_str() );
+    return NULL;
+  }
+
+  nkit::StringList mapping_names(builder->mapping_names());
+
+  PyObject * result = PyDict_New();
+  nkit::StringList::const_iterator mapping_name = mapping_names.begin(),
+      end = mapping_names.end();
+  for (; mapping_name != end; ++mapping_name)
+  {
+    PyObject * item = builder->var(*mapping_name);
+    PyDict_SetItemString(result, mapping_name->c_str(), item);
+  }
+  return result;
+}
+
+////----------------------------------------------------------------------------
+static PyMethodDef map_xml2var_methods[] =
+{
+  { "feed", map_feed_method, METH_VARARGS, "Usage: builder.feed()\n"
+          "Invoke \"Feed\" function\n"
+          "Returns None\n" },
+  { "get", map_get_method, METH_VARARGS, "Usage: builder.get()\n"
+          "Returns result by mapping name\n" },
+  { "end", map_end_method, METH_VARARGS, "Usage: builder.end()\n"
+          "Returns Dict: results for all mappings\n" },
+  { "get_buffer", builder_get_buffer<MapXml2PythonBuilderData>, METH_VARARGS,
+      "Usage: builder.get_buffer(size)\n"
+      "Returns parser's buffer to read next chunk of XML into\n" },
+  { "parse_buffer", builder_parse_buffer<MapXml2PythonBuilderData>,
+      METH_VARARGS, "Usage: builder.parse_buffer(length[, last])\n"
+      "Parses 'length' bytes written to buffer from get_buffer()\n"
+      "Returns None\n" },
+  { NULL, NULL, 0, NULL } /* Sentinel */
+};
+
+////----------------------------------------------------------------------------
+static PyTypeObject MapXml2PythonBuilderType =
+{
+  PyVarObject_HEAD_INIT(NULL, 0)
+  "nkit4py.Xml2VarBuilder", /*tp_name*/
+  sizeof(MapXml2PythonBuilderData), /*tp_basicsize*/
+  0, /*tp_itemsize*/
+  DeleteMapXml2VarBuilder, /*tp_dealloc*/
+  0, /*tp_print*/
+  0, /*tp_getattr*/
+  0, /*tp_setattr*/
+  0, /*tp_compare*/
+  0, /*tp_repr*/
+  0, /*tp_as_number*/
+  0, /*tp_as_sequence*/
+  0, /*tp_as_mapping*/
+  0, /*tp_hash */
+  0, /*tp_call*/
+  0, /*tp_str*/
+  0, /*tp_getattro*/
+  0, /*tp_setattro*/
+  0, /*tp_as_buffer*/
+  Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE, /*tp_flags*/
+  "XML to object or list converter and filter", /* tp_doc */
+  0,//tp_traverse
+  0,//tp_clear,
+  0,//tp_richcompare,
+  0,//tp_weaklistoffset,
+  0,//tp_iter,
+  0,//tp_iternext,
+  map_xml2var_methods,//tp_methods,
+  0,//tp_members,
+  0,//tp_getset,
+  0,//tp_base,
+  0,//tp_dict,
+  0,//tp_descr_get,
+  0,//tp_descr_set,
+  0,//tp_dictoffset,
+  0,//tp_init,
+  0,//tp_alloc,
+  CreateMapXml2VarBuilder,//tp_new,
+};
+
+////----------------------------------------------------------------------------
+static PyObject* CreateAnyXml2VarBuilder(
+    PyTypeObject * type, PyObject * args, PyObject *)
+{
+  PyObject * options_dict = NULL;
+  int result = PyArg_ParseTuple(args, "|O", &options_dict);
+  if(!result)
+  {
+    PyErr_SetString(Nkit4PyError,
+        "Expected one or two arguments:"
+        " 1) mappings or 2) options and mappings");
+    return NULL;
+  }
+
+  nkit::Dynamic options;
+  std::string error;
+  if (!options_dict)
+    options = nkit::Dynamic::Dict();
+  else if (!parse_dict(options_dict, &options, &error))
+  {
+    PyErr_SetString( Nkit4PyError,
+        ("Options parameter must be JSON-string or dictionary: " +
+        error).c_str());
+    return NULL;
+  }
+
+  if (!options.IsDict())
+  {
+    PyErr_SetString(
+        Nkit4PyError,
+        "Options parameter must be dict or JSON object" );
+    return NULL;
+  }
+
+  AnyXml2PythonBuilderData * self =
+      (AnyXml2PythonBuilderData *)type->tp_alloc( type, 0 );
+  if (!self)
+  {
+    PyErr_SetString(Nkit4PyError, "Low memory");
+    return NULL;
+  }
+
+  nkit::AnyXml2PythonBuilder::Ptr builder =
+      nkit::AnyXml2PythonBuilder::Create(options, &error);
+  if(!builder)
+  {
+    PyErr_SetString( Nkit4PyError, error.c_str() );
+    return NULL;
+  }
+
   self->holder_ =
-      new SharedPtrHolder< nkit::MapXml2PythonBuilder >(builder);
+      new SharedPtrHolder< nkit::AnyXml2PythonBuilder >(builder);
+  self->buffer_ = NULL;
+
+  return (PyObject *)self;
+}
+
+////----------------------------------------------------------------------------
+static void DeleteAnyXml2VarBuilder(PyObject * self)
+{
+  SharedPtrHolder< nkit::AnyXml2PythonBuilder > * ptr =
+        ((AnyXml2PythonBuilderData *)self)->holder_;
+  if (ptr)
+    delete ptr;
+  self->ob_type->tp_free(self);
+}
+
+////----------------------------------------------------------------------------
+static PyObject * any_feed_method( PyObject * self, PyObject * args )
+{
+  const char* request = NULL;
+  Py_ssize_t size = 0;
+  int result = PyArg_ParseTuple( args, "s#", &request, &size );
+  if(!result)
+  {
+    PyErr_SetString( Nkit4PyError, "Expected string arguments" );
+    return NULL;
+  }
+  if( !request || !*request || !size )
+  {
+    PyErr_SetString(
+        Nkit4PyError, "Parameter must not be empty string" );
+    return NULL;
+  }
+
+  nkit::AnyXml2PythonBuilder::Ptr builder =
+      ((AnyXml2PythonBuilderData *)self)->holder_->ptr_;
+  if (!builder_detach_buffer((AnyXml2PythonBuilderData *)self))
+    return NULL;
+
+  std::string error("");
+  if(!builder->Feed( request, size, false, &error ))
+  {
+    PyErr_SetString( Nkit4PyError, error.c_str() );
+    return NULL;
+  }
+
+  Py_RETURN_NONE;
+}
+
+////----------------------------------------------------------------------------
+static PyObject * any_get_method( PyObject * self, PyObject * args )
+{
+  nkit::AnyXml2PythonBuilder::Ptr builder =
+      ((AnyXml2PythonBuilderData *)self)->holder_->ptr_;
+
+  PyObject * item = builder->var();
+  Py_INCREF(item);
+  return item;
+}
+
+////------------------------------------------------------------------------------
+static PyObject * any_end_method( PyObject * self, PyObject * /*args*/ )
+{
+  nkit::AnyXml2PythonBuilder::Ptr builder =
+          ((AnyXml2PythonBuilderData *)self)->holder_->ptr_;
+  if (!builder_detach_buffer((AnyXml2PythonBuilderData *)self))
+    return NULL;
+
+  std::string empty("");
+  std::string error("");
+  if(!builder->Feed( empty.c_str(), empty.size(), true, &error ))
+  {
+    PyErr_SetString( Nkit4PyError, error.c_str() );
+    return NULL;
+  }
+
+  PyObject * item = builder->var();
+  Py_INCREF(item);
+  return item;
+}
+
+////----------------------------------------------------------------------------
+static PyObject * any_root_name_method( PyObject * self, PyObject * args )
+{
+  nkit::AnyXml2PythonBuilder::Ptr builder =
+      ((AnyXml2PythonBuilderData *)self)->holder_->ptr_;
+
+  const std::string & root_name = builder->root_name();
+  return PyStr_FromString(root_name.c_str());
+}
+
+////----------------------------------------------------------------------------
+static PyMethodDef any_xml2var_methods[] =
+{
+  { "feed", any_feed_method, METH_VARARGS, "Usage: builder.feed()\n"
+          "Invoke \"Feed\" function\n"
+          "Returns None\n" },
+  { "get", any_get_method, METH_VARARGS, "Usage: builder.get()\n"
+          "Returns result\n" },
+  { "end", any_end_method, METH_VARARGS, "Usage: builder.end()\n"
+          "Returns result\n" },
+  { "get_buffer", builder_get_buffer<AnyXml2PythonBuilderData>, METH_VARARGS,
+      "Usage: builder.get_buffer(size)\n"
+      "Returns parser's buffer to read next chunk of XML into\n" },
+  { "parse_buffer", builder_parse_buffer<AnyXml2PythonBuilderData>,
+      METH_VARARGS, "Usage: builder.parse_buffer(length[, last])\n"
+      "Parses 'length' bytes written to buffer from get_buffer()\n"
+      "Returns None\n" },
+  { "root_name", any_root_name_method, METH_VARARGS,
+      "Usage: builder.root_name()\n"
+      "Returns root element name\n" },
+  { NULL, NULL, 0, NULL } /* Sentinel */
+};
+
+////----------------------------------------------------------------------------
+static PyTypeObject AnyXml2PythonBuilderType =
+{
+  PyVarObject_HEAD_INIT(NULL, 0)
+  "nkit4py.AnyXml2VarBuilder", /*tp_name*/
+  sizeof(AnyXml2PythonBuilderData), /*tp_basicsize*/
+  0, /*tp_itemsize*/
+  DeleteAnyXml2VarBuilder, /*tp_dealloc*/
+  0, /*tp_print*/
+  0, /*tp_getattr*/
+  0, /*tp_setattr*/
+  0, /*tp_compare*/
+  0, /*tp_repr*/
+  0, /*tp_as_number*/
+  0, /*tp_as_sequence*/
+  0, /*tp_as_mapping*/
+  0, /*tp_hash */
+  0, /*tp_call*/
+  0, /*tp_str*/
+  0, /*tp_getattro*/
+  0, /*tp_setattro*/
+  0, /*tp_as_buffer*/
+  Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE, /*tp_flags*/
+  "XML to object or list converter and filter", /* tp_doc */
+  0,//tp_traverse
+  0,//tp_clear,
+  0,//tp_richcompare,
+  0,//tp_weaklistoffset,
+  0,//tp_iter,
+  0,//tp_iternext,
+  any_xml2var_methods,//tp_methods,
+  0,//tp_members,
+  0,//tp_getset,
+  0,//tp_base,
+  0,//tp_dict,
+  0,//tp_descr_get,
+  0,//tp_descr_set,
+  0,//tp_dictoffset,
+  0,//tp_init,
+  0,//tp_alloc,
+  CreateAnyXml2VarBuilder,//tp_new,
+};
+
+////----------------------------------------------------------------------------
+struct Json2PythonBuilderData
+{
+  PyObject_HEAD;
+  SharedPtrHolder<nkit::Json2PythonBuilder> * holder_;
+};
+
+////----------------------------------------------------------------------------
+static PyObject* CreateJson2VarBuilder(
+    PyTypeObject * type, PyObject * args, PyObject *)
+{
+  nkit::Dynamic options, mappings;
+  std::string error;
+  if (!parse_options_and_mappings(args, &options, &mappings))
+    return NULL;
+
+  nkit::Json2PythonBuilder::Ptr builder =
+      nkit::Json2PythonBuilder::Create(options, mappings, &error);
+  if(!builder)
+  {
+    PyErr_SetString( Nkit4PyError, error.c_str() );
+    return NULL;
+  }
+
+  Json2PythonBuilderData * self =
+      (Json2PythonBuilderData *)type->tp_alloc( type, 0 );
+  if (!self)
+  {
+    PyErr_SetString(Nkit4PyError, "Low memory");
+    return NULL;
+  }
+  self->holder_ = new SharedPtrHolder< nkit::Json2PythonBuilder >(builder);
+
+  return (PyObject *)self;
+}
+
+////----------------------------------------------------------------------------
+static void DeleteJson2VarBuilder(PyObject * self)
+{
+  SharedPtrHolder< nkit::Json2PythonBuilder > * ptr =
+        ((Json2PythonBuilderData *)self)->holder_;
+  if (ptr)
+    delete ptr;
+  self->ob_type->tp_free(self);
+}
+
+////----------------------------------------------------------------------------
+static PyObject * json_feed_method( PyObject * self, PyObject * args )
+{
+  const char* request = NULL;
+  Py_ssize_t size = 0;
+  int result = PyArg_ParseTuple( args, "s#", &request, &size );
+  if(!result)
+  {
+    PyErr_SetString( Nkit4PyError, "Expected string arguments" );
+    return NULL;
+  }
+  if( !request || !*request || !size )
+  {
+    PyErr_SetString(
+        Nkit4PyError, "Parameter must not be empty string" );
+    return NULL;
+  }
+
+  nkit::Json2PythonBuilder::Ptr builder =
+      ((Json2PythonBuilderData *)self)->holder_->ptr_;
+
+  std::string error("");
+  if(!builder->Feed( request, size, false, &error ))
+  {
+    PyErr_SetString( Nkit4PyError, error.c_str() );
+    return NULL;
+  }
+
+  Py_RETURN_NONE;
+}
+
+////----------------------------------------------------------------------------
+static PyObject * json_get_method( PyObject * self, PyObject * args )
+{
+  const char* mapping_name = NULL;
+  int result = PyArg_ParseTuple( args, "s", &mapping_name );
+  if(!result)
+  {
+    PyErr_SetString( Nkit4PyError, "Expected string argument" );
+    return NULL;
+  }
+  if( !mapping_name || !*mapping_name )
+  {
+    PyErr_SetString(
+        Nkit4PyError, "Mapping name must not be empty" );
+    return NULL;
+  }
+
+  nkit::Json2PythonBuilder::Ptr builder =
+      ((Json2PythonBuilderData *)self)->holder_->ptr_;
+
+  PyObject * item = builder->var(mapping_name);
+  Py_INCREF(item);
+  return item;
+}
+
+////----------------------------------------------------------------------------
+static PyObject * json_end_method( PyObject * self, PyObject * /*args*/ )
+{
+  nkit::Json2PythonBuilder::Ptr builder =
+          ((Json2PythonBuilderData *)self)->holder_->ptr_;
+
+  std::string error("");
+  if(!builder->Feed( "", 0, true, &error ))
+  {
+    PyErr_SetString( Nkit4PyError, error.c_str() );
+    return NULL;
+  }
+
+  nkit::StringList mapping_names(builder->mapping_names());
+
+  PyObject * result = PyDict_New();
+  nkit::StringList::const_iterator mapping_name = mapping_names.begin(),
+      end = mapping_names.end();
+  for (; mapping_name != end; ++mapping_name)
+  {
+    PyObject * item = builder->var(*mapping_name);
+    PyDict_SetItemString(result, mapping_name->c_str(), item);
+  }
+  return result;
+}
+
+////----------------------------------------------------------------------------
+static PyMethodDef json2var_methods[] =
+{
+  { "feed", json_feed_method, METH_VARARGS, "Usage: builder.feed(json)\n"
+          "Parses next chunk of JSON\n"
+          "Returns None\n" },
+  { "get", json_get_method, METH_VARARGS, "Usage: builder.get()\n"
+          "Returns result by mapping name\n" },
+  { "end", json_end_method, METH_VARARGS, "Usage: builder.end()\n"
+          "Returns Dict: results for all mappings\n" },
+  { NULL, NULL, 0, NULL } /* Sentinel */
+};
+
+////----------------------------------------------------------------------------
+static PyTypeObject Json2PythonBuilderType =
+{
+  PyVarObject_HEAD_INIT(NULL, 0)
+  "nkit4py.Json2VarBuilder", /*tp_name*/
+  sizeof(Json2PythonBuilderData), /*tp_basicsize*/
+  0, /*tp_itemsize*/
+  DeleteJson2VarBuilder, /*tp_dealloc*/
+  0, /*tp_print*/
+  0, /*tp_getattr*/
+  0, /*tp_setattr*/
+  0, /*tp_compare*/
+  0, /*tp_repr*/
+  0, /*tp_as_number*/
+  0, /*tp_as_sequence*/
+  0, /*tp_as_mapping*/
+  0, /*tp_hash */
+  0, /*tp_call*/
+  0, /*tp_str*/
+  0, /*tp_getattro*/
+  0, /*tp_setattro*/
+  0, /*tp_as_buffer*/
+  Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE, /*tp_flags*/
+  "JSON to object or list converter and filter", /* tp_doc */
+  0,//tp_traverse
+  0,//tp_clear,
+  0,//tp_richcompare,
+  0,//tp_weaklistoffset,
+  0,//tp_iter,
+  0,//tp_iternext,
+  json2var_methods,//tp_methods,
+  0,//tp_members,
+  0,//tp_getset,
+  0,//tp_base,
+  0,//tp_dict,
+  0,//tp_descr_get,
+  0,//tp_descr_set,
+  0,//tp_dictoffset,
+  0,//tp_init,
+  0,//tp_alloc,
+  CreateJson2VarBuilder,//tp_new,
+};
+
+////----------------------------------------------------------------------------
+static bool parse_var2xml_options(PyObject * options_dict, nkit::Dynamic * op)
+{
+  std::string error;
+  *op = nkit::Dynamic::Dict();
+  if (options_dict && !parse_dict(options_dict, op, &error))
+  {
+    std::string tmp("Options parameter must be JSON-string or dictionary: " +
+            error);
+    PyErr_SetString( Nkit4PyError, tmp.c_str());
+    return false;
+  }
+  if (!*op)
+    *op = nkit::Dynamic::Dict();
+  return true;
+}
+
+static bool var2xml_unicode(const nkit::Dynamic & op)
+{
+  const nkit::Dynamic * unicode = NULL;
+  return op.Get("unicode", &unicode) && unicode->GetBoolean();
+}
+
+////----------------------------------------------------------------------------
+/// Called from catch(...): C++ exceptions (e.g. std::bad_alloc on huge
+/// output) must not pass through Python C API
+static void current_exception_to_error(std::string * error)
+{
+  try
+  {
+    throw;
+  }
+  catch (const std::bad_alloc &)
+  {
+    *error = "Out of memory";
+  }
+  catch (const std::exception & e)
+  {
+    *error = e.what();
+  }
+  catch (...)
+  {
+    *error = "Unknown error";
+  }
+}
+
+////----------------------------------------------------------------------------
+/// Lists shorter than this are not worth of snapshot and threads
+static const size_t VAR2XML_PARALLEL_MIN_ITEMS = 1024;
+
+static bool var2xml_is_big_list(PyObject * data)
+{
+  return (PyList_CheckExact(data) || PyTuple_CheckExact(data)) &&
+      nkit::PythonReaderPolicy::ListSize(data) >= VAR2XML_PARALLEL_MIN_ITEMS;
+}
+
+/// Top level list or top level dict with list member must be big enough
+static bool var2xml_worth_parallel(PyObject * data)
+{
+  if (var2xml_is_big_list(data))
+    return true;
+  if (!PyDict_Check(data))
+    return false;
+
+  PyObject * key = NULL, * value = NULL;
+  Py_ssize_t pos = 0;
+  while (PyDict_Next(data, &pos, &key, &value))
+    if (var2xml_is_big_list(value))
+      return true;
+  return false;
+}
+
+static bool var2xml_parallel(const nkit::Var2XmlOptions::Ptr & options,
+    PyObject * data, std::string * out, std::string * error)
+{
+  nkit::PySnapshot snapshot(options->compiled_date_time_format_);
+  nkit::PySnapshotReaderPolicy::type root = { &snapshot, 0 };
+  if (!snapshot.Add(data, &root.index_, error))
+    return false;
+
+  // private copy of options: their reference counter is not atomic, and
+  // other Python threads may use the same options while GIL is released
+  nkit::Var2XmlOptions::Ptr own_options(new nkit::Var2XmlOptions(*options));
+
+  bool ok;
+  Py_BEGIN_ALLOW_THREADS
+  try
+  {
+    ok = nkit::PySnapshot2XmlConverter::ProcessParallel(own_options, root,
+        VAR2XML_PARALLEL_MIN_ITEMS, out, error);
+  }
+  catch (...)
+  {
+    ok = false;
+    current_exception_to_error(error);
+  }
+  Py_END_ALLOW_THREADS
+  return ok;
+}
+
+////----------------------------------------------------------------------------
+/// Converts in several threads if 'parallel' option asks for it and data is
+/// big enough list or dict with such list
+static bool var2xml_process(const nkit::Var2XmlOptions::Ptr & options,
+    PyObject * data, std::string * out, std::string * error)
+{
+  try
+  {
+    if (options->parallel_ > 1 && var2xml_worth_parallel(data))
+      return var2xml_parallel(options, data, out, error);
+
+    return nkit::Python2XmlConverter::Process(options, data, out, error);
+  }
+  catch (...)
+  {
+    current_exception_to_error(error);
+    return false;
+  }
+}
+
+////----------------------------------------------------------------------------
+static PyObject * var2xml_method( PyObject * self, PyObject * args )
+{
+  PyObject * data = NULL;
+  PyObject * options_dict = NULL;
+  int result = PyArg_ParseTuple( args, "O|O", &data, &options_dict);
+  if(!result)
+  {
+    PyErr_SetString( Nkit4PyError,
+            "Expected any object and optional 'options' Dict" );
+    return NULL;
+  }
+
+  nkit::Dynamic op;
+  if (!parse_var2xml_options(options_dict, &op))
+    return NULL;
+
+  std::string out, error;
+  nkit::Var2XmlOptions::Ptr options = nkit::Var2XmlOptions::Create(op, &error);
+  if(!options || !var2xml_process(options, data, &out, &error))
+  {
+    PyErr_SetString( Nkit4PyError, error.c_str() );
+    return NULL;
+  }
+
+  if (var2xml_unicode(op))
+    return PyUnicode_FromStringAndSize(out.data(), out.size());
+  else
+    return PyBytes_FromStringAndSize(out.data(), out.size());
+}
+
+////----------------------------------------------------------------------------
+struct Var2XmlSerializerData
+{
+  PyObject_HEAD;
+  SharedPtrHolder<nkit::Var2XmlOptions> * holder_;
+  bool unicode_;
+};
+
+////----------------------------------------------------------------------------
+static PyObject* CreateVar2XmlSerializer(
+    PyTypeObject * type, PyObject * args, PyObject *)
+{
+  PyObject * options_dict = NULL;
+  int result = PyArg_ParseTuple(args, "|O", &options_dict);
+  if(!result)
+  {
+    PyErr_SetString(Nkit4PyError, "Expected optional 'options' Dict");
+    return NULL;
+  }
+
+  nkit::Dynamic op;
+  if (!parse_var2xml_options(options_dict, &op))
+    return NULL;
+
+  std::string error;
+  nkit::Var2XmlOptions::Ptr options =
+      nkit::Var2XmlOptions::Create(op, &error);
+  if(!options)
+  {
+    PyErr_SetString( Nkit4PyError, error.c_str() );
+    return NULL;
+  }
+
+  Var2XmlSerializerData * self =
+      (Var2XmlSerializerData *)type->tp_alloc( type, 0 );
+  if (!self)
+  {
+    PyErr_SetString(Nkit4PyError, "Low memory");
+    return NULL;
+  }
+
+  self->holder_ = new SharedPtrHolder< nkit::Var2XmlOptions >(options);
+  self->unicode_ = var2xml_unicode(op);
+
+  return (PyObject *)self;
+}
+
+////----------------------------------------------------------------------------
+static void DeleteVar2XmlSerializer(PyObject * self)
+{
+  SharedPtrHolder< nkit::Var2XmlOptions > * ptr =
+        ((Var2XmlSerializerData *)self)->holder_;
+  if (ptr)
+    delete ptr;
+  self->ob_type->tp_free(self);
+}
+
+////----------------------------------------------------------------------------
+static PyObject * serializer_dumps_method( PyObject * self, PyObject * args )
+{
+  PyObject * data = NULL;
+  if(!PyArg_ParseTuple( args, "O", &data ))
+  {
+    PyErr_SetString( Nkit4PyError, "Expected any object" );
+    return NULL;
+  }
+
+  Var2XmlSerializerData * serializer = (Var2XmlSerializerData *)self;
+  std::string out, error;
+  if(!var2xml_process(serializer->holder_->ptr_, data, &out, &error))
+  {
+    PyErr_SetString( Nkit4PyError, error.c_str() );
+    return NULL;
+  }
+
+  if (serializer->unicode_)
+    return PyUnicode_FromStringAndSize(out.data(), out.size());
+  else
+    return PyBytes_FromStringAndSize(out.data(), out.size());
+}
+
+////----------------------------------------------------------------------------
+static PyMethodDef var2xml_serializer_methods[] =
+{
+  { "dumps", serializer_dumps_method, METH_VARARGS,
+      "Usage: serializer.dumps(data)\n"
+      "Converts python structure to xml string with precompiled options\n"
+      "Returns XML string\n" },
+  { NULL, NULL, 0, NULL } /* Sentinel */
+};
+
+////----------------------------------------------------------------------------
+static PyTypeObject Var2XmlSerializerType =
+{
+  PyVarObject_HEAD_INIT(NULL, 0)
+  "nkit4py.Var2XmlSerializer", /*tp_name*/
+  sizeof(Var2XmlSerializerData), /*tp_basicsize*/
+  0, /*tp_itemsize*/
+  DeleteVar2XmlSerializer, /*tp_dealloc*/
+  0, /*tp_print*/
+  0, /*tp_getattr*/
+  0, /*tp_setattr*/
+  0, /*tp_compare*/
+  0, /*tp_repr*/
+  0, /*tp_as_number*/
+  0, /*tp_as_sequence*/
+  0, /*tp_as_mapping*/
+  0, /*tp_hash */
+  0, /*tp_call*/
+  0, /*tp_str*/
+  0, /*tp_getattro*/
+  0, /*tp_setattro*/
+  0, /*tp_as_buffer*/
+  Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE, /*tp_flags*/
+  "Object to XML converter with precompiled options", /* tp_doc */
+  0,//tp_traverse
+  0,//tp_clear,
+  0,//tp_richcompare,
+  0,//tp_weaklistoffset,
+  0,//tp_iter,
+  0,//tp_iternext,
+  var2xml_serializer_methods,//tp_methods,
+  0,//tp_members,
+  0,//tp_getset,
+  0,//tp_base,
+  0,//tp_dict,
+  0,//tp_descr_get,
+  0,//tp_descr_set,
+  0,//tp_dictoffset,
+  0,//tp_init,
+  0,//tp_alloc,
+  CreateVar2XmlSerializer,//tp_new,
+};
 
-  return (PyObject *)self;
-}
+////----------------------------------------------------------------------------
+/// Writes var2xml output blocks to file descriptor, to object with 'write'
+/// method or to callable
+class PythonXmlSink: public nkit::Var2XmlSink
+{
+public:
+  PythonXmlSink(bool unicode)
+    : fd_(-1)
+    , callable_(NULL)
+    , unicode_(unicode)
+  {}
+
+  ~PythonXmlSink()
+  {
+    Py_XDECREF(callable_);
+  }
+
+  bool SetTarget(PyObject * target)
+  {
+    if (PyInt_Check(target) || PyLong_Check(target))
+    {
+      long fd = PyInt_AsLong(target);
+      if (fd < 0)
+      {
+        if (!PyErr_Occurred())
+          PyErr_SetString( Nkit4PyError, "Wrong file descriptor" );
+        return false;
+      }
+      fd_ = static_cast<int>(fd);
+    }
+    else if (PyObject_HasAttrString(target, "write"))
+      callable_ = PyObject_GetAttrString(target, "write");
+    else if (PyCallable_Check(target))
+    {
+      Py_INCREF(target);
+      callable_ = target;
+    }
+
+    if (fd_ < 0 && !callable_)
+    {
+      PyErr_SetString( Nkit4PyError,
+          "Target must be file descriptor, object with 'write' method"
+          " or callable" );
+      return false;
+    }
+    return true;
+  }
+
+  bool Write(const char * data, size_t size, std::string * error)
+  {
+    // e.g. dict changed size during iteration
+    if (PyErr_Occurred())
+    {
+      *error = "Error while reading data";
+      return false;
+    }
+
+    if (fd_ >= 0)
+      return WriteToFd(data, size, error);
+
+    if (!callable_)
+    {
+      *error = "Output target is cleared";
+      return false;
+    }
+
+    PyObject * chunk = unicode_ ?
+        PyUnicode_FromStringAndSize(data, size) :
+        PyBytes_FromStringAndSize(data, size);
+    if (!chunk)
+    {
+      *error = "Could not create output chunk";
+      return false;
+    }
+    PyObject * result = PyObject_CallFunctionObjArgs(callable_, chunk, NULL);
+    Py_DECREF(chunk);
+    if (!result)
+    {
+      *error = "Output target raised an exception";
+      return false;
+    }
+    Py_DECREF(result);
+    return true;
+  }
+
+  // garbage collector support for owners of sink
+  int Traverse(visitproc visit, void * arg)
+  {
+    Py_VISIT(callable_);
+    return 0;
+  }
+
+  void Clear()
+  {
+    Py_CLEAR(callable_);
+  }
+
+private:
+  bool WriteToFd(const char * block, size_t size, std::string * error)
+  {
+    // block belongs to serializer, which may be reached by other threads
+    // (XmlWriter.write()) as soon as the GIL is released, so the GIL is
+    // released only around writing of a private copy
+    fd_buffer_.assign(block, size);
+    const char * data = fd_buffer_.data();
+    int err = 0;
+    Py_BEGIN_ALLOW_THREADS
+    while (size)
+    {
+#if defined(NKIT_WINNT)
+      int written = _write(fd_, data, static_cast<unsigned>(size));
+#else
+      ssize_t written = ::write(fd_, data, size);
+#endif
+      if (written < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        err = errno;
+        break;
+      }
+      data += written;
+      size -= written;
+    }
+    Py_END_ALLOW_THREADS
+
+    if (err)
+    {
+      *error = strerror(err);
+      return false;
+    }
+    return true;
+  }
+
+private:
+  int fd_;
+  PyObject * callable_;
+  bool unicode_;
+  std::string fd_buffer_;
+};
 
 ////----------------------------------------------------------------------------
-static void DeleteMapXml2VarBuilder(PyObject * self)
+static PyObject * var2xml_to_method( PyObject * self, PyObject * args )
 {
-  SharedPtrHolder< nkit::MapXml2PythonBuilder > * ptr =
-        ((MapXml2PythonBuilderData *)self)->holder_;
-  if (ptr)
-    delete ptr;
-  self->ob_type->tp_free(self);
+  PyObject * target = NULL;
+  PyObject * data = NULL;
+  PyObject * options_dict = NULL;
+  int result = PyArg_ParseTuple( args, "OO|O", &target, &data, &options_dict);
+  if(!result)
+  {
+    PyErr_SetString( Nkit4PyError,
+        "Expected target (file descriptor, file-like object or callable),"
+        " any object and optional 'options' Dict" );
+    return NULL;
+  }
+
+  nkit::Dynamic op;
+  if (!parse_var2xml_options(options_dict, &op))
+    return NULL;
+
+  PythonXmlSink sink(var2xml_unicode(op));
+  if (!sink.SetTarget(target))
+    return NULL;
+
+  std::string error;
+  bool ok;
+  try
+  {
+    ok = nkit::Python2XmlConverter::Process(op, data, &sink, &error);
+  }
+  catch (...)
+  {
+    ok = false;
+    current_exception_to_error(&error);
+  }
+  if(!ok)
+  {
+    // keep exception raised by target
+    if (!PyErr_Occurred())
+      PyErr_SetString( Nkit4PyError, error.c_str() );
+    return NULL;
+  }
+  if (PyErr_Occurred())
+    return NULL;
+
+  Py_RETURN_NONE;
 }
 
 ////----------------------------------------------------------------------------
-static PyObject * map_feed_method( PyObject * self, PyObject * args )
+/// JSON is parsed to nkit::Dynamic and converted to XML without creating of
+/// Python objects and with GIL released
+static PyObject * json2xml_method( PyObject * self, PyObject * args )
 {
-  const char* request = NULL;
-  Py_ssize_t size = 0;
-  int result = PyArg_ParseTuple( args, "s#", &request, &size );
+  PyObject * json = NULL;
+  PyObject * options_dict = NULL;
+  int result = PyArg_ParseTuple( args, "O|O", &json, &options_dict);
   if(!result)
   {
-    PyErr_SetString( Nkit4PyError, "Expected string arguments" );
+    PyErr_SetString( Nkit4PyError,
+            "Expected JSON string and optional 'options' Dict" );
     return NULL;
   }
-  if( !request || !*request || !size )
+
+  const char * json_str = NULL;
+  Py_ssize_t json_size = 0;
+  if (PyStr_Check(json))
+    json_str = PyStr_AsUTF8AndSize(json, &json_size);
+  else if (PyBytes_Check(json))
+    PyBytes_AsStringAndSize(json, const_cast<char **>(&json_str), &json_size);
+  if (!json_str)
   {
-    PyErr_SetString(
-        Nkit4PyError, "Parameter must not be empty string" );
+    PyErr_Clear();
+    PyErr_SetString( Nkit4PyError, "JSON must be string or bytes" );
     return NULL;
   }
 
-  nkit::MapXml2PythonBuilder::Ptr builder =
-      ((MapXml2PythonBuilderData *)self)->holder_->ptr_;
+  nkit::Dynamic op;
+  if (!parse_var2xml_options(options_dict, &op))
+    return NULL;
 
-  std::string error("");
-  if(!builder->Feed( request, size, false, &error ))
+  std::string out, error;
+  nkit::Var2XmlOptions::Ptr options = nkit::Var2XmlOptions::Create(op, &error);
+  if(!options)
   {
     PyErr_SetString( Nkit4PyError, error.c_str() );
     return NULL;
   }
 
-  Py_RETURN_NONE;
+  bool ok;
+  Py_BEGIN_ALLOW_THREADS
+  try
+  {
+    nkit::Dynamic data = nkit::DynamicFromJson(json_str,
+        static_cast<size_t>(json_size), &error);
+    ok = error.empty() &&
+        nkit::Dynamic2XmlConverter::Process(options, data, &out, &error);
+  }
+  catch (...)
+  {
+    ok = false;
+    current_exception_to_error(&error);
+  }
+  Py_END_ALLOW_THREADS
+
+  if (!ok)
+  {
+    PyErr_SetString( Nkit4PyError, error.c_str() );
+    return NULL;
+  }
+
+  if (var2xml_unicode(op))
+    return PyUnicode_FromStringAndSize(out.data(), out.size());
+  else
+    return PyBytes_FromStringAndSize(out.data(), out.size());
 }
 
 ////----------------------------------------------------------------------------
-static PyObject * map_get_method( PyObject * self, PyObject * args )
+/// nkit4py.Dynamic is read-only view of nkit::Dynamic. Nested dicts, lists
+/// and tables stay in C++ and are wrapped when they are accessed, scalars
+/// are converted to Python objects on access
+struct DynamicData
 {
-  const char* mapping_name = NULL;
-  int result = PyArg_ParseTuple( args, "s", &mapping_name );
-  if(!result)
+  PyObject_HEAD;
+  nkit::Dynamic * value_;
+};
+
+extern PyTypeObject DynamicType;
+
+static PyObject * wrap_dynamic(const nkit::Dynamic & v)
+{
+  DynamicData * self = (DynamicData *)DynamicType.tp_alloc(&DynamicType, 0);
+  if (!self)
+    return NULL;
+  self->value_ = new nkit::Dynamic(v);
+  return (PyObject *)self;
+}
+
+static const nkit::Dynamic & dynamic_value(PyObject * self)
+{
+  return *((DynamicData *)self)->value_;
+}
+
+static nkit::Dynamic dynamic_table_row(const nkit::Dynamic & table,
+    size_t row)
+{
+  nkit::Dynamic result = nkit::Dynamic::Dict();
+  nkit::StringVector names = table.GetColumnNames();
+  for (size_t col = 0; col < names.size(); ++col)
+    result[names[col]] = table.GetCellValue(row, col);
+  return result;
+}
+
+static size_t dynamic_size(const nkit::Dynamic & v)
+{
+  return v.IsTable() ? v.height() : v.size();
+}
+
+/// 'deep' converts containers too, otherwise they are wrapped
+static PyObject * dynamic_to_python(const nkit::Dynamic & v, bool deep)
+{
+  switch (v.type())
   {
-    PyErr_SetString( Nkit4PyError, "Expected string argument" );
+  case nkit::detail::BOOL:
+    return PyBool_FromLong(v.GetSignedInteger() != 0);
+  case nkit::detail::INTEGER:
+    return PyLong_FromLongLong(v.GetSignedInteger());
+  case nkit::detail::UNSIGNED_INTEGER:
+    return PyLong_FromUnsignedLongLong(v.GetUnsignedInteger());
+  case nkit::detail::FLOAT:
+    return PyFloat_FromDouble(v.GetFloat());
+  case nkit::detail::STRING:
+  case nkit::detail::MONGODB_OID:
+    {
+      const std::string & str = v.GetConstString();
+      return PyUnicode_FromStringAndSize(str.data(), str.size());
+    }
+  case nkit::detail::DATE_TIME:
+    return PyDateTime_FromDateAndTime(v.year(), v.month(), v.day(),
+        v.hours(), v.minutes(), v.seconds(), v.microseconds());
+  case nkit::detail::LIST:
+  case nkit::detail::TABLE:
+    {
+      if (!deep)
+        return wrap_dynamic(v);
+      size_t size = dynamic_size(v);
+      PyObject * result = PyList_New(static_cast<Py_ssize_t>(size));
+      for (size_t i = 0; result && i < size; ++i)
+      {
+        PyObject * item = dynamic_to_python(
+            v.IsTable() ? dynamic_table_row(v, i) : v[i], true);
+        if (!item)
+        {
+          Py_CLEAR(result);
+          break;
+        }
+        PyList_SET_ITEM(result, static_cast<Py_ssize_t>(i), item);
+      }
+      return result;
+    }
+  case nkit::detail::DICT:
+    {
+      if (!deep)
+        return wrap_dynamic(v);
+      PyObject * result = PyDict_New();
+      nkit::Dynamic::DictConstIterator it = v.begin_d(), end = v.end_d();
+      for (; result && it != end; ++it)
+      {
+        PyObject * item = dynamic_to_python(it->second, true);
+        if (!item || PyDict_SetItemString(result, it->first.c_str(), item))
+          Py_CLEAR(result);
+        Py_XDECREF(item);
+      }
+      return result;
+    }
+  default:
+    Py_RETURN_NONE;
+  }
+}
+
+////----------------------------------------------------------------------------
+static PyObject * CreateDynamic(PyTypeObject *, PyObject * args, PyObject *)
+{
+  PyObject * data = NULL;
+  if(!PyArg_ParseTuple( args, "O", &data ))
+  {
+    PyErr_SetString( Nkit4PyError, "Expected any object" );
     return NULL;
   }
-  if( !mapping_name || !*mapping_name )
+
+  nkit::Dynamic value;
+  std::string error;
+  if (!nkit::py_to_dynamic(data, &value, &error))
   {
-    PyErr_SetString(
-        Nkit4PyError, "Mapping name must not be empty" );
+    PyErr_SetString( Nkit4PyError, error.c_str() );
     return NULL;
   }
+  return wrap_dynamic(value);
+}
 
-  nkit::MapXml2PythonBuilder::Ptr builder =
-      ((MapXml2PythonBuilderData *)self)->holder_->ptr_;
+static void DeleteDynamic(PyObject * self)
+{
+  delete ((DynamicData *)self)->value_;
+  self->ob_type->tp_free(self);
+}
 
-  PyObject * item = builder->var(mapping_name);
-  Py_INCREF(item);
+////----------------------------------------------------------------------------
+static Py_ssize_t dynamic_length(PyObject * self)
+{
+  const nkit::Dynamic & v = dynamic_value(self);
+  if (!v.IsDict() && !v.IsList() && !v.IsTable())
+  {
+    PyErr_SetString(PyExc_TypeError, "Dynamic scalar has no len()");
+    return -1;
+  }
+  return static_cast<Py_ssize_t>(dynamic_size(v));
+}
+
+static PyObject * dynamic_item(PyObject * self, Py_ssize_t index)
+{
+  const nkit::Dynamic & v = dynamic_value(self);
+  if (!v.IsList() && !v.IsTable())
+  {
+    PyErr_SetString(PyExc_TypeError, "Dynamic is not a list");
+    return NULL;
+  }
+
+  Py_ssize_t size = static_cast<Py_ssize_t>(dynamic_size(v));
+  if (index < 0)
+    index += size;
+  if (index < 0 || index >= size)
+  {
+    PyErr_SetString(PyExc_IndexError, "Dynamic index out of range");
+    return NULL;
+  }
+
+  size_t i = static_cast<size_t>(index);
+  return dynamic_to_python(v.IsTable() ? dynamic_table_row(v, i) : v[i],
+      false);
+}
+
+/// Returns NULL without exception if there is no such key
+static const nkit::Dynamic * dynamic_find(PyObject * self, PyObject * key)
+{
+  std::string str, error;
+  if ((!PyStr_Check(key) && !PyBytes_Check(key)) ||
+      !nkit::py_to_string(key, &str, &error))
+    return NULL;
+  const nkit::Dynamic * item = NULL;
+  if (!dynamic_value(self).Get(str, &item))
+    return NULL;
   return item;
 }
 
-////------------------------------------------------------------------------------
-static PyObject * map_end_method( PyObject * self, PyObject * /*args*/ )
+static PyObject * dynamic_subscript(PyObject * self, PyObject * key)
 {
-  nkit::MapXml2PythonBuilder::Ptr builder =
-          ((MapXml2PythonBuilderData *)self)->holder_->ptr_;
+  const nkit::Dynamic & v = dynamic_value(self);
+  if (!v.IsDict())
+  {
+    if (!PyIndex_Check(key))
+    {
+      PyErr_SetString(PyExc_TypeError, "Dynamic indices must be integers");
+      return NULL;
+    }
+    Py_ssize_t index = PyNumber_AsSsize_t(key, PyExc_IndexError);
+    if (index == -1 && PyErr_Occurred())
+      return NULL;
+    return dynamic_item(self, index);
+  }
 
-  std::string empty("");
-  std::string error("");
-  if(!builder->Feed( empty.c_str(), empty.size(), true, &error ))
+  const nkit::Dynamic * item = dynamic_find(self, key);
+  if (!item)
   {
-    PyErr_SetString( Nkit4PyError, error.c_str() );
+    PyErr_SetObject(PyExc_KeyError, key);
     return NULL;
   }
+  return dynamic_to_python(*item, false);
+}
 
-  nkit::StringList mapping_names(builder->mapping_names());
+static int dynamic_contains(PyObject * self, PyObject * value)
+{
+  const nkit::Dynamic & v = dynamic_value(self);
+  if (v.IsDict())
+    return dynamic_find(self, value) ? 1 : 0;
 
-  PyObject * result = PyDict_New();
-  nkit::StringList::const_iterator mapping_name = mapping_names.begin(),
-      end = mapping_names.end();
-  for (; mapping_name != end; ++mapping_name)
+  Py_ssize_t size = dynamic_length(self);
+  for (Py_ssize_t i = 0; i < size; ++i)
   {
-    PyObject * item = builder->var(*mapping_name);
-    PyDict_SetItemString(result, mapping_name->c_str(), item);
+    PyObject * item = dynamic_item(self, i);
+    if (!item)
+      return -1;
+    int eq = PyObject_RichCompareBool(item, value, Py_EQ);
+    Py_DECREF(item);
+    if (eq)
+      return eq;
+  }
+  return size < 0 ? -1 : 0;
+}
+
+static PyObject * dynamic_keys_method(PyObject * self, PyObject *)
+{
+  const nkit::Dynamic & v = dynamic_value(self);
+  if (!v.IsDict())
+  {
+    PyErr_SetString(PyExc_TypeError, "Dynamic is not a dict");
+    return NULL;
+  }
+
+  PyObject * result = PyList_New(static_cast<Py_ssize_t>(v.size()));
+  nkit::Dynamic::DictConstIterator it = v.begin_d(), end = v.end_d();
+  for (Py_ssize_t i = 0; result && it != end; ++it, ++i)
+  {
+    PyObject * key = PyUnicode_FromStringAndSize(it->first.data(),
+        it->first.size());
+    if (!key)
+      Py_CLEAR(result);
+    else
+      PyList_SET_ITEM(result, i, key);
   }
   return result;
 }
 
+static PyObject * dynamic_iter(PyObject * self)
+{
+  if (!dynamic_value(self).IsDict())
+    return PySeqIter_New(self);
+
+  PyObject * keys = dynamic_keys_method(self, NULL);
+  if (!keys)
+    return NULL;
+  PyObject * result = PyObject_GetIter(keys);
+  Py_DECREF(keys);
+  return result;
+}
+
+static PyObject * dynamic_get_method(PyObject * self, PyObject * args)
+{
+  PyObject * key = NULL;
+  PyObject * default_value = Py_None;
+  if (!PyArg_ParseTuple(args, "O|O", &key, &default_value))
+    return NULL;
+
+  const nkit::Dynamic * item = dynamic_value(self).IsDict() ?
+      dynamic_find(self, key) : NULL;
+  if (!item)
+  {
+    Py_INCREF(default_value);
+    return default_value;
+  }
+  return dynamic_to_python(*item, false);
+}
+
+static PyObject * dynamic_to_python_method(PyObject * self, PyObject *)
+{
+  return dynamic_to_python(dynamic_value(self), true);
+}
+
+static PyObject * dynamic_repr(PyObject * self)
+{
+  const nkit::Dynamic & v = dynamic_value(self);
+  std::string repr("<nkit4py.Dynamic ");
+  if (v.IsDict() || v.IsList() || v.IsTable())
+    repr += (v.IsDict() ? "dict" : v.IsList() ? "list" : "table") +
+        std::string(" of ") + nkit::string_cast(dynamic_size(v)) + " items>";
+  else
+    repr += v.GetString() + ">";
+  return PyStr_FromString(repr.c_str());
+}
+
 ////----------------------------------------------------------------------------
-static PyMethodDef map_xml2var_methods[] =
+static PyMethodDef dynamic_methods[] =
 {
-  { "feed", map_feed_method, METH_VARARGS, "Usage: builder.feed()\n"
-          "Invoke \"Feed\" function\n"
-          "Returns None\n" },
-  { "get", map_get_method, METH_VARARGS, "Usage: builder.get()\n"
-          "Returns result by mapping name\n" },
-  { "end", map_end_method, METH_VARARGS, "Usage: builder.end()\n"
-          "Returns Dict: results for all mappings\n" },
+  { "keys", dynamic_keys_method, METH_NOARGS,
+      "Usage: d.keys()\n"
+      "Returns list of dict keys\n" },
+  { "get", dynamic_get_method, METH_VARARGS,
+      "Usage: d.get(key[, default])\n"
+      "Returns dict value or 'default'\n" },
+  { "to_python", dynamic_to_python_method, METH_NOARGS,
+      "Usage: d.to_python()\n"
+      "Converts whole value to Python structure\n" },
   { NULL, NULL, 0, NULL } /* Sentinel */
 };
 
+static PySequenceMethods dynamic_as_sequence =
+{
+  dynamic_length, /*sq_length*/
+  0, /*sq_concat*/
+  0, /*sq_repeat*/
+  dynamic_item, /*sq_item*/
+  0, /*sq_slice*/
+  0, /*sq_ass_item*/
+  0, /*sq_ass_slice*/
+  dynamic_contains, /*sq_contains*/
+  0, /*sq_inplace_concat*/
+  0, /*sq_inplace_repeat*/
+};
+
+static PyMappingMethods dynamic_as_mapping =
+{
+  dynamic_length, /*mp_length*/
+  dynamic_subscript, /*mp_subscript*/
+  0, /*mp_ass_subscript*/
+};
+
 ////----------------------------------------------------------------------------
-static PyTypeObject MapXml2PythonBuilderType =
+PyTypeObject DynamicType =
 {
   PyVarObject_HEAD_INIT(NULL, 0)
-  "nkit4py.Xml2VarBuilder", /*tp_name*/
-  sizeof(MapXml2PythonBuilderData), /*tp_basicsize*/
+  "nkit4py.Dynamic", /*tp_name*/
+  sizeof(DynamicData), /*tp_basicsize*/
   0, /*tp_itemsize*/
-  DeleteMapXml2VarBuilder, /*tp_dealloc*/
+  DeleteDynamic, /*tp_dealloc*/
   0, /*tp_print*/
   0, /*tp_getattr*/
   0, /*tp_setattr*/
   0, /*tp_compare*/
-  0, /*tp_repr*/
+  dynamic_repr, /*tp_repr*/
   0, /*tp_as_number*/
-  0, /*tp_as_sequence*/
-  0, /*tp_as_mapping*/
+  &dynamic_as_sequence, /*tp_as_sequence*/
+  &dynamic_as_mapping, /*tp_as_mapping*/
   0, /*tp_hash */
   0, /*tp_call*/
   0, /*tp_str*/
   0, /*tp_getattro*/
   0, /*tp_setattro*/
   0, /*tp_as_buffer*/
-  Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE, /*tp_flags*/
-  "XML to object or list converter and filter", /* tp_doc */
+  Py_TPFLAGS_DEFAULT, /*tp_flags*/
+  "Read-only view of C++ data, converted to Python objects on access",
   0,//tp_traverse
   0,//tp_clear,
   0,//tp_richcompare,
   0,//tp_weaklistoffset,
-  0,//tp_iter,
+  dynamic_iter,//tp_iter,
   0,//tp_iternext,
-  map_xml2var_methods,//tp_methods,
+  dynamic_methods,//tp_methods,
   0,//tp_members,
   0,//tp_getset,
   0,//tp_base,
@@ -863,169 +3008,350 @@ static PyTypeObject MapXml2PythonBuilderType =
   0,//tp_dictoffset,
   0,//tp_init,
   0,//tp_alloc,
-  CreateMapXml2VarBuilder,//tp_new,
+  CreateDynamic,//tp_new,
 };
 
 ////----------------------------------------------------------------------------
-static PyObject* CreateAnyXml2VarBuilder(
-    PyTypeObject * type, PyObject * args, PyObject *)
+static bool get_text_argument(PyObject * text, const char ** str,
+    Py_ssize_t * size)
 {
-  PyObject * options_dict = NULL;
-  int result = PyArg_ParseTuple(args, "|O", &options_dict);
-  if(!result)
+  *str = NULL;
+  if (PyStr_Check(text))
+    *str = PyStr_AsUTF8AndSize(text, size);
+  else if (PyBytes_Check(text))
+    PyBytes_AsStringAndSize(text, const_cast<char **>(str), size);
+  if (!*str)
+    PyErr_Clear();
+  return *str != NULL;
+}
+
+static PyObject * dynamic_from_json_method( PyObject * self, PyObject * args )
+{
+  PyObject * json = NULL;
+  const char * json_str = NULL;
+  Py_ssize_t json_size = 0;
+  if (!PyArg_ParseTuple( args, "O", &json) ||
+      !get_text_argument(json, &json_str, &json_size))
   {
-    PyErr_SetString(Nkit4PyError,
-        "Expected one or two arguments:"
-        " 1) mappings or 2) options and mappings");
+    PyErr_Clear();
+    PyErr_SetString( Nkit4PyError, "JSON must be string or bytes" );
     return NULL;
   }
 
-  std::string options, error;
-  if (!options_dict)
-    options = "{}";
-  else if (!parse_dict(options_dict, &options, &error))
+  std::string error;
+  nkit::Dynamic data;
+  Py_BEGIN_ALLOW_THREADS
+  data = nkit::DynamicFromJson(json_str, static_cast<size_t>(json_size),
+      &error);
+  Py_END_ALLOW_THREADS
+
+  if (!error.empty())
   {
-    PyErr_SetString( Nkit4PyError,
-        ("Options parameter must be JSON-string or dictionary: " +
-        error).c_str());
+    PyErr_SetString( Nkit4PyError, error.c_str() );
     return NULL;
   }
+  return wrap_dynamic(data);
+}
 
-  if (options.empty())
+static PyObject * dynamic_from_xml_method( PyObject * self, PyObject * args )
+{
+  typedef nkit::StructXml2VarBuilder<nkit::DynamicBuilder> Builder;
+
+  PyObject * xml = NULL;
+  PyObject * dict1 = NULL;
+  PyObject * dict2 = NULL;
+  if (!PyArg_ParseTuple( args, "OO|O", &xml, &dict1, &dict2))
   {
-    PyErr_SetString(
-        Nkit4PyError,
-        "Options parameter must be dict or JSON object" );
+    PyErr_Clear();
+    PyErr_SetString( Nkit4PyError,
+        "Expected XML string and 1) mappings or 2) options and mappings" );
     return NULL;
   }
 
-  AnyXml2PythonBuilderData * self =
-      (AnyXml2PythonBuilderData *)type->tp_alloc( type, 0 );
-  if (!self)
+  const char * xml_str = NULL;
+  Py_ssize_t xml_size = 0;
+  if (!get_text_argument(xml, &xml_str, &xml_size))
   {
-    PyErr_SetString(Nkit4PyError, "Low memory");
+    PyErr_SetString( Nkit4PyError, "XML must be string or bytes" );
     return NULL;
   }
 
-  nkit::AnyXml2PythonBuilder::Ptr builder =
-      nkit::AnyXml2PythonBuilder::Create(options, &error);
-  if(!builder)
+  nkit::Dynamic options, mappings;
+  if (!parse_options_and_mappings(dict1, dict2, &options, &mappings))
+    return NULL;
+
+  std::string error;
+  Builder::Ptr builder = Builder::Create(options, mappings, &error);
+  if (!builder)
   {
     PyErr_SetString( Nkit4PyError, error.c_str() );
     return NULL;
   }
 
-  self->holder_ =
-      new SharedPtrHolder< nkit::AnyXml2PythonBuilder >(builder);
+  bool ok;
+  nkit::Dynamic result = nkit::Dynamic::Dict();
+  Py_BEGIN_ALLOW_THREADS
+  ok = builder->Feed(xml_str, static_cast<size_t>(xml_size), true, &error);
+  if (ok)
+  {
+    nkit::StringList mapping_names(builder->mapping_names());
+    nkit::StringList::const_iterator mapping_name = mapping_names.begin(),
+        end = mapping_names.end();
+    for (; mapping_name != end; ++mapping_name)
+      result[*mapping_name] = builder->var(*mapping_name);
+  }
+  Py_END_ALLOW_THREADS
 
-  return (PyObject *)self;
+  if (!ok)
+  {
+    PyErr_SetString( Nkit4PyError, error.c_str() );
+    return NULL;
+  }
+  return wrap_dynamic(result);
 }
 
 ////----------------------------------------------------------------------------
-static void DeleteAnyXml2VarBuilder(PyObject * self)
+struct XmlWriterData
 {
-  SharedPtrHolder< nkit::AnyXml2PythonBuilder > * ptr =
-        ((AnyXml2PythonBuilderData *)self)->holder_;
-  if (ptr)
-    delete ptr;
-  self->ob_type->tp_free(self);
-}
+  PyObject_HEAD;
+  SharedPtrHolder<nkit::Python2XmlConverter> * holder_;
+  PythonXmlSink * sink_;
+  bool unicode_;
+  // set while begin(), write() or end() is running: target callback or
+  // other thread (when output goes to file descriptor) must not reenter
+  bool busy_;
+};
 
 ////----------------------------------------------------------------------------
-static PyObject * any_feed_method( PyObject * self, PyObject * args )
+static PyObject* CreateXmlWriter(
+    PyTypeObject * type, PyObject * args, PyObject *)
 {
-  const char* request = NULL;
-  Py_ssize_t size = 0;
-  int result = PyArg_ParseTuple( args, "s#", &request, &size );
+  PyObject * options_dict = NULL;
+  PyObject * target = NULL;
+  int result = PyArg_ParseTuple(args, "|OO", &options_dict, &target);
   if(!result)
   {
-    PyErr_SetString( Nkit4PyError, "Expected string arguments" );
+    PyErr_SetString(Nkit4PyError,
+        "Expected optional 'options' Dict and optional target"
+        " (file descriptor, file-like object or callable)");
     return NULL;
   }
-  if( !request || !*request || !size )
-  {
-    PyErr_SetString(
-        Nkit4PyError, "Parameter must not be empty string" );
+
+  nkit::Dynamic op;
+  if (options_dict == Py_None)
+    options_dict = NULL;
+  if (!parse_var2xml_options(options_dict, &op))
     return NULL;
-  }
 
-  nkit::AnyXml2PythonBuilder::Ptr builder =
-      ((AnyXml2PythonBuilderData *)self)->holder_->ptr_;
+  bool unicode = var2xml_unicode(op);
+  PythonXmlSink * sink = NULL;
+  if (target && target != Py_None)
+  {
+    sink = new PythonXmlSink(unicode);
+    if (!sink->SetTarget(target))
+    {
+      delete sink;
+      return NULL;
+    }
+  }
 
-  std::string error("");
-  if(!builder->Feed( request, size, false, &error ))
+  std::string error;
+  nkit::Python2XmlConverter::Ptr writer =
+      nkit::Python2XmlConverter::Create(op, sink, &error);
+  if(!writer)
   {
+    delete sink;
     PyErr_SetString( Nkit4PyError, error.c_str() );
     return NULL;
   }
 
-  Py_RETURN_NONE;
+  XmlWriterData * self = (XmlWriterData *)type->tp_alloc( type, 0 );
+  if (!self)
+  {
+    delete sink;
+    PyErr_SetString(Nkit4PyError, "Low memory");
+    return NULL;
+  }
+
+  self->holder_ = new SharedPtrHolder< nkit::Python2XmlConverter >(writer);
+  self->sink_ = sink;
+  self->unicode_ = unicode;
+  self->busy_ = false;
+
+  return (PyObject *)self;
 }
 
 ////----------------------------------------------------------------------------
-static PyObject * any_get_method( PyObject * self, PyObject * args )
+static int TraverseXmlWriter(PyObject * self, visitproc visit, void * arg)
 {
-  nkit::AnyXml2PythonBuilder::Ptr builder =
-      ((AnyXml2PythonBuilderData *)self)->holder_->ptr_;
+  XmlWriterData * data = (XmlWriterData *)self;
+  if (data->sink_)
+    return data->sink_->Traverse(visit, arg);
+  return 0;
+}
 
-  PyObject * item = builder->var();
-  Py_INCREF(item);
-  return item;
+static int ClearXmlWriter(PyObject * self)
+{
+  XmlWriterData * data = (XmlWriterData *)self;
+  if (data->sink_)
+    data->sink_->Clear();
+  return 0;
 }
 
-////------------------------------------------------------------------------------
-static PyObject * any_end_method( PyObject * self, PyObject * /*args*/ )
+static void DeleteXmlWriter(PyObject * self)
 {
-  nkit::AnyXml2PythonBuilder::Ptr builder =
-          ((AnyXml2PythonBuilderData *)self)->holder_->ptr_;
+  PyObject_GC_UnTrack(self);
+  XmlWriterData * data = (XmlWriterData *)self;
+  if (data->holder_)
+    delete data->holder_;
+  if (data->sink_)
+    delete data->sink_;
+  self->ob_type->tp_free(self);
+}
 
-  std::string empty("");
-  std::string error("");
-  if(!builder->Feed( empty.c_str(), empty.size(), true, &error ))
+////----------------------------------------------------------------------------
+/// Returns None if writer has target, otherwise XML fragment produced by
+/// last call
+static bool xml_writer_acquire(XmlWriterData * self)
+{
+  if (self->busy_)
   {
-    PyErr_SetString( Nkit4PyError, error.c_str() );
+    PyErr_SetString( Nkit4PyError,
+        "XmlWriter is already in use by other call" );
+    return false;
+  }
+  self->busy_ = true;
+  return true;
+}
+
+static PyObject * xml_writer_result(XmlWriterData * self, bool ok,
+    const std::string & error)
+{
+  self->busy_ = false;
+  if (!ok)
+  {
+    // keep exception raised by target
+    if (!PyErr_Occurred())
+      PyErr_SetString( Nkit4PyError, error.c_str() );
     return NULL;
   }
 
-  PyObject * item = builder->var();
-  Py_INCREF(item);
-  return item;
+  if (self->sink_)
+    Py_RETURN_NONE;
+
+  std::string out;
+  self->holder_->ptr_->TakeOutput(&out);
+  if (self->unicode_)
+    return PyUnicode_FromStringAndSize(out.data(), out.size());
+  else
+    return PyBytes_FromStringAndSize(out.data(), out.size());
 }
 
 ////----------------------------------------------------------------------------
-static PyObject * any_root_name_method( PyObject * self, PyObject * args )
+static PyObject * xml_writer_begin_method( PyObject * self, PyObject * args )
 {
-  nkit::AnyXml2PythonBuilder::Ptr builder =
-      ((AnyXml2PythonBuilderData *)self)->holder_->ptr_;
+  const char * root_name = NULL;
+  if(!PyArg_ParseTuple( args, "|z", &root_name ))
+  {
+    PyErr_SetString( Nkit4PyError, "Expected optional root element name" );
+    return NULL;
+  }
 
-  const std::string & root_name = builder->root_name();
-  return PyStr_FromString(root_name.c_str());
+  XmlWriterData * data = (XmlWriterData *)self;
+  if (!xml_writer_acquire(data))
+    return NULL;
+  std::string error;
+  bool ok;
+  try
+  {
+    ok = data->holder_->ptr_->Begin(
+        root_name ? std::string(root_name) : nkit::S_EMPTY_, &error);
+  }
+  catch (...)
+  {
+    ok = false;
+    current_exception_to_error(&error);
+  }
+  return xml_writer_result(data, ok, error);
 }
 
 ////----------------------------------------------------------------------------
-static PyMethodDef any_xml2var_methods[] =
+static PyObject * xml_writer_write_method( PyObject * self, PyObject * args )
 {
-  { "feed", any_feed_method, METH_VARARGS, "Usage: builder.feed()\n"
-          "Invoke \"Feed\" function\n"
-          "Returns None\n" },
-  { "get", any_get_method, METH_VARARGS, "Usage: builder.get()\n"
-          "Returns result\n" },
-  { "end", any_end_method, METH_VARARGS, "Usage: builder.end()\n"
-          "Returns result\n" },
-  { "root_name", any_root_name_method, METH_VARARGS,
-      "Usage: builder.root_name()\n"
-      "Returns root element name\n" },
+  PyObject * item = NULL;
+  const char * name = NULL;
+  if(!PyArg_ParseTuple( args, "O|s", &item, &name ))
+  {
+    PyErr_SetString( Nkit4PyError,
+        "Expected any object and optional element name" );
+    return NULL;
+  }
+
+  XmlWriterData * data = (XmlWriterData *)self;
+  if (!xml_writer_acquire(data))
+    return NULL;
+  std::string error;
+  bool ok;
+  try
+  {
+    ok = name ?
+        data->holder_->ptr_->Write(std::string(name), item, &error) :
+        data->holder_->ptr_->Write(item, &error);
+  }
+  catch (...)
+  {
+    ok = false;
+    current_exception_to_error(&error);
+  }
+  return xml_writer_result(data, ok, error);
+}
+
+////----------------------------------------------------------------------------
+static PyObject * xml_writer_end_method( PyObject * self, PyObject * )
+{
+  XmlWriterData * data = (XmlWriterData *)self;
+  if (!xml_writer_acquire(data))
+    return NULL;
+  std::string error;
+  bool ok;
+  try
+  {
+    ok = data->holder_->ptr_->End(&error);
+  }
+  catch (...)
+  {
+    ok = false;
+    current_exception_to_error(&error);
+  }
+  return xml_writer_result(data, ok, error);
+}
+
+////----------------------------------------------------------------------------
+static PyMethodDef xml_writer_methods[] =
+{
+  { "begin", xml_writer_begin_method, METH_VARARGS,
+      "Usage: writer.begin([rootname])\n"
+      "Writes xml declaration and opens root element\n"
+      "Returns XML fragment or None if writer has target\n" },
+  { "write", xml_writer_write_method, METH_VARARGS,
+      "Usage: writer.write(item[, name])\n"
+      "Converts one item to element named 'name' or 'itemname' option\n"
+      "Returns XML fragment or None if writer has target\n" },
+  { "end", xml_writer_end_method, METH_NOARGS,
+      "Usage: writer.end()\n"
+      "Closes root element and flushes output to target\n"
+      "Returns XML fragment or None if writer has target\n" },
   { NULL, NULL, 0, NULL } /* Sentinel */
 };
 
 ////----------------------------------------------------------------------------
-static PyTypeObject AnyXml2PythonBuilderType =
+static PyTypeObject XmlWriterType =
 {
   PyVarObject_HEAD_INIT(NULL, 0)
-  "nkit4py.AnyXml2VarBuilder", /*tp_name*/
-  sizeof(AnyXml2PythonBuilderData), /*tp_basicsize*/
+  "nkit4py.XmlWriter", /*tp_name*/
+  sizeof(XmlWriterData), /*tp_basicsize*/
   0, /*tp_itemsize*/
-  DeleteAnyXml2VarBuilder, /*tp_dealloc*/
+  DeleteXmlWriter, /*tp_dealloc*/
   0, /*tp_print*/
   0, /*tp_getattr*/
   0, /*tp_setattr*/
@@ -1040,15 +3366,15 @@ static PyTypeObject AnyXml2PythonBuilderType =
   0, /*tp_getattro*/
   0, /*tp_setattro*/
   0, /*tp_as_buffer*/
-  Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE, /*tp_flags*/
-  "XML to object or list converter and filter", /* tp_doc */
-  0,//tp_traverse
-  0,//tp_clear,
+  Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_HAVE_GC, /*tp_flags*/
+  "Incremental object to XML writer", /* tp_doc */
+  TraverseXmlWriter,//tp_traverse
+  ClearXmlWriter,//tp_clear,
   0,//tp_richcompare,
   0,//tp_weaklistoffset,
   0,//tp_iter,
   0,//tp_iternext,
-  any_xml2var_methods,//tp_methods,
+  xml_writer_methods,//tp_methods,
   0,//tp_members,
   0,//tp_getset,
   0,//tp_base,
@@ -1058,57 +3384,9 @@ static PyTypeObject AnyXml2PythonBuilderType =
   0,//tp_dictoffset,
   0,//tp_init,
   0,//tp_alloc,
-  CreateAnyXml2VarBuilder,//tp_new,
+  CreateXmlWriter,//tp_new,
 };
 
-////----------------------------------------------------------------------------
-static PyObject * var2xml_method( PyObject * self, PyObject * args )
-{
-  PyObject * data = NULL;
-  PyObject * options_dict = NULL;
-  int result = PyArg_ParseTuple( args, "O|O", &data, &options_dict);
-  if(!result)
-  {
-    PyErr_SetString( Nkit4PyError,
-            "Expected any object and optional 'options' Dict" );
-    return NULL;
-  }
-
-  std::string options, error;
-  nkit::Dynamic op = nkit::Dynamic::Dict();
-  if (options_dict && !parse_dict(options_dict, &options, &error))
-  {
-    std::string tmp("Options parameter must be JSON-string or dictionary: " +
-            error);
-    PyErr_SetString( Nkit4PyError, tmp.c_str());
-    return NULL;
-  }
-  else if (!options.empty())
-  {
-    op = nkit::DynamicFromJson(options, &error);
-    if (!op && !error.empty())
-    {
-      std::string tmp("Options parameter must be JSON-string or dictionary: " +
-              error);
-      PyErr_SetString( Nkit4PyError, tmp.c_str());
-      return NULL;
-    }
-  }
-
-  std::string out;
-  if(!nkit::Python2XmlConverter::Process(op, data, &out, &error))
-  {
-    PyErr_SetString( Nkit4PyError, error.c_str() );
-    return NULL;
-  }
-
-  const nkit::Dynamic * unicode = NULL;
-  if (op.Get("unicode", &unicode) && unicode->GetBoolean())
-    return PyUnicode_FromStringAndSize(out.data(), out.size());
-  else
-    return PyBytes_FromStringAndSize(out.data(), out.size());
-}
-
 ////----------------------------------------------------------------------------
 static PyMethodDef ModuleMethods[] =
 {
@@ -1116,6 +3394,23 @@ static PyMethodDef ModuleMethods[] =
           "Usage: nkit4py.var2xml(data, options)\n"
           "Converts python structure to xml string\n"
           "Returns None\n" },
+  { "var2xml_to", var2xml_to_method, METH_VARARGS,
+          "Usage: nkit4py.var2xml_to(target, data, options)\n"
+          "Converts python structure to xml and writes it block by block\n"
+          "to target: file descriptor, object with 'write' method or callable\n"
+          "Returns None\n" },
+  { "json2xml", json2xml_method, METH_VARARGS,
+          "Usage: nkit4py.json2xml(json, options)\n"
+          "Converts JSON string to xml string without creating Python objects\n"
+          "Returns XML string\n" },
+  { "dynamic_from_json", dynamic_from_json_method, METH_VARARGS,
+          "Usage: nkit4py.dynamic_from_json(json)\n"
+          "Parses JSON string without creating Python objects\n"
+          "Returns nkit4py.Dynamic\n" },
+  { "dynamic_from_xml", dynamic_from_xml_method, METH_VARARGS,
+          "Usage: nkit4py.dynamic_from_xml(xml, [options,] mappings)\n"
+          "Applies mappings to XML string without creating Python objects\n"
+          "Returns nkit4py.Dynamic: results for all mappings\n" },
   { NULL, NULL, 0, NULL } /* Sentinel */
 };
 
@@ -1174,12 +3469,27 @@ namespace nkit
 ////----------------------------------------------------------------------------
 MODULE_INIT_FUNC(nkit4py)
 {
+  if( -1 == PyType_Ready(&XmlBufferType) )
+    return NULL;
+
   if( -1 == PyType_Ready(&MapXml2PythonBuilderType) )
     return NULL;
 
   if( -1 == PyType_Ready(&AnyXml2PythonBuilderType) )
     return NULL;
 
+  if( -1 == PyType_Ready(&Json2PythonBuilderType) )
+    return NULL;
+
+  if( -1 == PyType_Ready(&XmlWriterType) )
+    return NULL;
+
+  if( -1 == PyType_Ready(&Var2XmlSerializerType) )
+    return NULL;
+
+  if( -1 == PyType_Ready(&DynamicType) )
+    return NULL;
+
   PyObject * module = PyModule_Create(&moduledef);
   if( NULL == module )
     return NULL;
@@ -1196,6 +3506,20 @@ MODULE_INIT_FUNC(nkit4py)
   PyModule_AddObject( module,
           "AnyXml2VarBuilder", (PyObject *)&AnyXml2PythonBuilderType );
 
+  Py_INCREF(&Json2PythonBuilderType);
+  PyModule_AddObject( module,
+          "Json2VarBuilder", (PyObject *)&Json2PythonBuilderType );
+
+  Py_INCREF(&XmlWriterType);
+  PyModule_AddObject( module, "XmlWriter", (PyObject *)&XmlWriterType );
+
+  Py_INCREF(&Var2XmlSerializerType);
+  PyModule_AddObject( module,
+          "Var2XmlSerializer", (PyObject *)&Var2XmlSerializerType );
+
+  Py_INCREF(&DynamicType);
+  PyModule_AddObject( module, "Dynamic", (PyObject *)&DynamicType );
+
   nkit::traceback_module_ = PyImport_ImportModule("traceback");
   assert(nkit::traceback_module_);
   Py_INCREF(nkit::traceback_module_);
@@ -1,12 +1,17 @@
 #!/usr/bin/env python
 # -*- coding: utf-8 -*-
 
-from nkit4py import Xml2VarBuilder, AnyXml2VarBuilder, DatetimeJSONEncoder, var2xml
+from nkit4py import Xml2VarBuilder, AnyXml2VarBuilder, DatetimeJSONEncoder, var2xml, var2xml_to, \
+    XmlWriter, Var2XmlSerializer, json2xml, Json2VarBuilder, Dynamic, dynamic_from_json, \
+    dynamic_from_xml
 import json
 from datetime import *
 
+import collections
+import io
 import os
 import sys
+import tempfile
 import unittest
 try:
     from collections import OrderedDict
@@ -486,6 +491,190 @@ def test_xml2var_attribute_as_key():
     assert result[0]["ARTIST"] == "Bob Dylan"
     assert result[1]["YEAR"] == "1988"
     
+# ------------------------------------------------------------------------------
+# ------------------------------------------------------------------------------
+def test_xml2var_parse_buffer():
+    sample_path = os.path.join(NKIT_TEST_DATA_PATH, 'sample.xml')
+    mappings = {"phones": list_of_list_of_strings_mapping}
+
+    builder = Xml2VarBuilder(mappings)
+    builder.feed(read_file_text(sample_path))
+    etalon = builder.end()
+
+    builder = Xml2VarBuilder(mappings)
+    f = open(sample_path, 'rb')
+    while True:
+        buf = builder.get_buffer(16)
+        size = f.readinto(buf)
+        builder.parse_buffer(size)
+        if not size:
+            break
+    f.close()
+    result = builder.end()
+    if result != etalon:
+        print_json(result)
+        print_json(etalon)
+        raise Exception("Error #5.1")
+
+    any_builder = AnyXml2VarBuilder()
+    buf = any_builder.get_buffer(64)
+    xml = b"<root><a>1</a></root>"
+    view = memoryview(buf)
+    view[:len(xml)] = xml
+    # parser's memory can't be replaced while it is exported
+    for call in (lambda: any_builder.get_buffer(64),
+                 lambda: any_builder.feed("<a/>"),
+                 lambda: any_builder.end(),
+                 lambda: any_builder.parse_buffer(len(xml), True)):
+        try:
+            call()
+        except Exception:
+            pass
+        else:
+            raise Exception("Error #5.3")
+    view.release()
+    any_builder.parse_buffer(len(xml), True)
+    assert any_builder.root_name() == "root"
+
+    # buffer is not usable after parse_buffer()
+    try:
+        memoryview(buf)
+    except Exception:
+        pass
+    else:
+        raise Exception("Error #5.4")
+
+    # buffer keeps builder alive
+    any_builder = AnyXml2VarBuilder()
+    buf = any_builder.get_buffer(64)
+    del any_builder
+    view = memoryview(buf)
+    view[:3] = b"abc"
+    assert bytes(view[:3]) == b"abc"
+    view.release()
+    del buf
+
+    any_builder = AnyXml2VarBuilder()
+    try:
+        any_builder.parse_buffer(1)
+    except Exception:
+        pass
+    else:
+        raise Exception("Error #5.2")
+
+# ------------------------------------------------------------------------------
+# ------------------------------------------------------------------------------
+def test_xml2var_expat_options():
+    xml = '<!DOCTYPE a [<!ENTITY x "y">]><a>&x;</a>'
+    builder = AnyXml2VarBuilder({"entities": False})
+    try:
+        builder.feed(xml)
+        builder.end()
+    except Exception:
+        pass
+    else:
+        raise Exception("Error #5.3")
+
+    builder = AnyXml2VarBuilder({"ns_separator": " "})
+    builder.feed('<r xmlns="urn:r"><a>1</a></r>')
+    result = builder.end()
+    assert builder.root_name() == "urn:r r"
+    assert result["urn:r a"] == ["1"]
+
+# ------------------------------------------------------------------------------
+# ------------------------------------------------------------------------------
+def test_xml2var_fast_lane():
+    sample = read_file_text(os.path.join(NKIT_TEST_DATA_PATH, 'sample.xml'))
+    mappings = {"persons": ["/person", {"/*": "string",
+                                        "/married/@firstTime": "string"}]}
+
+    builder = Xml2VarBuilder({"trim": True}, mappings)
+    builder.feed(sample)
+    etalon = builder.end()
+
+    builder = Xml2VarBuilder({"trim": True, "fast_lane": True}, mappings)
+    builder.feed(sample)
+    result = builder.end()
+    if result != etalon:
+        print_json(result)
+        print_json(etalon)
+        raise Exception("Error #5.4")
+
+# ------------------------------------------------------------------------------
+# ------------------------------------------------------------------------------
+def test_xml2var_legacy_encodings():
+    texts = {"Shift_JIS": "日本語のテキスト",
+             "EUC-JP": "日本語のテキスト",
+             "GB18030": "中文文本",
+             "Big5": "中文文本",
+             "EUC-KR": "한국어 텍스트"}
+    for encoding, text in texts.items():
+        xml = '<?xml version="1.0" encoding="%s"?>' \
+              '<a><b attr="%s">%s</b><b>%s</b></a>' % (encoding, text, text,
+                                                     text * 100)
+        builder = AnyXml2VarBuilder({"trim": True})
+        builder.feed(xml[xml.find("?>") + 2:])
+        etalon = builder.end()
+
+        data = xml.encode(encoding)
+        builder = AnyXml2VarBuilder({"trim": True})
+        for i in range(0, len(data), 3):
+            builder.feed(data[i:i + 3])
+        result = builder.end()
+        if result != etalon:
+            print_json(result)
+            print_json(etalon)
+            raise Exception("Error #5.5 (%s)" % encoding)
+
+# ------------------------------------------------------------------------------
+# ------------------------------------------------------------------------------
+def test_json2var():
+    data = {"persons": [{"name": "Джек", "age": 33, "phones": ["1", "2"],
+                         "skip": {"a": [[1, 2], {"b": None}]}},
+                        {"name": "Boris", "age": 34, "phones": [],
+                         "address": {"city": "Moscow"}}],
+            "total": 2}
+    mappings = {"persons": ["/persons", {"/name": "string",
+                                         "/age": "integer",
+                                         "/address/city -> city":
+                                             "string|none"}],
+                "phones": ["/persons/phones", "string"],
+                "total": {"/total": "integer"}}
+    etalon = {"persons": [{"name": "Джек", "age": 33, "city": "none"},
+                          {"name": "Boris", "age": 34, "city": "Moscow"}],
+              "phones": ["1", "2"],
+              "total": {"total": 2}}
+
+    # JSON is mapped the same way as XML produced by var2xml
+    builder = Xml2VarBuilder(mappings)
+    builder.feed(var2xml(data, {"rootname": "root"}))
+    assert builder.end() == etalon
+
+    text = json.dumps(data, ensure_ascii=False).encode("utf-8")
+    for chunk_size in (len(text), 5, 1):
+        builder = Json2VarBuilder({"trim": True}, mappings)
+        for i in range(0, len(text), chunk_size):
+            builder.feed(text[i:i + chunk_size])
+        result = builder.end()
+        if result != etalon:
+            print_json(result)
+            print_json(etalon)
+            raise Exception("Error #5.6")
+        assert builder.get("phones") == ["1", "2"]
+
+    builder = Json2VarBuilder({"ids": ["/item/id", "integer"]})
+    builder.feed('[{"id": 1}, {"id": 2}]')
+    assert builder.end() == {"ids": [1, 2]}
+
+    builder = Json2VarBuilder({"ids": ["/item/id", "integer"]})
+    try:
+        builder.feed('[{"id": 1}, {"id" 2}]')
+        builder.end()
+    except Exception:
+        pass
+    else:
+        raise Exception("Error #5.7")
+
 # ------------------------------------------------------------------------------
 # ------------------------------------------------------------------------------
 def test_var2xml():
@@ -588,5 +777,399 @@ def test_var2xml():
         raise Exception("Error #6.3")
 
 
+
+# ------------------------------------------------------------------------------
+# ------------------------------------------------------------------------------
+def test_var2xml_to():
+    data = [{"id": i, "name": "name & < >", "ok": True} for i in range(1000)]
+    options = {
+        "rootname": "ROOT",
+        "pretty": {"indent": "  ", "newline": "\n"},
+        "buffer_size": 1024
+    }
+    etalon = var2xml(data, options)
+
+    stream = io.BytesIO()
+    var2xml_to(stream, data, options)
+    assert stream.getvalue() == etalon
+
+    chunks = []
+    var2xml_to(chunks.append, data, options)
+    assert len(chunks) > 1
+    assert b"".join(chunks) == etalon
+
+    fd, path = tempfile.mkstemp()
+    try:
+        var2xml_to(fd, data, options)
+        os.close(fd)
+        assert open(path, 'rb').read() == etalon
+    finally:
+        os.remove(path)
+
+    # list is changed by write callback in the middle of traversal
+    mutable = list(data)
+    chunks = []
+    def clearing_write(chunk):
+        chunks.append(chunk)
+        del mutable[:]
+    var2xml_to(clearing_write, mutable, options)
+    # items are read from live list: traversal stops early, output is closed
+    result = b"".join(chunks)
+    assert len(result) < len(etalon)
+    assert result.rstrip().endswith(etalon.rstrip().splitlines()[-1])
+
+    # values are removed from dict in the middle of traversal
+    mutable = {"a": ["x%d" % i for i in range(2000)], "b": ["y"] * 10}
+    def clearing_dict_write(chunk):
+        mutable.clear()
+    try:
+        var2xml_to(clearing_dict_write, mutable, options)
+    except RuntimeError:
+        pass
+    else:
+        raise Exception("Error #6.11")
+
+    def failing_write(chunk):
+        raise ValueError("test")
+    try:
+        var2xml_to(failing_write, data, options)
+    except ValueError:
+        pass
+    else:
+        raise Exception("Error #6.4")
+
+
+def test_xml_writer():
+    data = [{"id": i, "name": "name & < >", "$": {"n": i}} for i in range(300)]
+    options = {
+        "rootname": "ROOT",
+        "itemname": "record",
+        "xmldec": {"version": "1.0"},
+        "pretty": {"indent": "  ", "newline": "\n"},
+        "cdata": ["name"],
+        "encoding": "windows-1251",
+        "buffer_size": 1024
+    }
+    etalon = var2xml(data, options)
+
+    def records():
+        for item in data:
+            yield item
+
+    stream = io.BytesIO()
+    writer = XmlWriter(options, stream)
+    assert writer.begin() is None
+    for item in records():
+        writer.write(item)
+    writer.end()
+    assert stream.getvalue() == etalon
+
+    writer = XmlWriter({"itemname": "i", "unicode": True})
+    fragments = [writer.begin("R"), writer.write([1, 2], "x"),
+                 writer.write({"a": "b"}), writer.end()]
+    assert fragments == ["<R>", "<x>1</x><x>2</x>", "<i><a>b</a></i>", "</R>"]
+
+    try:
+        writer.write(1)
+    except Exception:
+        pass
+    else:
+        raise Exception("Error #6.5")
+
+    # reentrance from target callback
+    def reentering_write(chunk):
+        writer.write(2)
+    writer = XmlWriter({"rootname": "R", "buffer_size": 1}, reentering_write)
+    try:
+        writer.begin()
+    except Exception as e:
+        assert "in use" in str(e), e
+    else:
+        raise Exception("Error #6.5.1")
+    # writer which has failed accepts nothing
+    try:
+        writer.write(1)
+    except Exception as e:
+        assert "failed" in str(e), e
+    else:
+        raise Exception("Error #6.5.2")
+
+    # root name given to begin() belongs to that writer only
+    options = {"rootname": "R", "xmldec": {"version": "1.0"}}
+    writer = XmlWriter(options)
+    assert writer.begin("X").endswith(b"<X>")
+    writer = XmlWriter(options)
+    assert writer.begin().endswith(b"<R>")
+
+    # writer and its target in reference cycle are collected
+    import gc
+    import weakref
+
+    class Target(object):
+        def write(self, chunk):
+            pass
+    target = Target()
+    target.writer = XmlWriter({}, target)
+    ref = weakref.ref(target)
+    del target
+    gc.collect()
+    assert ref() is None
+
+
+def test_var2xml_keys():
+    data = [{"имя": "значение %d" % i, 1: i, "key": {"ключ": i}}
+            for i in range(100)]
+    options = {"rootname": "корень", "itemname": "запись"}
+    utf8 = var2xml(data, options)
+    assert "<1>0</1>".encode("utf-8") in utf8
+    options["encoding"] = "windows-1251"
+    cp1251 = var2xml(data, options)
+    assert cp1251 == utf8.decode("utf-8").encode("windows-1251")
+
+
+def test_var2xml_serializer():
+    options = {
+        "rootname": "ROOT",
+        "priority": ["name", "id"],
+        "cdata": ["text"],
+        "unicode": True
+    }
+    serializer = Var2XmlSerializer(options)
+    for i in range(10):
+        data = {"id": i, "text": "<текст %d>" % i, "name": "имя", "x": 1}
+        xml = serializer.dumps(data)
+        assert xml == var2xml(data, options)
+        assert xml.startswith("<ROOT><name>")
+        assert "<![CDATA[<текст %d>]]>" % i in xml
+
+    try:
+        Var2XmlSerializer({"encoding": "unknown"})
+    except Exception:
+        pass
+    else:
+        raise Exception("Error #6.6")
+
+
+def test_var2xml_numbers_and_datetimes():
+    data = {
+        "int": [0, -7, 2 ** 63 - 1, -2 ** 63, 2 ** 70, True],
+        "float": [0.125, 1.005, -0.001, 2.5, 1e20],
+        "dt": [datetime(2015, 3, 7, 9, 5, 3, 42), datetime(999, 1, 2)]
+    }
+    for fmt in ("%Y-%m-%d %H:%M:%S", "%d.%m.%Y %H%% %f", "%a %Y"):
+        options = {"priority": ["int", "float", "dt"],
+                   "date_time_format": fmt, "float_precision": 2}
+        xml = var2xml(data, options).decode("utf-8")
+        etalon = "".join(["<int>%s</int>" % i for i in
+                          ["0", "-7", str(2 ** 63 - 1), str(-2 ** 63),
+                           str(2 ** 70), "1"]] +
+                         ["<float>%.2f</float>" % f for f in data["float"]] +
+                         ["<dt>%s</dt>" % d.strftime(fmt) for d in data["dt"]])
+        assert xml == etalon, (xml, etalon)
+
+    # serializers with different formats used in turn
+    dt = datetime(2015, 3, 7, 9, 5, 3)
+    first = Var2XmlSerializer({"rootname": "r", "date_time_format": "%Y"})
+    second = Var2XmlSerializer({"rootname": "r", "date_time_format": "%H:%M"})
+    for i in range(3):
+        assert first.dumps({"dt": dt}) == b"<r><dt>2015</dt></r>"
+        assert second.dumps({"dt": dt}) == b"<r><dt>09:05</dt></r>"
+
+
+def test_var2xml_value_kinds():
+    import collections
+
+    class MyList(list):
+        pass
+
+    class MyFloat(float):
+        pass
+
+    class MyInt(int):
+        pass
+
+    data = collections.OrderedDict([
+        ("tuple", (1, "a")),
+        ("set", set([7])),
+        ("my_list", MyList([2])),
+        ("my_float", MyFloat(1.5)),
+        ("my_int", MyInt(3)),
+        ("dict", collections.OrderedDict([("$", {"a": "1"}), ("b", None)])),
+        ("bytes", b"x"),
+        ("dt", datetime(2000, 1, 2)),
+    ])
+    xml = var2xml(data, {"rootname": "r"})
+    assert xml == (b'<r><tuple>1</tuple><tuple>a</tuple><set>7</set>'
+                   b'<my_list>2</my_list><my_float>1.50</my_float>'
+                   b'<my_int>3</my_int><dict a="1"><b>None</b></dict>'
+                   b'<bytes>x</bytes><dt>2000-01-02 00:00:00</dt></r>'), xml
+
+    # output is not reserved by size of big first item times list size
+    data = ["x" * 1000000] + [1] * 200000
+    xml = var2xml(data, {"rootname": "r", "itemname": "i"})
+    assert len(xml) == 1000000 + 200001 * len(b"<i></i>") + 200000 + 7
+
+
+def test_var2xml_parallel():
+    import collections
+    data = [collections.OrderedDict([
+        ("z", i), ("a", "text < & %d" % i), ("f", i / 3.0), ("b", i % 2 == 0),
+        ("big", 2 ** 70 + i), ("none", None), ("dt", datetime(2015, 1, 1 + i % 28)),
+        ("$", {"id": i}), ("_", "t"), ("list", [1, (2, 3), {"k": "v"}]),
+        ("cd", "<cdata>")]) for i in range(3000)]
+    for options in ({"rootname": "R", "itemname": "rec",
+                     "xmldec": {"version": "1.0"},
+                     "pretty": {"indent": "  ", "newline": "\n"},
+                     "priority": ["a"], "cdata": ["cd"],
+                     "encoding": "windows-1251", "float_precision": 3},
+                    {"pretty": {"indent": "\t", "newline": "\n"}},
+                    {"rootname": "R"}):
+        etalon = var2xml(data, options)
+        options["parallel"] = 4
+        assert var2xml(data, options) == etalon
+        assert var2xml(tuple(data), options) == etalon
+        assert Var2XmlSerializer(options).dumps(data) == etalon
+
+    # big list is member of top level dict, other members are written in
+    # their usual places; dicts with many keys are looked up by index
+    wide = collections.OrderedDict(("k%d" % i, i) for i in range(20))
+    wide["$"] = {"attr": "v"}
+    wide["_"] = "text"
+    root = collections.OrderedDict([
+        ("head", {"a": 1}), ("wide", wide), ("rows", data),
+        ("tuple_rows", tuple(data[:1500])), ("tail", [1, 2]), ("p", "first")])
+    for options in ({"rootname": "R", "priority": ["p", "a"],
+                     "pretty": {"indent": "  ", "newline": "\n"},
+                     "xmldec": {"version": "1.0"}},
+                    {"rootname": "R"}):
+        etalon = var2xml(root, options)
+        options["parallel"] = 3
+        assert var2xml(root, options) == etalon
+
+    options = {"rootname": "R", "parallel": 0}
+    assert var2xml([], options) == b"<R></R>"
+    assert var2xml(data[:10], options) == var2xml(data[:10], {"rootname": "R"})
+
+
+def test_json2xml():
+    data = {"b": [1, 2.5, True, "text < &"], "a": {"$": {"x": "1"},
+            "_": "t", "c": [{"d": -3}]}, "u": "юникод"}
+    options = {"rootname": "R", "pretty": {"indent": " ", "newline": "\n"},
+               "encoding": "windows-1251"}
+    # Dynamic keeps dict keys sorted
+    etalon = var2xml(json.loads(json.dumps(data, sort_keys=True),
+                                object_pairs_hook=collections.OrderedDict),
+                     options)
+    assert json2xml(json.dumps(data), options) == etalon
+    assert json2xml(json.dumps(data).encode("utf-8"), options) == etalon
+    # JSON null becomes empty element
+    assert json2xml('{"n": null}', {"rootname": "R"}) == b"<R><n></n></R>"
+
+    for wrong in ("[1, ", "1", 1):
+        try:
+            json2xml(wrong)
+        except Exception:
+            pass
+        else:
+            raise Exception("Error #6.7")
+
+
+def test_options_from_python_data():
+    sample = read_file_text(os.path.join(NKIT_TEST_DATA_PATH, 'sample.xml'))
+    options = {"trim": True, "white_spaces": " \t\n\r"}
+    mappings = {"persons": ("/person", {"/name": "string",
+                                        "/age": "integer|0",
+                                        "/married/@firstTime": "string"}),
+                1: ["/person/phone", "string"]}
+
+    builder = Xml2VarBuilder(options, mappings)
+    builder.feed(sample)
+    result = builder.end()
+
+    builder = Xml2VarBuilder(json.dumps(options), json.dumps(mappings))
+    builder.feed(sample)
+    if result != builder.end():
+        raise Exception("Error #6.8")
+    assert "1" in result
+
+    for wrong in ({"persons": ["/person", {"/name": object()}]},
+                  {"a": ["/a", "string", float("nan")], "b": 2 ** 70},
+                  "[1, "):
+        try:
+            Xml2VarBuilder(wrong)
+        except Exception:
+            pass
+        else:
+            raise Exception("Error #6.9")
+
+    nested = []
+    nested.append(nested)
+    try:
+        Xml2VarBuilder({"a": nested})
+    except Exception:
+        pass
+    else:
+        raise Exception("Error #6.10")
+
+
+def test_dynamic():
+    data = {"a": [1, 2.5, True, None, "юникод", {"b": [[]]}],
+            "big": 2 ** 63, "neg": -7, "empty": {}}
+    d = dynamic_from_json(json.dumps(data))
+    assert isinstance(d, Dynamic)
+    assert len(d) == 4
+    assert sorted(d.keys()) == sorted(data.keys())
+    assert sorted(d) == sorted(data.keys())
+    assert "a" in d and "x" not in d
+    assert d.to_python() == data
+
+    a = d["a"]
+    assert isinstance(a, Dynamic)
+    assert len(a) == 6
+    assert a[0] == 1 and a[-1]["b"][0].to_python() == []
+    assert list(a)[1:5] == [2.5, True, None, "юникод"]
+    assert 2.5 in a
+    assert d.get("x", 5) == 5 and d.get("neg") == -7
+
+    for key in ("x", 1):
+        try:
+            d[key]
+        except KeyError:
+            pass
+        else:
+            raise Exception("Error #7.1")
+    try:
+        a[6]
+    except IndexError:
+        pass
+    else:
+        raise Exception("Error #7.2")
+    try:
+        dynamic_from_json("[1, ")
+    except Exception:
+        pass
+    else:
+        raise Exception("Error #7.3")
+
+    assert Dynamic(data).to_python() == data
+    assert Dynamic((1, "2")).to_python() == [1, "2"]
+
+    # non-string keys are converted as json.dumps() does it
+    keys = {1.5: 1, 2.0: 2, 1e20: 3, 0.1: 4, float("inf"): 5, -3: 6,
+            None: 7, True: 8}
+    assert Dynamic(keys).to_python() == json.loads(json.dumps(keys))
+
+    sample = read_file_text(os.path.join(NKIT_TEST_DATA_PATH, 'sample.xml'))
+    mappings = {"persons": ["/person", {"/name": "string",
+                                        "/age": "integer|0",
+                                        "/birthday": "datetime|1970-01-01|%Y-%m-%d"}]}
+    builder = Xml2VarBuilder({"trim": True}, mappings)
+    builder.feed(sample)
+    etalon = builder.end()
+    result = dynamic_from_xml(sample, {"trim": True}, mappings)
+    assert result.to_python() == etalon
+    assert result["persons"][0]["name"] == etalon["persons"][0]["name"]
+
+
 if __name__ == '__main__':
     unittest.main()